@@ -0,0 +1,403 @@
+// Renders N submeshes of TexCube and the Pokémon models on the headless
+// context through each draw submission path, and reports the CPU time to
+// submit one draw and the frame time of every path:
+//   uniform+attribs  glUniform and vertex attribute setup per draw, like TriangleMesh::Render
+//   uniform+VAO      glUniform per draw, one vertex array object per submesh
+//   UBO+VAO          per-draw data in one uniform buffer bound by range, one VAO per submesh
+//   MDI+SSBO         a single glMultiDrawElementsIndirect over merged buffers (GL 4.3)
+//
+// Usage: DrawSubmissionBenchmark [--draws N] [--frames N] [--output report.json] [--save-images]
+
+// C++ STL headers.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// GLM headers.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// Project headers.
+#include "Clock.h"
+#include "HeadlessContext.h"
+#include "ImageTexture.h"
+#include "ShaderProg.h"
+#include "TriangleMesh.h"
+
+using opengl_homework::TriangleMesh;
+
+// Per-draw data, laid out alike in std140 and std430.
+struct DrawData
+{
+	glm::mat4 MVP;
+	glm::mat4 worldMatrix;
+	glm::mat4 normalMatrix;
+	glm::vec4 Ka;
+	glm::vec4 Kd;
+	glm::vec4 Ks;
+};
+
+// One submesh of one of the loaded meshes.
+struct SubMeshRef
+{
+	int mesh;
+	int subMesh;
+	GLuint vaoId;
+	// Location in the merged buffers of the indirect path.
+	GLuint firstIndex;
+	GLint baseVertex;
+};
+
+// DrawElementsIndirectCommand of GL 4.3.
+struct IndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+struct PathResult
+{
+	std::string name;
+	double submitMsPerFrame = 0.0;
+	double submitUsPerDraw = 0.0;
+	double frameMs = 0.0;
+};
+
+static constexpr GLsizei kVertexStride = 8 * sizeof(float);
+
+static void SetVertexAttributes(const GLuint vboId) {
+	glBindBuffer(GL_ARRAY_BUFFER, vboId);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kVertexStride, (void*)0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, kVertexStride, (void*)(3 * sizeof(float)));
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, kVertexStride, (void*)(6 * sizeof(float)));
+}
+
+static double Median(std::vector<double> samples) {
+	std::sort(samples.begin(), samples.end());
+	return samples.empty() ? 0.0 : samples[samples.size() / 2];
+}
+
+// Render numWarmupFrames + numFrames frames with a submission path and measure the measured ones.
+static PathResult RunPath(const std::string& name, HeadlessContext& context, const int numDraws,
+	const int numFrames, const std::function<void()>& submit, const bool saveImage) {
+	const int numWarmupFrames = 10;
+	std::vector<double> submitTimes;
+	std::vector<double> frameTimes;
+	for (int frame = 0; frame < numWarmupFrames + numFrames; ++frame) {
+		context.Bind();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		Clock clock;
+		submit();
+		double submitTime = clock.GetElapsedTime() * 1000.0;
+		glFinish();
+		double frameTime = clock.GetElapsedTime() * 1000.0;
+		if (frame >= numWarmupFrames) {
+			submitTimes.push_back(submitTime);
+			frameTimes.push_back(frameTime);
+		}
+	}
+	if (saveImage) {
+		std::string fileName = name;
+		std::replace(fileName.begin(), fileName.end(), '+', '_');
+		context.SaveImage(fileName + ".png");
+	}
+
+	PathResult result;
+	result.name = name;
+	result.submitMsPerFrame = Median(submitTimes);
+	result.submitUsPerDraw = result.submitMsPerFrame * 1000.0 / numDraws;
+	result.frameMs = Median(frameTimes);
+	return result;
+}
+
+static bool WriteJson(const std::filesystem::path& filePath, const int numDraws, const std::vector<PathResult>& results) {
+	std::ofstream fout(filePath);
+	if (!fout) {
+		std::cerr << "[ERROR] Cannot write draw submission report " << filePath << std::endl;
+		return false;
+	}
+	fout << "{\n  \"draws\": " << numDraws << ",\n  \"paths\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		fout << "    { \"name\": \"" << r.name << "\", \"submit_ms\": " << r.submitMsPerFrame
+			<< ", \"submit_us_per_draw\": " << r.submitUsPerDraw << ", \"frame_ms\": " << r.frameMs << " }"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	fout << "  ]\n}\n";
+	return true;
+}
+
+int main(int argc, char** argv) {
+	int numDraws = 2000;
+	int numFrames = 200;
+	std::filesystem::path outputFile;
+	bool saveImages = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--draws" && i + 1 < argc) {
+			numDraws = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			numFrames = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			outputFile = argv[++i];
+		}
+		else if (arg == "--save-images") {
+			saveImages = true;
+		}
+	}
+
+	HeadlessContext context;
+	if (!context.Create()) {
+		return EXIT_FAILURE;
+	}
+	glewExperimental = GL_TRUE;
+	if (glewContextInit() != GLEW_OK || !context.CreateTargets(1280, 720)) {
+		std::cerr << "[ERROR] Cannot initialize the headless context" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Renderer: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+
+	// The textures are not sampled, skip their upload.
+	ImageTexture::SetUploadEnabled(false);
+	std::vector<std::unique_ptr<TriangleMesh>> meshes;
+	for (const char* name : { "TexCube", "Arcanine", "Gengar", "Ivysaur", "Koffing", "MagikarpF", "Slowbro" }) {
+		auto objFilePath = std::filesystem::path("models") / name / (std::string(name) + ".obj");
+		if (!std::filesystem::exists(objFilePath)) {
+			continue;
+		}
+		meshes.push_back(std::make_unique<TriangleMesh>(objFilePath, true));
+		meshes.back()->CreateBuffers();
+	}
+
+	// One VAO per submesh, and the submeshes laid out one after the other in the merged buffers.
+	std::vector<SubMeshRef> subMeshes;
+	GLuint numMergedIndices = 0;
+	GLint numMergedVertices = 0;
+	for (int m = 0; m < (int)meshes.size(); ++m) {
+		for (int s = 0; s < meshes[m]->GetNumSubMeshes(); ++s) {
+			if (meshes[m]->GetSubMeshNumIndices(s) == 0) {
+				continue;
+			}
+			SubMeshRef ref = { m, s, 0, numMergedIndices, numMergedVertices };
+			glGenVertexArrays(1, &ref.vaoId);
+			glBindVertexArray(ref.vaoId);
+			SetVertexAttributes(meshes[m]->GetVertexBuffer());
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshes[m]->GetSubMeshIndexBuffer(s));
+			glBindVertexArray(0);
+			subMeshes.push_back(ref);
+			numMergedIndices += meshes[m]->GetSubMeshNumIndices(s);
+		}
+		numMergedVertices += meshes[m]->GetNumVertices();
+	}
+	if (subMeshes.empty()) {
+		std::cerr << "[ERROR] No models found in models/" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Draw i renders submesh i % #submeshes on a grid facing the camera.
+	const int gridSize = (int)std::ceil(std::sqrt((double)numDraws));
+	const float cellSize = 2.0f / gridSize;
+	const glm::mat4 VP = glm::perspective(glm::radians(30.0f), 1280.0f / 720.0f, 0.1f, 100.0f)
+		* glm::lookAt(glm::vec3(0.0f, 0.0f, 4.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	std::vector<DrawData> drawData(numDraws);
+	for (int i = 0; i < numDraws; ++i) {
+		glm::vec3 position = glm::vec3(-1.0f + cellSize * (i % gridSize + 0.5f), -1.0f + cellSize * (i / gridSize + 0.5f), 0.0f);
+		glm::mat4 world = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.9f * cellSize));
+		DrawData& data = drawData[i];
+		data.MVP = VP * world;
+		data.worldMatrix = world;
+		data.normalMatrix = glm::transpose(glm::inverse(world));
+		data.Ka = glm::vec4(0.1f, 0.1f, 0.1f, 0.0f);
+		data.Kd = glm::vec4((i * 37 % 256) / 255.0f, (i * 91 % 256) / 255.0f, (i * 53 % 256) / 255.0f, 0.0f);
+		data.Ks = glm::vec4(0.2f, 0.2f, 0.2f, 0.0f);
+	}
+	auto getSubMesh = [&subMeshes](const int draw) -> const SubMeshRef& { return subMeshes[draw % subMeshes.size()]; };
+	auto getNumIndices = [&meshes](const SubMeshRef& ref) { return meshes[ref.mesh]->GetSubMeshNumIndices(ref.subMesh); };
+
+	DrawSubmissionShaderProg uniformShader;
+	DrawSubmissionShaderProg uboShader;
+	if (!uniformShader.LoadFromFiles("shaders/draw_submission.vs", "shaders/draw_submission.fs", "")
+		|| !uboShader.LoadFromFiles("shaders/draw_submission.vs", "shaders/draw_submission.fs", "", { "PER_DRAW_UBO" })) {
+		std::cerr << "[ERROR] Cannot load the draw submission shaders" << std::endl;
+		return EXIT_FAILURE;
+	}
+	auto setUniforms = [&uniformShader](const DrawData& data) {
+		glUniformMatrix4fv(uniformShader.GetLocMVP(), 1, GL_FALSE, glm::value_ptr(data.MVP));
+		glUniformMatrix4fv(uniformShader.GetLocWorldMatrix(), 1, GL_FALSE, glm::value_ptr(data.worldMatrix));
+		glUniformMatrix4fv(uniformShader.GetLocNormalMatrix(), 1, GL_FALSE, glm::value_ptr(data.normalMatrix));
+		glUniform4fv(uniformShader.GetLocKa(), 1, glm::value_ptr(data.Ka));
+		glUniform4fv(uniformShader.GetLocKd(), 1, glm::value_ptr(data.Kd));
+		glUniform4fv(uniformShader.GetLocKs(), 1, glm::value_ptr(data.Ks));
+	};
+
+	std::vector<PathResult> results;
+
+	// The pattern of TriangleMesh::Render and RenderSubMesh.
+	results.push_back(RunPath("uniform+attribs", context, numDraws, numFrames, [&]() {
+		for (int i = 0; i < numDraws; ++i) {
+			const SubMeshRef& ref = getSubMesh(i);
+			uniformShader.Bind();
+			setUniforms(drawData[i]);
+			SetVertexAttributes(meshes[ref.mesh]->GetVertexBuffer());
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshes[ref.mesh]->GetSubMeshIndexBuffer(ref.subMesh));
+			glDrawElements(GL_TRIANGLES, getNumIndices(ref), GL_UNSIGNED_INT, 0);
+			glDisableVertexAttribArray(0);
+			glDisableVertexAttribArray(1);
+			glDisableVertexAttribArray(2);
+			uniformShader.Unbind();
+		}
+	}, saveImages));
+
+	results.push_back(RunPath("uniform+VAO", context, numDraws, numFrames, [&]() {
+		uniformShader.Bind();
+		for (int i = 0; i < numDraws; ++i) {
+			const SubMeshRef& ref = getSubMesh(i);
+			setUniforms(drawData[i]);
+			glBindVertexArray(ref.vaoId);
+			glDrawElements(GL_TRIANGLES, getNumIndices(ref), GL_UNSIGNED_INT, 0);
+		}
+		glBindVertexArray(0);
+		uniformShader.Unbind();
+	}, saveImages));
+
+	// The ranges must start at multiples of the offset alignment.
+	GLint uboAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+	const GLsizeiptr uboStride = (sizeof(DrawData) + uboAlignment - 1) / uboAlignment * uboAlignment;
+	std::vector<unsigned char> uboData(uboStride * numDraws);
+	GLuint uboId = 0;
+	glGenBuffers(1, &uboId);
+	glBindBuffer(GL_UNIFORM_BUFFER, uboId);
+	glBufferData(GL_UNIFORM_BUFFER, uboData.size(), nullptr, GL_STREAM_DRAW);
+	results.push_back(RunPath("UBO+VAO", context, numDraws, numFrames, [&]() {
+		for (int i = 0; i < numDraws; ++i) {
+			std::copy_n((const unsigned char*)&drawData[i], sizeof(DrawData), uboData.data() + uboStride * i);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, uboId);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, uboData.size(), uboData.data());
+		uboShader.Bind();
+		for (int i = 0; i < numDraws; ++i) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, DrawSubmissionShaderProg::kDrawBlockBinding, uboId, uboStride * i, sizeof(DrawData));
+			glBindVertexArray(getSubMesh(i).vaoId);
+			glDrawElements(GL_TRIANGLES, getNumIndices(getSubMesh(i)), GL_UNSIGNED_INT, 0);
+		}
+		glBindVertexArray(0);
+		uboShader.Unbind();
+	}, saveImages));
+
+	if (GLEW_VERSION_4_3) {
+		// Merge the vertex and index buffers on the GPU.
+		GLuint mergedVboId = 0;
+		GLuint mergedIboId = 0;
+		glGenBuffers(1, &mergedVboId);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mergedVboId);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)numMergedVertices * kVertexStride, nullptr, GL_STATIC_DRAW);
+		GLintptr vertexOffset = 0;
+		for (const auto& mesh : meshes) {
+			const GLsizeiptr size = (GLsizeiptr)mesh->GetNumVertices() * kVertexStride;
+			glBindBuffer(GL_COPY_READ_BUFFER, mesh->GetVertexBuffer());
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, vertexOffset, size);
+			vertexOffset += size;
+		}
+		glGenBuffers(1, &mergedIboId);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mergedIboId);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)numMergedIndices * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+		for (const auto& ref : subMeshes) {
+			glBindBuffer(GL_COPY_READ_BUFFER, meshes[ref.mesh]->GetSubMeshIndexBuffer(ref.subMesh));
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+				ref.firstIndex * sizeof(GLuint), getNumIndices(ref) * sizeof(GLuint));
+		}
+
+		// The base instance of command i selects draws[i] through the DrawId attribute.
+		std::vector<IndirectCommand> commands(numDraws);
+		std::vector<GLuint> drawIds(numDraws);
+		for (int i = 0; i < numDraws; ++i) {
+			const SubMeshRef& ref = getSubMesh(i);
+			commands[i] = { (GLuint)getNumIndices(ref), 1, ref.firstIndex, ref.baseVertex, (GLuint)i };
+			drawIds[i] = (GLuint)i;
+		}
+		GLuint indirectBufferId = 0;
+		glGenBuffers(1, &indirectBufferId);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferId);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(IndirectCommand) * commands.size(), commands.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		GLuint drawIdVboId = 0;
+		glGenBuffers(1, &drawIdVboId);
+		glBindBuffer(GL_ARRAY_BUFFER, drawIdVboId);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * drawIds.size(), drawIds.data(), GL_STATIC_DRAW);
+		GLuint ssboId = 0;
+		glGenBuffers(1, &ssboId);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboId);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawData) * drawData.size(), nullptr, GL_STREAM_DRAW);
+
+		GLuint mergedVaoId = 0;
+		glGenVertexArrays(1, &mergedVaoId);
+		glBindVertexArray(mergedVaoId);
+		SetVertexAttributes(mergedVboId);
+		glBindBuffer(GL_ARRAY_BUFFER, drawIdVboId);
+		glEnableVertexAttribArray(3);
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+		glVertexAttribDivisor(3, 1);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mergedIboId);
+		glBindVertexArray(0);
+
+		DrawSubmissionShaderProg indirectShader;
+		if (indirectShader.LoadFromFiles("shaders/draw_submission_indirect.vs", "shaders/draw_submission.fs", "")) {
+			results.push_back(RunPath("MDI+SSBO", context, numDraws, numFrames, [&]() {
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboId);
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DrawData) * drawData.size(), drawData.data());
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawSubmissionShaderProg::kDrawBlockBinding, ssboId);
+				indirectShader.Bind();
+				glBindVertexArray(mergedVaoId);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferId);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, numDraws, 0);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+				glBindVertexArray(0);
+				indirectShader.Unbind();
+			}, saveImages));
+		}
+
+		glDeleteVertexArrays(1, &mergedVaoId);
+		GLuint buffers[5] = { mergedVboId, mergedIboId, indirectBufferId, drawIdVboId, ssboId };
+		glDeleteBuffers(5, buffers);
+	}
+	else {
+		std::cout << "Multi-draw indirect skipped, it requires OpenGL 4.3." << std::endl;
+	}
+
+	for (const auto& ref : subMeshes) {
+		glDeleteVertexArrays(1, &ref.vaoId);
+	}
+	glDeleteBuffers(1, &uboId);
+
+	std::printf("%-16s %8s %14s %14s %10s\n", "Path", "Draws", "Submit ms", "us per draw", "Frame ms");
+	for (const auto& r : results) {
+		std::printf("%-16s %8d %14.3f %14.3f %10.3f\n", r.name.c_str(), numDraws, r.submitMsPerFrame, r.submitUsPerDraw, r.frameMs);
+	}
+	if (!outputFile.empty() && !WriteJson(outputFile, numDraws, results)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+// Compares the throughput of the job system with std::async on the shapes of
+// work the engine hands to it:
+//   tiny jobs       many independent jobs doing almost nothing, the scheduling cost
+//   parallel for    a loop over a large array split in chunks, like culling a scene
+//   fork-join       jobs spawning and waiting for subjobs, like nested loaders
+// std::async starts a thread per task, so it is given the same chunks but is
+// not nested as deep.
+//
+// It then checks that a frame never waits on a long background job: frames
+// made of a job running a parallel for must stay far shorter than the
+// background jobs queued before them, like panorama decodes. The benchmark
+// fails if one does not.
+//
+// Usage: JobSystemBenchmark [--workers N] [--repeat N]
+
+// C++ STL headers.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+// Project headers.
+#include "Clock.h"
+#include "JobSystem.h"
+
+// Median time in milliseconds of repeated runs.
+static double Measure(const int numRepeats, const std::function<void()>& run) {
+	std::vector<double> times;
+	for (int i = 0; i < numRepeats; ++i) {
+		Clock clock;
+		run();
+		times.push_back(clock.GetElapsedTime() * 1000.0);
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+static void PrintRow(const char* name, const int numTasks, const double jobTime, const double asyncTime) {
+	std::printf("%-14s %9d %12.3f %12.3f %10.0f %10.0f %8.2fx\n", name, numTasks, jobTime, asyncTime,
+		numTasks / jobTime * 1000.0, numTasks / asyncTime * 1000.0, asyncTime / jobTime);
+}
+
+// Some arithmetic per element, so that a chunk is worth a job.
+static float Work(const float x) {
+	return std::sqrt(x * x + 1.0f) * std::sin(x);
+}
+
+static int64_t ForkJoin(JobSystem& jobSystem, const int depth) {
+	if (depth == 0) {
+		return 1;
+	}
+	std::atomic<int64_t> sum = 0;
+	JobCounter counter;
+	for (int i = 0; i < 4; ++i) {
+		jobSystem.Run([&jobSystem, &sum, depth]() { sum += ForkJoin(jobSystem, depth - 1); }, &counter);
+	}
+	jobSystem.Wait(counter);
+	return sum;
+}
+
+// Busy for the given seconds, like a decode.
+static void Spin(const double seconds) {
+	Clock clock;
+	while (clock.GetElapsedTime() < seconds) {
+	}
+}
+
+static int64_t ForkJoinAsync(const int depth) {
+	if (depth == 0) {
+		return 1;
+	}
+	std::vector<std::future<int64_t>> futures;
+	for (int i = 0; i < 4; ++i) {
+		futures.push_back(std::async(std::launch::async, ForkJoinAsync, depth - 1));
+	}
+	int64_t sum = 0;
+	for (auto& future : futures) {
+		sum += future.get();
+	}
+	return sum;
+}
+
+int main(int argc, char** argv) {
+	int numWorkers = 0;
+	int numRepeats = 5;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--workers" && i + 1 < argc) {
+			numWorkers = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--repeat" && i + 1 < argc) {
+			numRepeats = std::max(1, std::atoi(argv[++i]));
+		}
+	}
+
+	JobSystem jobSystem(numWorkers);
+	std::printf("Threads: %d (workers and the calling thread)\n\n", jobSystem.GetNumThreads());
+	std::printf("%-14s %9s %12s %12s %10s %10s %9s\n", "Workload", "Tasks", "Jobs ms", "async ms", "Jobs/s", "async/s", "Speedup");
+
+	// Tiny jobs.
+	{
+		const int numJobs = 20000;
+		std::atomic<int> count = 0;
+		double jobTime = Measure(numRepeats, [&]() {
+			JobCounter counter;
+			for (int i = 0; i < numJobs; ++i) {
+				jobSystem.Run([&count]() { ++count; }, &counter);
+			}
+			jobSystem.Wait(counter);
+		});
+		double asyncTime = Measure(numRepeats, [&]() {
+			std::vector<std::future<void>> futures;
+			futures.reserve(numJobs);
+			for (int i = 0; i < numJobs; ++i) {
+				futures.push_back(std::async(std::launch::async, [&count]() { ++count; }));
+			}
+			for (auto& future : futures) {
+				future.wait();
+			}
+		});
+		PrintRow("tiny jobs", numJobs, jobTime, asyncTime);
+	}
+
+	// Parallel for over 4M elements in chunks of 16K.
+	{
+		const int numElements = 1 << 22;
+		const int grainSize = 1 << 14;
+		const int numChunks = numElements / grainSize;
+		std::vector<float> input(numElements);
+		std::vector<float> output(numElements);
+		for (int i = 0; i < numElements; ++i) {
+			input[i] = (float)i * 0.001f;
+		}
+		auto body = [&input, &output](const int first, const int last) {
+			for (int i = first; i < last; ++i) {
+				output[i] = Work(input[i]);
+			}
+		};
+		double serialTime = Measure(numRepeats, [&]() { body(0, numElements); });
+		double jobTime = Measure(numRepeats, [&]() { jobSystem.ParallelFor(0, numElements, grainSize, body); });
+		double asyncTime = Measure(numRepeats, [&]() {
+			std::vector<std::future<void>> futures;
+			for (int first = 0; first < numElements; first += grainSize) {
+				futures.push_back(std::async(std::launch::async, body, first, std::min(numElements, first + grainSize)));
+			}
+			for (auto& future : futures) {
+				future.wait();
+			}
+		});
+		PrintRow("parallel for", numChunks, jobTime, asyncTime);
+		std::printf("%-14s %9s %12.3f  (serial, %.2fx with jobs)\n", "", "", serialTime, serialTime / jobTime);
+	}
+
+	// Fork-join trees of 4^depth leaves.
+	{
+		const int depth = 6;
+		const int asyncDepth = 4;
+		const int numJobs = (int)((std::pow(4.0, depth + 1) - 1) / 3) - 1;
+		const int numAsyncTasks = (int)((std::pow(4.0, asyncDepth + 1) - 1) / 3) - 1;
+		double jobTime = Measure(numRepeats, [&]() { ForkJoin(jobSystem, depth); });
+		double asyncTime = Measure(numRepeats, [&]() { ForkJoinAsync(asyncDepth); });
+		PrintRow("fork-join", numJobs, jobTime, asyncTime * numJobs / numAsyncTasks);
+		std::printf("%-14s %9d %12s %12.3f  (std::async measured at depth %d, scaled to the job count)\n",
+			"", numAsyncTasks, "", asyncTime, asyncDepth);
+	}
+
+	// Frames while one long background job per thread is queued.
+	{
+		const double longJobTime = 0.2;
+		const int numFrames = 20;
+		JobCounter backgroundCounter;
+		for (int i = 0; i < jobSystem.GetNumThreads(); ++i) {
+			jobSystem.RunBackground([longJobTime]() { Spin(longJobTime); }, &backgroundCounter);
+		}
+		std::vector<float> values(1 << 16);
+		double maxFrameTime = 0.0;
+		for (int frame = 0; frame < numFrames; ++frame) {
+			Clock clock;
+			JobCounter frameCounter;
+			jobSystem.Run([&]() {
+				jobSystem.ParallelFor(0, (int)values.size(), 1 << 10, [&values, frame](const int first, const int last) {
+					for (int i = first; i < last; ++i) {
+						values[i] = Work((float)(i + frame));
+					}
+				});
+			}, &frameCounter);
+			jobSystem.Wait(frameCounter);
+			maxFrameTime = std::max(maxFrameTime, clock.GetElapsedTime() * 1000.0);
+		}
+		jobSystem.Wait(backgroundCounter);
+		std::printf("\nLongest of %d frames with %d background jobs of %.0f ms queued: %.3f ms\n",
+			numFrames, jobSystem.GetNumThreads(), longJobTime * 1000.0, maxFrameTime);
+		if (maxFrameTime > 0.5 * longJobTime * 1000.0) {
+			std::fprintf(stderr, "[ERROR] A frame waited on a background job\n");
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+// Loads every model in models/ through the CPU part of TriangleMesh, with the
+// GL uploads disabled, and reports the time of each loading stage. The peak
+// RSS is that of the process after each model; the models load from the
+// smallest up, so it follows the largest model loaded so far.
+//
+// Usage: LoaderBenchmark [--repeat N] [--output report.json] [models directory]
+
+// C++ STL headers.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Project headers.
+#include "Clock.h"
+#include "ImageTexture.h"
+#include "TriangleMesh.h"
+
+using opengl_homework::TriangleMesh;
+
+struct ModelResult
+{
+	std::string name;
+	int numVertices = 0;
+	int numTriangles = 0;
+	double totalTime = 0.0;
+	TriangleMesh::LoadStats stats;
+	size_t peakRssBytes = 0;
+};
+
+// Peak resident set size of the process so far.
+static size_t GetPeakRssBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	// Kilobytes on Linux.
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+// Load a model repeat times and keep the run with the median total time.
+static ModelResult LoadModel(const std::filesystem::path& objFilePath, const int repeat) {
+	std::vector<ModelResult> runs;
+	for (int i = 0; i < repeat; ++i) {
+		ModelResult run;
+		run.name = objFilePath.stem().string();
+		Clock clock;
+		TriangleMesh mesh(objFilePath, true);
+		run.totalTime = clock.GetElapsedTime();
+		run.numVertices = mesh.GetNumVertices();
+		run.numTriangles = mesh.GetNumTriangles();
+		run.stats = mesh.GetLoadStats();
+		run.peakRssBytes = GetPeakRssBytes();
+		runs.push_back(run);
+	}
+	std::sort(runs.begin(), runs.end(), [](const ModelResult& lhs, const ModelResult& rhs) { return lhs.totalTime < rhs.totalTime; });
+	return runs[runs.size() / 2];
+}
+
+static bool WriteJson(const std::filesystem::path& filePath, const std::vector<ModelResult>& results) {
+	std::ofstream fout(filePath);
+	if (!fout) {
+		std::cerr << "[ERROR] Cannot write loader report " << filePath << std::endl;
+		return false;
+	}
+	fout << "{\n  \"models\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		fout << "    { \"name\": \"" << r.name << "\", \"bytes\": " << r.stats.numFileBytes
+			<< ", \"vertices\": " << r.numVertices << ", \"triangles\": " << r.numTriangles
+			<< ", \"total_ms\": " << r.totalTime * 1000.0
+			<< ", \"read_ms\": " << r.stats.readTime * 1000.0
+			<< ", \"parse_ms\": " << r.stats.parseTime * 1000.0
+			<< ", \"mtl_ms\": " << r.stats.mtlTime * 1000.0
+			<< ", \"texture_ms\": " << r.stats.textureTime * 1000.0
+			<< ", \"normalize_ms\": " << r.stats.normalizeTime * 1000.0
+			<< ", \"post_process_ms\": " << r.stats.postProcessTime * 1000.0
+			<< ", \"mb_per_s\": " << r.stats.numFileBytes / (1024.0 * 1024.0) / r.totalTime
+			<< ", \"vertices_per_s\": " << r.numVertices / r.totalTime
+			<< ", \"peak_rss_mb\": " << r.peakRssBytes / (1024.0 * 1024.0) << " }"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	fout << "  ]\n}\n";
+	return true;
+}
+
+int main(int argc, char** argv) {
+	std::filesystem::path modelsDir = "models";
+	std::filesystem::path outputFile;
+	int repeat = 3;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--repeat" && i + 1 < argc) {
+			repeat = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			outputFile = argv[++i];
+		}
+		else {
+			modelsDir = arg;
+		}
+	}
+
+	// Every model is in <models>/<name>/<name>.obj, loaded from the smallest file up.
+	std::vector<std::filesystem::path> objFiles;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(modelsDir, ec)) {
+		auto objFilePath = entry.path() / (entry.path().filename().string() + ".obj");
+		if (entry.is_directory() && std::filesystem::exists(objFilePath)) {
+			objFiles.push_back(objFilePath);
+		}
+	}
+	if (objFiles.empty()) {
+		std::cerr << "[ERROR] No models found in " << modelsDir << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::sort(objFiles.begin(), objFiles.end(), [](const auto& lhs, const auto& rhs) {
+		return std::filesystem::file_size(lhs) < std::filesystem::file_size(rhs);
+	});
+
+	// No GL context exists here, the textures are decoded only.
+	ImageTexture::SetUploadEnabled(false);
+
+	std::vector<ModelResult> results;
+	std::printf("%-12s %9s %9s %8s %8s %8s %8s %8s %8s %8s %8s %10s %9s\n", "Model", "MB", "Vertices", "Total ms",
+		"Read", "Parse", "MTL", "Texture", "Normal.", "Post", "MB/s", "MVerts/s", "Peak MB");
+	for (const auto& objFilePath : objFiles) {
+		ModelResult r = LoadModel(objFilePath, repeat);
+		const double megabytes = r.stats.numFileBytes / (1024.0 * 1024.0);
+		std::printf("%-12s %9.2f %9d %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %10.2f %9.1f\n", r.name.c_str(),
+			megabytes, r.numVertices, r.totalTime * 1000.0,
+			r.stats.readTime * 1000.0, r.stats.parseTime * 1000.0, r.stats.mtlTime * 1000.0, r.stats.textureTime * 1000.0,
+			r.stats.normalizeTime * 1000.0, r.stats.postProcessTime * 1000.0,
+			megabytes / r.totalTime, r.numVertices / r.totalTime * 1e-6, r.peakRssBytes / (1024.0 * 1024.0));
+		results.push_back(r);
+	}
+
+	if (!outputFile.empty() && !WriteJson(outputFile, results)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
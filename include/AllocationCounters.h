@@ -0,0 +1,32 @@
+#pragma once
+
+// C++ STL headers.
+#include <cstdint>
+
+/**
+ * @brief AllocationCounters class.
+ *
+ * Counts the calls of the global operator new, to check that the frames do
+ * not allocate. Built with ALLOCATION_COUNTERS, the library replaces every
+ * form of the global operator new with one that counts before allocating
+ * with malloc; counting is one relaxed atomic increment.
+ *
+ * Without ALLOCATION_COUNTERS nothing is replaced and the count stays zero.
+*/
+class AllocationCounters
+{
+public:
+	// AllocationCounters Public Methods.
+	static constexpr bool IsEnabled() {
+#ifdef ALLOCATION_COUNTERS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Number of global operator new calls on all threads since the start.
+	*/
+	static uint64_t GetNumAllocations();
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+// C++ STL headers.
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Project headers.
+#include "GLCallCounters.h"
+
+/**
+ * @brief BenchmarkReport class.
+ *
+ * Collects the measured frames of a benchmark run, summarizes them as
+ * percentiles, and reads and writes the summary as JSON so that a run can be
+ * compared against a stored baseline.
+*/
+class BenchmarkReport
+{
+public:
+	// Percentiles Declarations.
+	// Milliseconds, negative when no frame was measured.
+	struct Percentiles
+	{
+		double p50 = -1.0;
+		double p95 = -1.0;
+		double p99 = -1.0;
+	};
+
+	// BenchmarkReport Public Methods.
+	BenchmarkReport(const std::string& name);
+
+	/**
+	 * @param gpuFrameTime Negative if the GPU time of the frame is unknown.
+	*/
+	void AddFrame(const double cpuFrameTime, const double gpuFrameTime, const int numDrawCalls, const int numTriangles);
+
+	/**
+	 * @brief Add the GL call counts of a measured frame, written as their averages when GL_CALL_COUNTERS is enabled.
+	*/
+	void AddGLCallCounts(const GLCallCounters::Counts& counts);
+
+	/**
+	 * @brief Add the heap allocations of a measured frame, written when ALLOCATION_COUNTERS is enabled.
+	*/
+	void AddAllocations(const uint64_t numAllocations);
+
+	/**
+	 * @brief Compute the percentiles and the averages of the frames added so far.
+	*/
+	void Summarize();
+
+	bool WriteJson(const std::filesystem::path& filePath) const;
+	bool LoadJson(const std::filesystem::path& filePath);
+
+	/**
+	 * @brief Print and count the metrics more than threshold (a fraction) above the baseline.
+	*/
+	int CountRegressions(const BenchmarkReport& baseline, const double threshold) const;
+
+	const Percentiles& GetCpuFrameTime() const { return cpuFrameTime; }
+	const Percentiles& GetGpuFrameTime() const { return gpuFrameTime; }
+	double GetDrawCalls() const { return drawCalls; }
+	double GetTriangles() const { return triangles; }
+	// Frames of the run which allocated from the heap.
+	int GetNumAllocatingFrames() const { return numAllocatingFrames; }
+
+private:
+	// BenchmarkReport Private Methods.
+	static Percentiles ComputePercentiles(std::vector<double> samples);
+
+	// BenchmarkReport Private Data.
+	std::string name;
+	int numFrames;
+	std::vector<double> cpuSamples;
+	std::vector<double> gpuSamples;
+	double drawCallSum;
+	double triangleSum;
+	int numCountedFrames;
+	GLCallCounters::Counts glCallSum;
+	uint64_t allocationSum;
+	uint64_t maxAllocations;
+	int numAllocatingFrames;
+	Percentiles cpuFrameTime;
+	Percentiles gpuFrameTime;
+	// Averages per frame.
+	double drawCalls;
+	double triangles;
+};
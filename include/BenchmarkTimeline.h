@@ -0,0 +1,74 @@
+#pragma once
+
+// C++ STL headers.
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// GLM headers.
+#include <glm/glm.hpp>
+
+/**
+ * @brief BenchmarkTimeline class.
+ *
+ * Scripted benchmark run read from a text file with one command per line,
+ * # starting a comment:
+ *   model <name>                       model directory in models/
+ *   skybox <name>                      panorama directory in textures/
+ *   timestep <seconds>                 fixed animation step of every frame
+ *   warmup <frames>                    frames played before measuring
+ *   frames <frames>                    measured frames
+ *   camera <time> <eye xyz> <target xyz>
+ *   pointlight <time> <position xyz>
+ *   spotlight <time> <position xyz>
+ * The camera and the lights move linearly between their keys, sorted by time,
+ * and hold the first and the last key outside of them.
+*/
+class BenchmarkTimeline
+{
+public:
+	// BenchmarkTimeline Public Methods.
+	BenchmarkTimeline();
+
+	bool LoadFromFile(const std::filesystem::path& filePath);
+
+	const std::string& GetName() const { return name; }
+	const std::string& GetModel() const { return model; }
+	const std::string& GetSkybox() const { return skybox; }
+	double GetTimeStep() const { return timeStep; }
+	int GetNumWarmupFrames() const { return numWarmupFrames; }
+	int GetNumMeasuredFrames() const { return numMeasuredFrames; }
+
+	/**
+	 * @brief Interpolate the keys at a time.
+	 *
+	 * @return false if the timeline has no key of this kind.
+	*/
+	bool SampleCamera(const double time, glm::vec3& eye, glm::vec3& target) const;
+	bool SamplePointLight(const double time, glm::vec3& position) const;
+	bool SampleSpotLight(const double time, glm::vec3& position) const;
+
+private:
+	// Key Declarations.
+	// Camera keys store the target in b, light keys leave it unused.
+	struct Key
+	{
+		double time;
+		glm::vec3 a;
+		glm::vec3 b;
+	};
+
+	// BenchmarkTimeline Private Methods.
+	static bool Sample(const std::vector<Key>& keys, const double time, glm::vec3& a, glm::vec3& b);
+
+	// BenchmarkTimeline Private Data.
+	std::string name;
+	std::string model;
+	std::string skybox;
+	double timeStep;
+	int numWarmupFrames;
+	int numMeasuredFrames;
+	std::vector<Key> cameraKeys;
+	std::vector<Key> pointLightKeys;
+	std::vector<Key> spotLightKeys;
+};
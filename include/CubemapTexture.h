@@ -0,0 +1,70 @@
+#pragma once
+
+// C++ STL headers.
+#include <string>
+#include <memory>
+#include <filesystem>
+
+// OpenCV headers.
+#include <opencv2/opencv.hpp>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// CubemapImage Declarations.
+// Decoded cube faces in CPU memory, ready to be uploaded.
+struct CubemapImage
+{
+	std::filesystem::path texFilePath;
+	int faceSize = 0;
+	int numChannels = 0;
+	cv::Mat faces[6];
+};
+
+// CubemapTexture Declarations.
+// Converts an equirectangular panorama into a mipmapped cube map once at load time.
+class CubemapTexture
+{
+public:
+	// CubemapTexture Public Methods.
+	CubemapTexture(const std::filesystem::path& panoramaPath);
+	CubemapTexture(const CubemapImage& image);
+	~CubemapTexture();
+
+	void Bind(GLenum textureUnit);
+	std::filesystem::path GetTexFilePath() const { return texFilePath; }
+	int GetFaceSize() const { return faceSize; }
+
+	/**
+	 * @brief Get the GPU memory used by the cube map, including mipmaps.
+	*/
+	size_t GetSizeInBytes() const;
+
+	/**
+	 * @brief Decode a panorama and convert it into cube faces.
+	 *
+	 * @note This function does not touch OpenGL and can run on any thread.
+	 *
+	 * @return nullptr if the panorama cannot be loaded.
+	*/
+	static std::shared_ptr<CubemapImage> DecodePanorama(const std::filesystem::path& panoramaPath);
+
+	/**
+	 * @brief Resample the six cube faces from an equirectangular panorama.
+	 *
+	 * @param panorama Panorama with the top row at +Y, as loaded by cv::imread.
+	 * @param faceSize Width and height of each face.
+	 * @param faces Output faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order.
+	*/
+	static void ConvertPanorama(const cv::Mat& panorama, const int faceSize, cv::Mat faces[6]);
+
+private:
+	// CubemapTexture Private Methods.
+	void Upload(const CubemapImage& image);
+
+	// CubemapTexture Private Data.
+	std::filesystem::path texFilePath;
+	GLuint textureObj;
+	int faceSize;
+	int numChannels;
+};
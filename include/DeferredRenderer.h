@@ -0,0 +1,81 @@
+#pragma once
+
+// C++ STL headers.
+#include <memory>
+#include <vector>
+
+// GLM headers.
+#include <glm/glm.hpp>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// Project headers.
+#include "Camera.h"
+#include "Light.h"
+#include "LightClusterGrid.h"
+#include "ShaderProg.h"
+
+/**
+ * @brief DeferredRenderer class.
+ *
+ * The geometry pass writes the materials into a G-buffer of 16 bytes per pixel
+ * plus depth:
+ *   0. RGBA8:       diffuse color, log2(Ns + 1) / 11.
+ *   1. RGBA8:       Ks.
+ *   2. RG16:        octahedral view space normal, remapped to [0, 1].
+ *   3. RGB10_A2:    Ka * ambientLight.
+ * The lighting pass then adds the ambient and directional light in one
+ * full-screen pass, and every point and spot light with an instanced box
+ * around its range, so that a light only shades the pixels it can reach.
+*/
+class DeferredRenderer
+{
+public:
+	// DeferredRenderer Public Methods.
+	DeferredRenderer(const int width, const int height);
+	~DeferredRenderer();
+
+	void Resize(const int width, const int height);
+
+	/**
+	 * @brief Bind and clear the G-buffer. Render the meshes with gbuffer.fs afterwards.
+	*/
+	void BeginGeometryPass();
+	void EndGeometryPass();
+
+	/**
+	 * @brief Shade the G-buffer into the bound framebuffer and copy its depth.
+	 *
+	 * @param lights Point and spot lights in view space.
+	*/
+	void RenderLighting(
+		const std::shared_ptr<Camera>& camera,
+		const std::shared_ptr<DirectionalLight>& dirLight,
+		const std::vector<LightClusterGrid::Light>& lights,
+		const std::shared_ptr<DeferredLightingShaderProg>& directionalShader,
+		const std::shared_ptr<DeferredLightingShaderProg>& lightShader);
+
+private:
+	// DeferredRenderer Private Methods.
+	void CreateTargets();
+	void ReleaseTargets();
+	void BindGBuffer(const std::shared_ptr<DeferredLightingShaderProg>& shader) const;
+
+	// DeferredRenderer Private Data.
+	static constexpr int kNumColorTargets = 4;
+
+	int width;
+	int height;
+	GLuint fboId;
+	// Framebuffer bound before the geometry pass, restored after it.
+	GLint prevFboId;
+	GLuint colorTexIds[kNumColorTargets];
+	GLuint depthTexId;
+	// Full-screen triangle, unit box and the per-instance lights.
+	GLuint triangleVboId;
+	GLuint boxVboId;
+	GLuint boxIboId;
+	GLuint lightVboId;
+	int numBoxIndices;
+};
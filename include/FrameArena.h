@@ -0,0 +1,84 @@
+#pragma once
+
+// C++ STL headers.
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief FrameArena class.
+ *
+ * Linear allocator for the temporaries of one frame: draw packets, culling
+ * results and formatted text. Allocating bumps an atomic offset into one
+ * block, so jobs can allocate concurrently, and nothing is freed until Reset
+ * rewinds the whole arena at the start of the next frame. Requests past the
+ * block go to the heap and are counted; Reset then frees them and grows the
+ * block, so the frames after the first few allocate nothing from the heap.
+ *
+ * @note Only trivially destructible objects may live in the arena, no destructor runs.
+*/
+class FrameArena
+{
+public:
+	// FrameArena Public Methods.
+	FrameArena(const size_t capacity);
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	/**
+	 * @brief Release everything allocated since the last reset.
+	 *
+	 * @note Must not overlap any allocation, nor any use of the memory handed out.
+	*/
+	void Reset();
+
+	/**
+	 * @brief Thread-safe, the memory stays valid until the next Reset.
+	*/
+	void* Allocate(const size_t size, const size_t alignment = alignof(std::max_align_t));
+
+	/**
+	 * @brief Uninitialized storage for count objects of type T.
+	*/
+	template <typename T>
+	T* AllocateArray(const size_t count) {
+		static_assert(std::is_trivially_destructible_v<T>, "FrameArena never runs destructors");
+		return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	/**
+	 * @brief printf into the arena.
+	 *
+	 * @return The null-terminated text, valid until the next Reset.
+	*/
+	const char* Format(const char* format, ...);
+
+	size_t GetCapacity() const { return capacity; }
+	// Bytes handed out since the last reset, including the heap overflow.
+	size_t GetUsedBytes() const;
+	// Heap allocations made because the block was full, since the arena was created.
+	int GetNumOverflows() const { return numOverflows; }
+
+private:
+	// Overflow Declarations.
+	struct Overflow
+	{
+		void* memory;
+		size_t alignment;
+	};
+
+	// FrameArena Private Data.
+	static constexpr size_t kBlockAlignment = 64;
+	char* block;
+	size_t capacity;
+	std::atomic<size_t> offset;
+	// Requests the block could not hold, freed by Reset.
+	std::mutex overflowMutex;
+	std::vector<Overflow> overflows;
+	size_t overflowBytes;
+	int numOverflows;
+};
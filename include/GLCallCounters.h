@@ -0,0 +1,102 @@
+#pragma once
+
+// C++ STL headers.
+#include <cstdint>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+/**
+ * @brief GLCallCounters class.
+ *
+ * Counts the GL calls of every frame, to find redundant work in the render
+ * paths. Built with GL_CALL_COUNTERS, Install replaces the GLEW function
+ * pointers of the draws, binds, uniform uploads, buffer uploads and program
+ * switches the project uses with counting wrappers. The GL 1.1 entry points
+ * are exported by the GL library rather than loaded by GLEW, so this header
+ * redirects them to the wrappers below with macros in every file that
+ * includes it. Counting is a few increments per call on the GL thread.
+ *
+ * Without GL_CALL_COUNTERS nothing is wrapped and every count stays zero.
+*/
+class GLCallCounters
+{
+public:
+	// Counts Declarations.
+	struct Counts
+	{
+		int calls = 0;
+		int draws = 0;
+		int programSwitches = 0;
+		// glUseProgram of the program already in use.
+		int redundantProgramSwitches = 0;
+		int bufferBinds = 0;
+		int vertexArrayBinds = 0;
+		int textureBinds = 0;
+		int framebufferBinds = 0;
+		// Binds of the object already bound to the same target.
+		int redundantBinds = 0;
+		// glEnable, glDisable, depth, cull, blend, color mask, viewport and active texture changes.
+		int stateChanges = 0;
+		int uniformUploads = 0;
+		int64_t bufferBytes = 0;
+		int64_t textureBytes = 0;
+	};
+
+	// GLCallCounters Public Methods.
+	static constexpr bool IsEnabled() {
+#ifdef GL_CALL_COUNTERS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Wrap the GLEW function pointers, must be called after GLEW is initialized.
+	*/
+	static void Install();
+
+	/**
+	 * @brief Keep the counts of the frame that ended and start counting a new one.
+	*/
+	static void BeginFrame();
+
+	static const Counts& GetCurrentFrame();
+	static const Counts& GetLastFrame();
+
+	// Wrappers of the GL 1.1 entry points.
+	static void GLAPIENTRY DrawArrays(GLenum mode, GLint first, GLsizei count);
+	static void GLAPIENTRY DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+	static void GLAPIENTRY BindTexture(GLenum target, GLuint texture);
+	static void GLAPIENTRY DeleteTextures(GLsizei n, const GLuint* textures);
+	static void GLAPIENTRY TexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+		GLint border, GLenum format, GLenum type, const void* pixels);
+	static void GLAPIENTRY TexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+		GLenum format, GLenum type, const void* pixels);
+	static void GLAPIENTRY Enable(GLenum cap);
+	static void GLAPIENTRY Disable(GLenum cap);
+	static void GLAPIENTRY DepthMask(GLboolean flag);
+	static void GLAPIENTRY DepthFunc(GLenum func);
+	static void GLAPIENTRY CullFace(GLenum mode);
+	static void GLAPIENTRY BlendFunc(GLenum sfactor, GLenum dfactor);
+	static void GLAPIENTRY ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+	static void GLAPIENTRY Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+};
+
+#if defined(GL_CALL_COUNTERS) && !defined(GL_CALL_COUNTERS_IMPLEMENTATION)
+#define glDrawArrays GLCallCounters::DrawArrays
+#define glDrawElements GLCallCounters::DrawElements
+#define glBindTexture GLCallCounters::BindTexture
+#define glDeleteTextures GLCallCounters::DeleteTextures
+#define glTexImage2D GLCallCounters::TexImage2D
+#define glTexSubImage2D GLCallCounters::TexSubImage2D
+#define glEnable GLCallCounters::Enable
+#define glDisable GLCallCounters::Disable
+#define glDepthMask GLCallCounters::DepthMask
+#define glDepthFunc GLCallCounters::DepthFunc
+#define glCullFace GLCallCounters::CullFace
+#define glBlendFunc GLCallCounters::BlendFunc
+#define glColorMask GLCallCounters::ColorMask
+#define glViewport GLCallCounters::Viewport
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+// C++ STL headers.
+#include <filesystem>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+/**
+ * @brief HeadlessContext class.
+ *
+ * OpenGL context without a window or a display, made current through an EGL
+ * surfaceless context (Mesa llvmpipe runs it on machines without a GPU), with
+ * an offscreen color and depth framebuffer standing in for the window.
+ *
+ * @note Only available when built with HEADLESS_EGL, Create fails otherwise.
+*/
+class HeadlessContext
+{
+public:
+	// HeadlessContext Public Methods.
+	HeadlessContext();
+	~HeadlessContext();
+
+	/**
+	 * @brief Create the context and make it current.
+	*/
+	bool Create();
+
+	/**
+	 * @brief Create the offscreen framebuffer, call after GLEW is initialized.
+	*/
+	bool CreateTargets(const int width, const int height);
+
+	/**
+	 * @brief Bind the offscreen framebuffer and set the viewport to its size.
+	*/
+	void Bind() const;
+
+	/**
+	 * @brief Write the color of the offscreen framebuffer to an image file.
+	*/
+	bool SaveImage(const std::filesystem::path& filePath) const;
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	GLuint GetFramebuffer() const { return fboId; }
+
+private:
+	// HeadlessContext Private Data.
+	// EGLDisplay and EGLContext, kept opaque so that EGL stays out of this header.
+	void* display;
+	void* context;
+	int width;
+	int height;
+	GLuint fboId;
+	GLuint colorRboId;
+	GLuint depthRboId;
+};
@@ -21,6 +21,10 @@ public:
 	void Bind(GLenum textureUnit);
 	void Preview();
 	std::filesystem::path GetTexFilePath() const { return texFilePath; }
+	bool IsValid() const { return textureObj != 0; }
+
+	// Decode only, without creating GL textures, for tools running without a context.
+	static void SetUploadEnabled(const bool enabled) { uploadEnabled = enabled; }
 
 private:
 	// Texture Private Data.
@@ -30,4 +34,5 @@ private:
 	int imageHeight;
 	int numChannels;
 	cv::Mat texImage;
+	static bool uploadEnabled;
 };
@@ -0,0 +1,195 @@
+#pragma once
+
+// C++ STL headers.
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Number of unfinished jobs, which jobs and waiting threads depend on.
+ *
+ * A counter must outlive the jobs counted by it and the jobs depending on it.
+*/
+class JobCounter
+{
+public:
+	JobCounter() : value(0) {}
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const {
+		if (value.load(std::memory_order_acquire) != 0) {
+			return false;
+		}
+		// The job that brought the value to zero may still hold the mutex.
+		std::lock_guard<std::mutex> lock(continuationMutex);
+		return true;
+	}
+
+private:
+	friend class JobSystem;
+
+	// JobCounter Private Data.
+	std::atomic<int> value;
+	// Jobs queued when the value drops to zero.
+	mutable std::mutex continuationMutex;
+	std::vector<std::function<void()>> continuations;
+};
+
+/**
+ * @brief JobSystem class.
+ *
+ * Runs jobs on one worker thread per spare core. Every worker owns a deque:
+ * it pushes and pops the jobs it spawns at the back, so nested work stays in
+ * its cache, and idle workers steal the oldest jobs from the front of the
+ * others. Jobs submitted from other threads are spread over the deques.
+ * Threads waiting on a counter run jobs instead of blocking.
+ *
+ * Jobs touching GL are pinned to the thread that created the job system,
+ * which runs them in RunGLJobs and while it waits.
+ *
+ * Long jobs no frame waits on, like panorama decodes, go to a background
+ * queue that only idle workers take. A waiting thread never picks one up,
+ * so a wait only lasts as long as the short jobs in the deques.
+ *
+ * Queuing a job allocates nothing once the queues have grown to the largest
+ * batch, as long as the job fits in the small buffer of std::function.
+*/
+class JobSystem
+{
+public:
+	using Job = std::function<void()>;
+
+	// JobSystem Public Methods.
+	/**
+	 * @param numWorkers Worker threads, 0 for one per core besides the calling thread.
+	*/
+	JobSystem(const int numWorkers = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	/**
+	 * @brief Queue a job on the workers.
+	 *
+	 * @param counter Incremented now and decremented when the job finishes, may be nullptr.
+	 * @param dependency The job starts only once this counter is done, may be nullptr.
+	*/
+	void Run(Job job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	/**
+	 * @brief Queue a job on the GL thread, see Run.
+	*/
+	void RunOnGLThread(Job job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	/**
+	 * @brief Queue a long job on the background queue, run by idle workers only.
+	 *
+	 * @param counter Incremented now and decremented when the job finishes, may be nullptr.
+	*/
+	void RunBackground(Job job, JobCounter* counter = nullptr);
+
+	/**
+	 * @brief Run the jobs of the calling thread, and steal others, until the counter is done.
+	*/
+	void Wait(JobCounter& counter);
+
+	/**
+	 * @brief Run body(first, last) over [begin, end) split in chunks of grainSize, and wait.
+	 *
+	 * The calling thread runs the first chunk itself instead of waiting idle.
+	 * Every job only holds a pointer to the body, so no job allocates.
+	 *
+	 * @param grainSize Indices per job, 0 to split the range in a few chunks per thread.
+	*/
+	template <typename Body>
+	void ParallelFor(const int begin, const int end, const int grainSize, const Body& body) {
+		const int count = end - begin;
+		if (count <= 0) {
+			return;
+		}
+		const int grain = grainSize > 0 ? grainSize : std::max(1, count / (4 * GetNumThreads()));
+		JobCounter counter;
+		for (int first = begin + grain; first < end; first += grain) {
+			const int last = std::min(end, first + grain);
+			Run([&body, first, last]() { body(first, last); }, &counter);
+		}
+		body(begin, std::min(end, begin + grain));
+		Wait(counter);
+	}
+
+	/**
+	 * @brief Run the GL jobs queued so far, must be called on the GL thread.
+	*/
+	void RunGLJobs();
+
+	// Threads running jobs, the workers and the GL thread.
+	int GetNumThreads() const { return (int)workers.size() + 1; }
+	bool IsGLThread() const { return std::this_thread::get_id() == glThreadId; }
+
+private:
+	// JobSystem Private Declarations.
+	// A job and the counter it decrements when it finishes.
+	struct QueuedJob
+	{
+		Job job;
+		JobCounter* counter = nullptr;
+	};
+
+	// Double-ended ring of jobs, which only grows: unlike a std::deque it
+	// allocates nothing in steady state.
+	class JobQueue
+	{
+	public:
+		bool IsEmpty() const { return head == tail; }
+		size_t GetSize() const { return tail - head; }
+		void PushBack(QueuedJob job);
+		QueuedJob PopBack();
+		QueuedJob PopFront();
+
+	private:
+		std::vector<QueuedJob> slots;
+		// Positions grow without wrapping, the slot is the position modulo the size.
+		size_t head = 0;
+		size_t tail = 0;
+	};
+
+	struct Worker
+	{
+		std::thread thread;
+		std::mutex mutex;
+		JobQueue jobs;
+	};
+
+	// JobSystem Private Methods.
+	void WorkerMain(const int index);
+	void Queue(QueuedJob job, JobCounter* dependency, const bool glThread);
+	void Push(QueuedJob job, const bool glThread);
+	bool RunOne();
+	bool RunBackgroundJob();
+	bool PopOrSteal(QueuedJob& job);
+	void Execute(QueuedJob& job);
+	void Finish(JobCounter* counter);
+
+	// JobSystem Private Data.
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<unsigned> nextWorker;
+	std::thread::id glThreadId;
+	std::mutex glMutex;
+	JobQueue glJobs;
+	// Idle workers sleep until a job is queued or the system shuts down.
+	std::mutex sleepMutex;
+	std::condition_variable wakeUp;
+	std::atomic<int> numQueuedJobs;
+	std::mutex backgroundMutex;
+	JobQueue backgroundJobs;
+	std::atomic<int> numBackgroundJobs;
+	bool quit;
+};
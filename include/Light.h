@@ -1,8 +1,14 @@
 #pragma once
 
+#include <memory>
+
 #include <glm/glm.hpp>
 #include <GL/glew.h>
 
+#include "GLCallCounters.h"
+
+class PointShadowMap;
+
 // VertexP Declarations.
 struct VertexP
 {
@@ -30,6 +36,10 @@ public:
 	glm::vec3 GetPosition() const { return position; }
 	glm::vec3 GetIntensity() const { return intensity; }
 
+	// Null if the light casts no shadow.
+	void SetShadowMap(const std::shared_ptr<PointShadowMap>& map) { shadowMap = map; }
+	const std::shared_ptr<PointShadowMap>& GetShadowMap() const { return shadowMap; }
+
 	void Draw() {
 		glPointSize(16.0f);
 		glEnableVertexAttribArray(0);
@@ -40,6 +50,7 @@ public:
 		glPointSize(1.0f);
 	}
 
+	void SetPosition(const glm::vec3& p) { position = p; }
 	void MoveLeft(const float moveSpeed) { position += moveSpeed * glm::vec3(-0.1f, 0.0f, 0.0f); }
 	void MoveRight(const float moveSpeed) { position += moveSpeed * glm::vec3(0.1f, 0.0f, 0.0f); }
 	void MoveUp(const float moveSpeed) { position += moveSpeed * glm::vec3(0.0f, 0.1f, 0.0f); }
@@ -59,6 +70,7 @@ protected:
 	GLuint vboId;
 	glm::vec3 position;
 	glm::vec3 intensity;
+	std::shared_ptr<PointShadowMap> shadowMap;
 };
 
 // SpotLight Declarations.
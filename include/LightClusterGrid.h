@@ -0,0 +1,118 @@
+#pragma once
+
+// C++ STL headers.
+#include <cmath>
+#include <vector>
+
+// GLM headers.
+#include <glm/glm.hpp>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// Project headers.
+#include "Light.h"
+
+/**
+ * @brief LightClusterGrid class.
+ *
+ * Splits the view frustum into dimX x dimY screen tiles and dimZ exponential
+ * depth slices (froxels), and assigns every point and spot light to the froxels
+ * its range touches. The fragment shader then only loops over the lights of
+ * its own froxel.
+ *
+ * @note Build() only touches CPU memory and can be tested without a GL context.
+*/
+class LightClusterGrid
+{
+public:
+	/**
+	 * @brief Light record in view space, laid out for a std430 buffer.
+	*/
+	struct Light {
+		glm::vec4 positionRange;	// xyz: position, w: range.
+		glm::vec4 intensityType;	// xyz: intensity, w: 0 for point light, 1 for spot light.
+		glm::vec4 direction;		// xyz: spot direction.
+		glm::vec4 spotParams;		// x: total width in degrees, y: cutoff in degrees.
+	};
+
+	// Intensity below which a light is treated as zero, defining its range.
+	static constexpr float kAttenuationCutoff = 1.0f / 256.0f;
+
+	// LightClusterGrid Public Methods.
+	LightClusterGrid(const int dimX, const int dimY, const int dimZ, const float zNear, const float zFar);
+	~LightClusterGrid();
+
+	/**
+	 * @brief Make a view space light record. The range is where the
+	 * inverse square falloff drops below kAttenuationCutoff.
+	*/
+	static Light MakePointLight(const glm::vec3& position, const glm::vec3& intensity, const glm::mat4& viewMatrix);
+	static Light MakeSpotLight(const SpotLight& spotLight, const glm::mat4& viewMatrix);
+
+	/**
+	 * @brief Assign the lights to the froxels.
+	 *
+	 * @param projMatrix Symmetric perspective projection of the camera.
+	 * @param lights Lights in view space.
+	*/
+	void Build(const glm::mat4& projMatrix, const std::vector<Light>& lights);
+
+	/**
+	 * @brief Get the froxel of a point, with the same mapping as the shader.
+	 *
+	 * @param ndc Normalized device coordinate of the point.
+	 * @param viewDepth Positive distance of the point along the view direction.
+	*/
+	int GetClusterIndex(const glm::vec2& ndc, const float viewDepth) const;
+
+	/**
+	 * @brief Get the indices into the light list of the lights affecting a froxel.
+	*/
+	std::vector<unsigned int> GetClusterLights(const int clusterIndex) const;
+
+	int GetNumClusters() const { return dimX * dimY * dimZ; }
+	glm::ivec3 GetDims() const { return glm::ivec3(dimX, dimY, dimZ); }
+	float GetZNear() const { return zNear; }
+	// Number of depth slices per unit of log(depth).
+	float GetLogDepthScale() const { return (float)dimZ / std::log(zFar / zNear); }
+
+	/**
+	 * @brief Upload the lights, the froxel ranges and the light indices to the SSBOs,
+	 * and the grid parameters to the ClusterParams uniform block.
+	 *
+	 * @param lights
+	 * @param screenSize Viewport size in pixels.
+	*/
+	void Upload(const std::vector<Light>& lights, const glm::vec2& screenSize);
+
+	/**
+	 * @brief Bind the SSBOs to binding points 0 (lights), 1 (froxel ranges) and 2 (light indices),
+	 * and the parameters to uniform block binding 0.
+	*/
+	void Bind() const;
+
+private:
+	// LightClusterGrid Private Methods.
+	float GetSliceDepth(const int slice) const;
+
+	// LightClusterGrid Private Data.
+	int dimX;
+	int dimY;
+	int dimZ;
+	float zNear;
+	float zFar;
+
+	// Offset into lightIndices and number of lights per froxel.
+	std::vector<glm::uvec2> clusterRanges;
+	std::vector<unsigned int> lightIndices;
+	// Scratch (froxel, light) pairs of the last Build.
+	std::vector<glm::uvec2> pairs;
+	// Scratch squared x distances of the tile columns to the current light.
+	std::vector<float> dx2;
+
+	GLuint lightSsbo;
+	GLuint clusterSsbo;
+	GLuint indexSsbo;
+	GLuint paramsUbo;
+};
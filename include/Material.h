@@ -5,6 +5,7 @@
 
 #include "ShaderProg.h"
 #include "ImageTexture.h"
+#include "CubemapTexture.h"
 
 // Material Declarations.
 class Material
@@ -65,6 +66,13 @@ class SkyboxMaterial : public Material
 {
 public:
 	// SkyboxMaterial Public Methods.
-	SkyboxMaterial() {};
+	SkyboxMaterial() : mapCube(nullptr) {};
 	~SkyboxMaterial() {};
+
+	void SetMapCube(std::shared_ptr<CubemapTexture> tex) { mapCube = tex; }
+	std::shared_ptr<CubemapTexture> GetMapCube() const { return mapCube; }
+
+private:
+	// SkyboxMaterial Private Data.
+	std::shared_ptr<CubemapTexture> mapCube;
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+// C++ STL headers.
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// GLM headers.
+#include <glm/glm.hpp>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// Project headers.
+#include "ShaderProg.h"
+#include "ShadowAtlas.h"
+
+/**
+ * @brief PointShadowMap class.
+ *
+ * Depth cube map of a point light rendered in a single pass: the casters are
+ * drawn once, instanced over the cube faces their bounding spheres touch, and
+ * every instance is routed to its face with gl_Layer. Like ShadowAtlas, the map
+ * is only rendered again when the light or a caster in range moves.
+*/
+class PointShadowMap
+{
+public:
+	// PointShadowMap Public Methods.
+	PointShadowMap(const int size);
+	~PointShadowMap();
+
+	/**
+	 * @brief Render the cube map if the light or the casters changed.
+	 *
+	 * @param arena Holds the bounding spheres of the casters for the frame.
+	 *
+	 * @note Restores the bound framebuffer, viewport and face culling.
+	*/
+	void Update(
+		const glm::vec3& lightPosition,
+		const std::vector<ShadowCaster>& casters,
+		FrameArena& arena,
+		const std::shared_ptr<PointShadowShaderProg>& shader);
+
+	void Invalidate() { valid = false; }
+	void Bind(const GLenum textureUnit) const;
+
+	/**
+	 * @brief (a, b) such that the stored depth of a point at distance d along
+	 * the major axis of its cube face is a + b / d.
+	*/
+	glm::vec2 GetDepthParams() const;
+
+	int GetNumPassesRendered() const { return numPassesRendered; }
+	int GetNumPassesSkipped() const { return numPassesSkipped; }
+	int GetNumFacesRendered() const { return numFacesRendered; }
+
+private:
+	// PointShadowMap Private Data.
+	GLuint fboId;
+	GLuint texId;
+	int size;
+	float zNear;
+	float zFar;
+	bool valid;
+	glm::vec3 lightPosition;
+	uint64_t casterKey;
+	int numPassesRendered;
+	int numPassesSkipped;
+	int numFacesRendered;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+// C++ STL headers.
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// Project headers.
+#include "Clock.h"
+
+/**
+ * @brief Profiler class.
+ *
+ * Measures nested scopes on the CPU with a Clock and on the GPU with
+ * GL_TIMESTAMP queries. The queries of a frame are read kFrameLatency frames
+ * later, and only once the driver reports them available, so profiling never
+ * waits for the GPU; a frame whose queries are still pending when its slot is
+ * reused is dropped. Every scope keeps its last kHistorySize samples, from
+ * which GetStats reports the rolling min, average and 99th percentile.
+ *
+ * @note Scopes are identified by name, a name must always be opened at the same depth.
+*/
+class Profiler
+{
+public:
+	static constexpr int kFrameLatency = 4;
+	static constexpr int kHistorySize = 240;
+
+	// ScopeStats Declarations.
+	// Times in milliseconds, negative GPU times while no frame has been read back.
+	struct ScopeStats
+	{
+		std::string name;
+		int depth;
+		double cpuMin;
+		double cpuAvg;
+		double cpuP99;
+		double gpuMin;
+		double gpuAvg;
+		double gpuP99;
+	};
+
+	// Profiler Public Methods.
+	Profiler();
+	~Profiler();
+
+	/**
+	 * @brief Read back the finished frames and start recording a new one.
+	*/
+	void BeginFrame();
+	void EndFrame();
+
+	void BeginScope(const std::string_view name);
+	void EndScope();
+
+	/**
+	 * @brief Statistics of every scope, in the order the scopes were first opened.
+	*/
+	std::vector<ScopeStats> GetStats() const;
+	int GetNumDroppedFrames() const { return numDroppedFrames; }
+
+private:
+	// Profiler Private Declarations.
+	struct Scope
+	{
+		std::string name;
+		int depth = 0;
+		// Ring buffers of the last kHistorySize samples in milliseconds.
+		std::vector<double> cpuSamples;
+		std::vector<double> gpuSamples;
+		int cpuNext = 0;
+		int gpuNext = 0;
+	};
+	struct OpenScope
+	{
+		int scope;
+		double cpuStart;
+		int gpuBeginQuery;
+	};
+	struct GpuScope
+	{
+		int scope;
+		int beginQuery;
+		int endQuery;
+	};
+	struct FrameSlot
+	{
+		std::vector<GLuint> queries;
+		int numQueriesUsed = 0;
+		std::vector<GpuScope> scopes;
+		bool pending = false;
+	};
+
+	// Profiler Private Methods.
+	int FindScope(const std::string_view name, const int depth);
+	int AllocateQuery();
+	bool ReadFrame(FrameSlot& slot);
+	static void AddSample(std::vector<double>& samples, int& next, const double value);
+	static void ComputeStats(const std::vector<double>& samples, double& minValue, double& avgValue, double& p99Value);
+
+	// Profiler Private Data.
+	Clock clock;
+	std::vector<Scope> scopes;
+	std::vector<OpenScope> openScopes;
+	FrameSlot frames[kFrameLatency];
+	uint64_t frameIndex;
+	int numDroppedFrames;
+};
+
+/**
+ * @brief RAII helper opening a Profiler scope for the lifetime of the object.
+*/
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, const std::string_view name) : profiler(profiler) { profiler.BeginScope(name); }
+	~ProfileScope() { profiler.EndScope(); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	Profiler& profiler;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+// C++ STL headers.
+#include <string>
+#include <vector>
+
+/**
+ * @brief QualityGovernor class.
+ *
+ * Keeps the frame time under a target by walking a ladder of quality levels,
+ * from full quality (level 0) down to the cheapest one. The CPU and GPU frame
+ * times are smoothed, and a level is only changed after the smoothed time
+ * stayed over (or well under) the target for a number of frames. After a
+ * change the governor waits for the new level to show up in the measurements,
+ * so it does not oscillate between two levels.
+ *
+ * @note Every knob here costs GPU time only, so the governor never lowers the
+ * quality when the frame is CPU bound.
+*/
+class QualityGovernor
+{
+public:
+	// QualityLevel Declarations.
+	struct QualityLevel
+	{
+		// Render resolution relative to the window, upscaled when presenting.
+		float renderScale;
+		// Samples of the scene target, 1 disables MSAA.
+		int msaaSamples;
+		// Resolution of one shadow map of the ShadowAtlas.
+		int shadowTileSize;
+		// Added to the mip level of the material textures.
+		float lodBias;
+	};
+
+	// QualityGovernor Public Methods.
+	/**
+	 * @param targetFrameTime Target frame time in milliseconds.
+	*/
+	QualityGovernor(const double targetFrameTime);
+
+	/**
+	 * @brief Feed the times of one frame and pick the level of the next one.
+	 *
+	 * @param cpuFrameTime CPU time of the frame in milliseconds.
+	 * @param gpuFrameTime GPU time of the frame in milliseconds, negative if not available yet.
+	 *
+	 * @return true if the level changed.
+	*/
+	bool Update(const double cpuFrameTime, const double gpuFrameTime);
+
+	double GetTargetFrameTime() const { return targetFrameTime; }
+
+	const QualityLevel& GetLevel() const { return levels[levelIndex]; }
+	int GetLevelIndex() const { return levelIndex; }
+	int GetNumLevels() const { return (int)levels.size(); }
+
+	// Metrics.
+	double GetSmoothedCpuFrameTime() const { return smoothedCpuTime; }
+	double GetSmoothedGpuFrameTime() const { return smoothedGpuTime; }
+	int GetNumDecisions() const { return numDecisions; }
+	const std::string& GetLastDecision() const { return lastDecision; }
+
+private:
+	// QualityGovernor Private Methods.
+	std::string FormatReason(const double gpuTime) const;
+	void ChangeLevel(const int newLevelIndex, const std::string& reason);
+
+	// QualityGovernor Private Data.
+	std::vector<QualityLevel> levels;
+	int levelIndex;
+	double targetFrameTime;
+	// Exponential moving averages, negative until the first sample.
+	double smoothedCpuTime;
+	double smoothedGpuTime;
+	// Consecutive frames over or under the thresholds.
+	int framesOverBudget;
+	int framesUnderBudget;
+	// Frames left before the measurements reflect the last change.
+	int cooldownFrames;
+	int numDecisions;
+	std::string lastDecision;
+};
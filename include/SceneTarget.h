@@ -0,0 +1,69 @@
+#pragma once
+
+// C++ STL headers.
+#include <memory>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// Project headers.
+#include "ShaderProg.h"
+
+/**
+ * @brief SceneTarget class.
+ *
+ * Offscreen color and depth target the scene is rendered into at a reduced
+ * resolution and a chosen MSAA sample count. Present resolves the samples
+ * and upscales the result to the window with bilinear filtering.
+*/
+class SceneTarget
+{
+public:
+	// SceneTarget Public Methods.
+	SceneTarget(const int width, const int height, const int samples);
+	~SceneTarget();
+
+	/**
+	 * @brief Recreate the target if its size or sample count changed.
+	 *
+	 * @param samples 1 for no MSAA, clamped to GL_MAX_SAMPLES.
+	*/
+	void Resize(const int width, const int height, const int samples);
+
+	/**
+	 * @brief Bind the target and set the viewport to its size.
+	*/
+	void Bind() const;
+
+	/**
+	 * @brief Resolve the target and draw it over the whole output framebuffer.
+	 *
+	 * @param outputFboId 0 for the window, or the offscreen framebuffer of a headless run.
+	 *
+	 * @note Leaves the output framebuffer bound with a viewport of the window size.
+	*/
+	void Present(const GLuint outputFboId, const int windowWidth, const int windowHeight,
+		const std::shared_ptr<UpscaleShaderProg>& shader);
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	int GetSamples() const { return samples; }
+
+private:
+	// SceneTarget Private Methods.
+	void CreateTargets();
+	void ReleaseTargets();
+
+	// SceneTarget Private Data.
+	int width;
+	int height;
+	int samples;
+	// Rendered framebuffer, with multisample renderbuffers if samples > 1.
+	GLuint fboId;
+	GLuint colorRboId;
+	GLuint depthRboId;
+	// Single sample color the upscale pass reads.
+	GLuint resolveFboId;
+	GLuint resolveTexId;
+	GLuint triangleVboId;
+};
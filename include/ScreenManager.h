@@ -4,6 +4,8 @@
 #include <memory>
 #include <filesystem>
 
+class Profiler;
+
 namespace opengl_homework {
 
 /**
@@ -29,7 +31,16 @@ public:
      */
     void Start(int, char**);
 
+    /**
+     * @brief CPU and GPU times of the render passes, valid once rendering started.
+     */
+    const Profiler& GetProfiler() const;
+
 private:
+    // ScreenManager Private Declarations.
+    struct InputEvent;
+    struct FrameSnapshot;
+
     // ScreenManager Private Methods.
     ScreenManager();
 
@@ -39,11 +50,35 @@ private:
     void SetupRenderState();
     void SetupScene(int);
     void SetupShaderLib();
+    void FinishShaderLib();
     void SetupLights();
     void SetupCamera();
     void SetupSkybox(int);
     void SetupMenu();
 
+    void SetupRedisplay();
+    bool IsAnimating() const;
+    bool HasPendingLoads() const;
+    void RunHeadless();
+    void WaitForLoads();
+    bool RunBenchmark();
+    void UpdateQuality(double);
+    void ApplyQualityLevel();
+    void DrawProfilerOverlay();
+    void DrawGLCallCounters();
+
+    void GatherLights();
+    void UpdateLightClusters();
+
+    void PushInput(const InputEvent&);
+    void StartSimulation();
+    void SimulationMain();
+    void Simulate(FrameSnapshot&);
+    void ApplySimulationInput(const InputEvent&, FrameSnapshot&);
+    void AcquireSnapshot();
+    void ApplySnapshot(const FrameSnapshot&);
+    void ApplyRenderKey(unsigned char);
+
     void ReshapeCB(int, int);
     void ProcessSpecialKeysCB(int, int, int);
     void ProcessKeysCB(unsigned char, int, int);
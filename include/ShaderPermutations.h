@@ -0,0 +1,150 @@
+#pragma once
+
+// C++ STL headers.
+#include <bit>
+#include <concepts>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Project headers.
+#include "ShaderProg.h"
+
+/**
+ * @brief ShaderPermutations class.
+ *
+ * Compiles variants of one set of shader sources on first use, each with the
+ * #define set selected by a feature bitmask, and caches them by that bitmask.
+ * Variants compile in the background where the driver supports it.
+ *
+ * @note Bit i of the mask enables featureDefines[i]. An empty define means the
+ * sources do not use that feature, and the bit is ignored.
+*/
+template<typename T>
+    requires std::derived_from<T, ShaderProg>
+class ShaderPermutations
+{
+public:
+    // ShaderPermutations Public Methods.
+    ShaderPermutations(
+        const std::filesystem::path& vsFilePath,
+        const std::filesystem::path& fsFilePath,
+        const std::filesystem::path& gsFilePath,
+        const std::vector<std::string>& featureDefines) :
+        vsFilePath(vsFilePath),
+        fsFilePath(fsFilePath),
+        gsFilePath(gsFilePath),
+        featureDefines(featureDefines) {
+        supportedMask = 0;
+        for (size_t i = 0; i < featureDefines.size(); ++i) {
+            if (!featureDefines[i].empty()) {
+                supportedMask |= 1u << i;
+            }
+        }
+    }
+
+    /**
+     * @brief Get the variant for a feature bitmask, submitting it on first use.
+     *
+     * While the variant is still compiling (or if it failed), the ready variant
+     * with the largest subset of the features is returned instead, so the caller
+     * renders with fewer features rather than stalling.
+     *
+     * @return nullptr if no suitable variant is ready.
+    */
+    std::shared_ptr<T> Get(unsigned int features) {
+        features &= supportedMask;
+        std::shared_ptr<T> shader = Submit(features);
+        if (shader != nullptr) {
+            if (shader->IsReady()) {
+                return shader;
+            }
+            if (shader->GetStatus() == ShaderProg::FAILED) {
+                std::cerr << "[ERROR] Failed to compile variant " << features << " of " << fsFilePath << std::endl;
+                variants[features] = nullptr;
+            }
+        }
+
+        std::shared_ptr<T> fallback = nullptr;
+        int fallbackFeatures = -1;
+        for (const auto& [variantFeatures, variant] : variants) {
+            if ((variantFeatures & ~features) != 0 || variant == nullptr || variant->GetStatus() != ShaderProg::READY) {
+                continue;
+            }
+            if (std::popcount(variantFeatures) > fallbackFeatures) {
+                fallbackFeatures = std::popcount(variantFeatures);
+                fallback = variant;
+            }
+        }
+        return fallback;
+    }
+
+    /**
+     * @brief Start compiling a variant without waiting for it.
+     *
+     * @return nullptr if the variant failed.
+    */
+    std::shared_ptr<T> Submit(unsigned int features) {
+        features &= supportedMask;
+        auto it = variants.find(features);
+        if (it != variants.end()) {
+            return it->second;
+        }
+
+        std::vector<std::string> defines;
+        for (size_t i = 0; i < featureDefines.size(); ++i) {
+            if (features & (1u << i)) {
+                defines.push_back(featureDefines[i]);
+            }
+        }
+        auto shader = std::make_shared<T>();
+        if (!shader->Submit(vsFilePath, fsFilePath, gsFilePath, defines)) {
+            shader = nullptr;
+        }
+        // Failed variants are cached too, so they are not recompiled every frame.
+        variants[features] = shader;
+        return shader;
+    }
+
+    /**
+     * @brief Wait for a variant, submitting it first if needed.
+     *
+     * @return nullptr if the variant failed to compile.
+    */
+    std::shared_ptr<T> Finish(unsigned int features) {
+        features &= supportedMask;
+        std::shared_ptr<T> shader = Submit(features);
+        if (shader != nullptr && !shader->Finish()) {
+            std::cerr << "[ERROR] Failed to compile variant " << features << " of " << fsFilePath << std::endl;
+            shader = nullptr;
+            variants[features] = nullptr;
+        }
+        return shader;
+    }
+
+    size_t GetNumVariants() const { return variants.size(); }
+
+    /**
+     * @brief True while a submitted variant has not been seen ready by Get or Finish.
+    */
+    bool HasPending() const {
+        for (const auto& [variantFeatures, variant] : variants) {
+            if (variant != nullptr && variant->GetStatus() == ShaderProg::COMPILING) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // ShaderPermutations Private Data.
+    std::filesystem::path vsFilePath;
+    std::filesystem::path fsFilePath;
+    std::filesystem::path gsFilePath;
+    std::vector<std::string> featureDefines;
+    unsigned int supportedMask;
+    std::map<unsigned int, std::shared_ptr<T>> variants;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <filesystem>
 
 #include <GL/glew.h>
@@ -11,11 +12,48 @@
 class ShaderProg
 {
 public:
+	// ShaderProg Public Types.
+	enum Status { EMPTY, COMPILING, READY, FAILED };
+
 	// ShaderProg Public Methods.
 	ShaderProg();
 	~ShaderProg();
 
-	bool LoadFromFiles(const std::filesystem::path&, const std::filesystem::path&, const std::filesystem::path&);
+	/**
+	 * @brief Compile and link the program.
+	 *
+	 * @param vsFilePath
+	 * @param fsFilePath
+	 * @param gsFilePath Empty for no geometry shader.
+	 * @param defines Macros injected after the #version line of every stage, e.g. "NUM_POINT_LIGHTS 1".
+	*/
+	bool LoadFromFiles(const std::filesystem::path&, const std::filesystem::path&, const std::filesystem::path&,
+		const std::vector<std::string>& defines = {});
+	/**
+	 * @brief Start compiling and linking the program without waiting for the driver.
+	 *
+	 * @return false only if a source file cannot be read. Compile errors are reported by Finish().
+	*/
+	bool Submit(const std::filesystem::path&, const std::filesystem::path&, const std::filesystem::path&,
+		const std::vector<std::string>& defines = {});
+	/**
+	 * @brief Poll a submitted program. Never blocks when GL_KHR_parallel_shader_compile is available.
+	*/
+	bool IsReady();
+	/**
+	 * @brief Wait for a submitted program and check its compile and link status.
+	*/
+	bool Finish();
+	Status GetStatus() const { return status; }
+	/**
+	 * @brief Allow the driver to compile on background threads, if supported.
+	*/
+	static void EnableParallelCompile();
+	/**
+	 * @brief Set the directory of the program binary cache. An empty path disables the cache.
+	*/
+	static void SetBinaryCacheDir(const std::filesystem::path&);
+
 	void Bind() { glUseProgram(shaderProgId); };
 	void Unbind() { glUseProgram(0); };
 
@@ -31,10 +69,19 @@ protected:
 private:
 	// ShaderProg Private Methods.
 	GLuint AddShader(const std::string& sourceText, GLenum shaderType);
+	void ReleaseShaders();
 	static bool LoadShaderTextFromFile(const std::filesystem::path&, std::string& sourceText);
+	static void InjectDefines(const std::vector<std::string>& defines, std::string& sourceText);
+	static std::filesystem::path GetBinaryCachePath(const std::string& sourceText);
+	bool LoadProgramBinary(const std::filesystem::path&);
+	void SaveProgramBinary(const std::filesystem::path&);
 
 	// ShaderProg Private Data.
 	GLint locMVP;
+	Status status;
+	std::vector<GLuint> shaderIds;
+	std::filesystem::path binaryPath;
+	static std::filesystem::path binaryCacheDir;
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -60,6 +107,57 @@ private:
 
 // ------------------------------------------------------------------------------------------------
 
+// DepthOnlyShaderProg Declarations.
+// Writes depth only; used by the depth pre-pass.
+class DepthOnlyShaderProg : public ShaderProg
+{
+public:
+	// DepthOnlyShaderProg Public Methods.
+	DepthOnlyShaderProg();
+	~DepthOnlyShaderProg();
+
+protected:
+	// DepthOnlyShaderProg Protected Methods.
+	void GetUniformVariableLocation() override;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// PointShadowShaderProg Declarations.
+class PointShadowShaderProg : public ShaderProg
+{
+public:
+	// PointShadowShaderProg Public Methods.
+	PointShadowShaderProg();
+	~PointShadowShaderProg();
+
+	GLint GetLocM() const { return locM; }
+	GLint GetLocFaceViewProj() const { return locFaceViewProj; }
+	GLint GetLocFaceLayers() const { return locFaceLayers; }
+
+protected:
+	// PointShadowShaderProg Protected Methods.
+	void GetUniformVariableLocation() override;
+
+private:
+	// PointShadowShaderProg Private Data.
+	GLint locM;
+	GLint locFaceViewProj;
+	GLint locFaceLayers;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// Feature bits of the phong shader permutations.
+enum PhongFeature : unsigned int {
+	PHONG_HAS_MAP_KD = 1u << 0,
+	PHONG_USE_DIR_LIGHT = 1u << 1,
+	PHONG_USE_POINT_LIGHT = 1u << 2,
+	PHONG_USE_SPOT = 1u << 3,
+	PHONG_USE_SHADOWS = 1u << 4,
+	PHONG_USE_POINT_SHADOW = 1u << 5,
+};
+
 // PhongShadingDemoShaderProg Declarations.
 class PhongShadingDemoShaderProg : public ShaderProg
 {
@@ -87,6 +185,12 @@ public:
 	GLint GetLocSpotLightIntensity() const { return locSpotLightIntensity; }
 	GLint GetLocSpotLightCutoff() const { return locSpotLightCutoff; }
 	GLint GetLocSpotLightTotalWidth() const { return locSpotLightTotalWidth; }
+	GLint GetLocShadowAtlas() const { return locShadowAtlas; }
+	GLint GetLocCascadeShadowMatrices() const { return locCascadeShadowMatrices; }
+	GLint GetLocCascadeSplits() const { return locCascadeSplits; }
+	GLint GetLocSpotShadowMatrix() const { return locSpotShadowMatrix; }
+	GLint GetLocPointShadowMap() const { return locPointShadowMap; }
+	GLint GetLocPointShadowDepth() const { return locPointShadowDepth; }
 
 protected:
 	// PhongShadingDemoShaderProg Protected Methods.
@@ -116,6 +220,13 @@ private:
 	GLint locSpotLightIntensity;
 	GLint locSpotLightCutoff;
 	GLint locSpotLightTotalWidth;
+	// Shadow data.
+	GLint locShadowAtlas;
+	GLint locCascadeShadowMatrices;
+	GLint locCascadeSplits;
+	GLint locSpotShadowMatrix;
+	GLint locPointShadowMap;
+	GLint locPointShadowDepth;
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -129,6 +240,7 @@ public:
 	~SkyboxShaderProg();
 
 	GLint GetLocMapKd() const { return locMapKd; }
+	GLint GetLocInvViewProj() const { return locInvViewProj; }
 
 protected:
 	// PhongShadingDemoShaderProg Protected Methods.
@@ -137,4 +249,156 @@ protected:
 private:
 	// SkyboxShaderProg Public Data.
 	GLint locMapKd;
+	GLint locInvViewProj;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// DeferredLightingShaderProg Declarations.
+// Shared by the directional and the light volume passes of DeferredRenderer.
+class DeferredLightingShaderProg : public ShaderProg
+{
+public:
+	// DeferredLightingShaderProg Public Methods.
+	DeferredLightingShaderProg();
+	~DeferredLightingShaderProg();
+
+	GLint GetLocAlbedoNs() const { return locAlbedoNs; }
+	GLint GetLocSpecular() const { return locSpecular; }
+	GLint GetLocNormal() const { return locNormal; }
+	GLint GetLocAmbient() const { return locAmbient; }
+	GLint GetLocDepth() const { return locDepth; }
+	GLint GetLocP() const { return locP; }
+	GLint GetLocInvP() const { return locInvP; }
+	GLint GetLocDirLightDir() const { return locDirLightDir; }
+	GLint GetLocDirLightRadiance() const { return locDirLightRadiance; }
+
+protected:
+	// DeferredLightingShaderProg Protected Methods.
+	void GetUniformVariableLocation() override;
+
+private:
+	// DeferredLightingShaderProg Private Data.
+	// G-buffer.
+	GLint locAlbedoNs;
+	GLint locSpecular;
+	GLint locNormal;
+	GLint locAmbient;
+	GLint locDepth;
+	// Transformation matrix.
+	GLint locP;
+	GLint locInvP;
+	// Light data.
+	GLint locDirLightDir;
+	GLint locDirLightRadiance;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// VisibilityShaderProg Declarations.
+// Writes the submesh and triangle of every pixel into the visibility buffer.
+class VisibilityShaderProg : public ShaderProg
+{
+public:
+	// VisibilityShaderProg Public Methods.
+	VisibilityShaderProg();
+	~VisibilityShaderProg();
+
+	GLint GetLocDrawId() const { return locDrawId; }
+	GLint GetLocFirstTriangle() const { return locFirstTriangle; }
+
+protected:
+	// VisibilityShaderProg Protected Methods.
+	void GetUniformVariableLocation() override;
+
+private:
+	// VisibilityShaderProg Private Data.
+	GLint locDrawId;
+	GLint locFirstTriangle;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// VisibilityResolveShaderProg Declarations.
+// Phong shading of the pixels of one submesh, pulling its vertices from the visibility buffer IDs.
+class VisibilityResolveShaderProg : public PhongShadingDemoShaderProg
+{
+public:
+	// VisibilityResolveShaderProg Public Methods.
+	VisibilityResolveShaderProg();
+	~VisibilityResolveShaderProg();
+
+	GLint GetLocVisibilityIds() const { return locVisibilityIds; }
+	GLint GetLocVisibilityDepth() const { return locVisibilityDepth; }
+	GLint GetLocDrawId() const { return locDrawId; }
+	GLint GetLocScreenSize() const { return locScreenSize; }
+
+protected:
+	// VisibilityResolveShaderProg Protected Methods.
+	void GetUniformVariableLocation() override;
+
+private:
+	// VisibilityResolveShaderProg Private Data.
+	GLint locVisibilityIds;
+	GLint locVisibilityDepth;
+	GLint locDrawId;
+	GLint locScreenSize;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// UpscaleShaderProg Declarations.
+class UpscaleShaderProg : public ShaderProg
+{
+public:
+	// UpscaleShaderProg Public Methods.
+	UpscaleShaderProg();
+	~UpscaleShaderProg();
+
+	GLint GetLocSceneTexture() const { return locSceneTexture; }
+	GLint GetLocOutputSize() const { return locOutputSize; }
+
+protected:
+	// UpscaleShaderProg Protected Methods.
+	void GetUniformVariableLocation() override;
+
+private:
+	// UpscaleShaderProg Private Data.
+	GLint locSceneTexture;
+	GLint locOutputSize;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// DrawSubmissionShaderProg Declarations.
+// Minimal lit material of the draw submission benchmark, with the per-draw data
+// in uniforms, in the DrawBlock uniform block (PER_DRAW_UBO) or in a storage buffer
+// indexed by the DrawId attribute (draw_submission_indirect.vs).
+class DrawSubmissionShaderProg : public ShaderProg
+{
+public:
+	// Binding point of DrawBlock, and of the storage buffer of the indirect variant.
+	static constexpr GLuint kDrawBlockBinding = 0;
+
+	// DrawSubmissionShaderProg Public Methods.
+	DrawSubmissionShaderProg();
+	~DrawSubmissionShaderProg();
+
+	GLint GetLocWorldMatrix() const { return locWorldMatrix; }
+	GLint GetLocNormalMatrix() const { return locNormalMatrix; }
+	GLint GetLocKa() const { return locKa; }
+	GLint GetLocKd() const { return locKd; }
+	GLint GetLocKs() const { return locKs; }
+
+protected:
+	// DrawSubmissionShaderProg Protected Methods.
+	void GetUniformVariableLocation() override;
+
+private:
+	// DrawSubmissionShaderProg Private Data.
+	GLint locWorldMatrix;
+	GLint locNormalMatrix;
+	GLint locKa;
+	GLint locKd;
+	GLint locKs;
 };
@@ -0,0 +1,138 @@
+#pragma once
+
+// C++ STL headers.
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// GLM headers.
+#include <glm/glm.hpp>
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+// Project headers.
+#include "Camera.h"
+#include "FrameArena.h"
+#include "Light.h"
+#include "ShaderProg.h"
+#include "TriangleMesh.h"
+
+// ShadowCaster Declarations.
+struct ShadowCaster
+{
+	/**
+	 * @brief World space bounding sphere (xyz: center, w: radius).
+	*/
+	glm::vec4 GetBoundingSphere() const;
+
+	// Owned by the scene, the caster list is rebuilt every frame.
+	const opengl_homework::TriangleMesh* mesh;
+	glm::mat4 worldMatrix;
+};
+
+/**
+ * @brief ShadowAtlas class.
+ *
+ * One depth texture split into 2 x 2 tiles: kNumCascades cascades of the
+ * directional light and one map of the spot light. A tile is only re-rendered
+ * when its light matrix changes, when it is invalidated, or when a caster
+ * inside its frustum moves; otherwise the previous depth is reused.
+ *
+ * @note Cascades are fitted to bounding spheres and snapped to whole texels,
+ * so their matrices stay constant while the lights and the camera are still.
+*/
+class ShadowAtlas
+{
+public:
+	static constexpr int kNumCascades = 3;
+	static constexpr int kSpotView = kNumCascades;
+	static constexpr int kNumViews = kNumCascades + 1;
+
+	// ShadowAtlas Public Methods.
+	/**
+	 * @param tileSize Resolution of one shadow map.
+	 * @param shadowDistance View depth covered by the cascades.
+	*/
+	ShadowAtlas(const int tileSize, const float shadowDistance);
+	~ShadowAtlas();
+
+	/**
+	 * @brief Fit the shadow views to the lights and re-render the tiles which changed.
+	 *
+	 * @param arena Holds the bounding spheres of the casters for the frame.
+	 *
+	 * @note Restores the bound framebuffer, viewport and face culling.
+	*/
+	void Update(
+		const std::shared_ptr<Camera>& camera,
+		const std::shared_ptr<DirectionalLight>& dirLight,
+		const std::shared_ptr<SpotLight>& spotLight,
+		const std::vector<ShadowCaster>& casters,
+		FrameArena& arena,
+		const std::shared_ptr<DepthOnlyShaderProg>& shader);
+
+	/**
+	 * @brief Force the next Update to re-render the views of a light.
+	*/
+	void InvalidateDirectionalLight();
+	void InvalidateSpotLight();
+	void InvalidateAll();
+
+	/**
+	 * @brief Change the resolution of one shadow map and re-render every view.
+	*/
+	void SetTileSize(const int tileSize);
+	int GetTileSize() const { return tileSize; }
+
+	void Bind(const GLenum textureUnit) const;
+
+	/**
+	 * @brief Matrices from camera view space to atlas coordinates, valid after Update.
+	*/
+	const glm::mat4* GetCascadeMatrices() const { return shadowMatrices; }
+	const glm::mat4& GetSpotMatrix() const { return shadowMatrices[kSpotView]; }
+	// Far view depth of every cascade.
+	glm::vec3 GetCascadeSplits() const { return cascadeSplits; }
+
+	int GetNumPassesRendered() const { return numPassesRendered; }
+	int GetNumPassesSkipped() const { return numPassesSkipped; }
+
+	/**
+	 * @brief Test a sphere (xyz: center, w: radius) against the frustum of a view-projection matrix.
+	*/
+	static bool IntersectsFrustum(const glm::mat4& viewProj, const glm::vec4& sphere);
+
+private:
+	// ShadowView Declarations.
+	struct ShadowView
+	{
+		bool active = false;
+		bool valid = false;
+		glm::mat4 viewProj = glm::mat4(1.0f);
+		uint64_t casterKey = 0;
+	};
+
+	// ShadowAtlas Private Methods.
+	void CreateTargets();
+	void ReleaseTargets();
+	glm::mat4 FitCascade(const glm::mat4& invView, const glm::vec3 nearCorners[4], const float zNear,
+		const float depthBegin, const float depthEnd, const glm::vec3& lightDir,
+		const std::span<const glm::vec4> casterSpheres) const;
+	static glm::mat4 FitSpot(const SpotLight& spotLight, const std::span<const glm::vec4> casterSpheres);
+	static uint64_t GetCasterKey(const glm::mat4& viewProj, const std::vector<ShadowCaster>& casters,
+		const std::span<const glm::vec4> casterSpheres);
+	glm::mat4 GetTileMatrix(const int view) const;
+
+	// ShadowAtlas Private Data.
+	GLuint fboId;
+	GLuint texId;
+	int tileSize;
+	float shadowDistance;
+	ShadowView views[kNumViews];
+	glm::mat4 shadowMatrices[kNumViews];
+	glm::vec3 cascadeSplits;
+	int numPassesRendered;
+	int numPassesSkipped;
+};
@@ -1,54 +1,40 @@
 #pragma once
 
-#include "ImageTexture.h"
+#include "CubemapTexture.h"
 #include "ShaderProg.h"
 #include "Material.h"
 #include "Camera.h"
 
-// VertexPT Declarations.
-struct VertexPT
-{
-	VertexPT() {
-		position = glm::vec3(0.0f, 0.0f, 0.0f);
-		texcoord = glm::vec2(0.0f, 0.0f);
-	}
-	VertexPT(glm::vec3 p, glm::vec2 uv) {
-		position = p;
-		texcoord = uv;
-	}
-	glm::vec3 position;
-	glm::vec2 texcoord;
-};
-
-
 // Skybox Declarations.
+// The panorama is converted to a cube map at load time and drawn as a single
+// full-screen triangle at depth 1.0 after the opaque geometry.
 class Skybox
 {
 public:
 	// Skybox Public Methods.
-	Skybox(const std::filesystem::path& texImagePath, const int nSlices,
-		const int nStacks, const float radius);
+	Skybox(const std::filesystem::path& texImagePath);
+	Skybox(std::shared_ptr<CubemapTexture> cubemap);
 	~Skybox();
 	void Render(std::shared_ptr<Camera> camera, std::shared_ptr<SkyboxShaderProg> shader);
 
 	void SetRotation(const float newRotation) { rotationY = newRotation; }
 
 	std::shared_ptr<SkyboxMaterial> GetMaterial() const { return material; }
+	std::shared_ptr<CubemapTexture> GetCubemap() const { return cubemap; }
 	float GetRotation() const { return rotationY; }
 
 private:
 	// Skybox Private Methods.
-	static void CreateSphere3D(const int nSlices, const int nStacks, const float radius,
-		std::vector<VertexPT>& vertices, std::vector<unsigned int>& indices);
+	void AcquireGeometry();
+	static void ReleaseGeometry();
 
 	// Skybox Private Data.
-	GLuint vboId;
-	GLuint iboId;
-	std::vector<VertexPT> vertices;
-	std::vector<unsigned int> indices;
+	// The full-screen triangle is shared by all skyboxes.
+	static GLuint vboId;
+	static int numInstances;
 
 	std::shared_ptr<SkyboxMaterial> material;
-	std::shared_ptr<ImageTexture> panorama;
+	std::shared_ptr<CubemapTexture> cubemap;
 
 	float rotationY;
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+// C++ STL headers.
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+
+// Project headers.
+#include "JobSystem.h"
+#include "Skybox.h"
+
+// SkyboxCache Declarations.
+// Decodes panoramas on the job system and keeps the recently used skyboxes
+// resident on the GPU within a memory budget.
+class SkyboxCache
+{
+public:
+	// SkyboxCache Public Methods.
+	SkyboxCache(const size_t budgetBytes, JobSystem& jobSystem);
+	~SkyboxCache();
+
+	/**
+	 * @brief Get a skybox if it is resident, otherwise start decoding it in the background.
+	 *
+	 * @param texImagePath Path to the panorama.
+	 *
+	 * @return nullptr if the skybox is not ready yet.
+	*/
+	std::shared_ptr<Skybox> Request(const std::filesystem::path& texImagePath);
+
+	/**
+	 * @brief Upload the panoramas decoded since the last call.
+	 *
+	 * @note Must be called on the thread owning the GL context.
+	 *
+	 * @return true if a skybox became resident.
+	*/
+	bool Update();
+
+	size_t GetResidentBytes() const { return residentBytes; }
+	// True while a panorama is being decoded.
+	bool HasPending() const { return !pending.empty(); }
+
+private:
+	// SkyboxCache Private Declarations.
+	struct PendingDecode
+	{
+		JobCounter counter;
+		std::shared_ptr<CubemapImage> image;
+	};
+
+	// SkyboxCache Private Methods.
+	void Evict();
+
+	// SkyboxCache Private Data.
+	JobSystem& jobSystem;
+	size_t budgetBytes;
+	size_t residentBytes;
+	// Resident skyboxes, most recently used first.
+	std::list<std::pair<std::filesystem::path, std::shared_ptr<Skybox>>> resident;
+	std::map<std::filesystem::path, std::unique_ptr<PendingDecode>> pending;
+};
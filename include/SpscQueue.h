@@ -0,0 +1,60 @@
+#pragma once
+
+// C++ STL headers.
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free queue between one producer and one consumer thread.
+ *
+ * The producer only writes the tail and the consumer only writes the head, so
+ * neither ever waits for the other; a full queue fails Push and an empty one
+ * fails Pop. The indices sit on separate cache lines to keep the two threads
+ * from invalidating each other's line on every operation.
+ *
+ * @tparam T Element type, moved in and out of the ring.
+ * @tparam Capacity Maximum number of queued elements.
+*/
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+	/**
+	 * @brief Producer side, returns false if the queue is full.
+	*/
+	bool Push(T value) {
+		const size_t tail = this->tail.load(std::memory_order_relaxed);
+		const size_t next = (tail + 1) % kSlots;
+		if (next == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		slots[tail] = std::move(value);
+		this->tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Consumer side, returns false if the queue is empty.
+	*/
+	bool Pop(T& value) {
+		const size_t head = this->head.load(std::memory_order_relaxed);
+		if (head == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = std::move(slots[head]);
+		this->head.store((head + 1) % kSlots, std::memory_order_release);
+		return true;
+	}
+
+	bool IsEmpty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+private:
+	// One slot stays empty to tell a full queue from an empty one.
+	static constexpr size_t kSlots = Capacity + 1;
+
+	// SpscQueue Private Data.
+	alignas(64) std::atomic<size_t> head = 0;
+	alignas(64) std::atomic<size_t> tail = 0;
+	alignas(64) T slots[kSlots];
+};
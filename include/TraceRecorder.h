@@ -0,0 +1,75 @@
+#pragma once
+
+// C++ STL headers.
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+/**
+ * @brief TraceRecorder class.
+ *
+ * Records begin/end events of named scopes for a timeline of the frames,
+ * loads and worker threads. Every thread writes into its own ring buffer of
+ * kCapacity events without locks, so the recorder always holds the last
+ * window of activity; Dump writes it as Chrome trace JSON, which Perfetto and
+ * chrome://tracing both open.
+ *
+ * @note Names must outlive the recorder, pass string literals.
+*/
+class TraceRecorder
+{
+public:
+	static constexpr uint64_t kCapacity = 16384;
+
+	// Ring buffer of one thread, defined in TraceRecorder.cpp.
+	struct ThreadBuffer;
+
+	/**
+	 * @brief Record the begin or the end of a scope on the calling thread.
+	*/
+	static void Begin(const char* name);
+	static void End(const char* name);
+
+	/**
+	 * @brief Name the calling thread in the trace.
+	*/
+	static void SetThreadName(const char* name);
+
+	/**
+	 * @brief Write the events of every thread as Chrome trace JSON.
+	 *
+	 * @return true if the file was written.
+	*/
+	static bool Dump(const std::filesystem::path& filePath);
+
+private:
+	// TraceRecorder Private Declarations.
+	struct Event
+	{
+		const char* name;
+		double time;
+		uint32_t threadId;
+		char phase;
+	};
+
+	// TraceRecorder Private Methods.
+	static ThreadBuffer& GetThreadBuffer();
+	static void Record(const char* name, const char phase);
+};
+
+/**
+ * @brief RAII helper recording a TraceRecorder scope for the lifetime of the object.
+*/
+class TraceScope
+{
+public:
+	TraceScope(const char* name) : name(name) { TraceRecorder::Begin(name); }
+	~TraceScope() { TraceRecorder::End(name); }
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name;
+};
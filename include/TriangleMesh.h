@@ -4,13 +4,22 @@
 #include <glm/glm.hpp>
 
 // C++ STL headers.
+#include <cstdint>
 #include <filesystem>
+#include <span>
+#include <vector>
 
 // Project headers.
 #include "Light.h"
 #include "ShaderProg.h"
+#include "ShaderPermutations.h"
 #include "Camera.h"
 
+class FrameArena;
+class JobSystem;
+class ShadowAtlas;
+class VisibilityBuffer;
+
 namespace opengl_homework {
 
 /**
@@ -19,6 +28,66 @@ namespace opengl_homework {
 class TriangleMesh
 {
 public:
+	// LoadStats Declarations.
+	// Seconds spent in each stage of the constructor, and the bytes of the obj and mtl files.
+	struct LoadStats
+	{
+		double readTime = 0.0;
+		// Obj parsing, without the material libraries.
+		double parseTime = 0.0;
+		// Mtl reading and parsing, without the textures.
+		double mtlTime = 0.0;
+		double textureTime = 0.0;
+		// Normalization and bounding sphere.
+		double normalizeTime = 0.0;
+		// Clusters and normal cones.
+		double postProcessTime = 0.0;
+		size_t numFileBytes = 0;
+	};
+
+	// DrawPacket Declarations.
+	// A visible submesh and the range of its visible cluster runs in the draw ranges of the frame.
+	struct DrawPacket
+	{
+		// Texture variant in the high bits, then the view depth, front to back.
+		uint64_t sortKey = 0;
+		int subMesh = 0;
+		int firstRange = 0;
+		int numRanges = 0;
+		int numTriangles = 0;
+	};
+
+	// PacketBuffer Declarations.
+	// Packets and multi-draw ranges written by one preparation job, in arrays
+	// of the frame arena sized for the worst case.
+	struct PacketBuffer
+	{
+		DrawPacket* packets = nullptr;
+		int numPackets = 0;
+		GLsizei* drawCounts = nullptr;
+		const void** drawOffsets = nullptr;
+		int numRanges = 0;
+
+		std::span<const DrawPacket> GetPackets() const { return { packets, (size_t)numPackets }; }
+	};
+
+	// PreparedFrame Declarations.
+	// Culling results, draw order and per-object uniforms of one frame, made by
+	// Prepare and shared by every pass drawing the mesh from the camera. The
+	// arrays live in the frame arena and are only valid until it is reset.
+	struct PreparedFrame
+	{
+		glm::mat4 worldMatrix = glm::mat4(1.0f);
+		glm::mat4 viewMatrix = glm::mat4(1.0f);
+		glm::mat4 normalMatrix = glm::mat4(1.0f);
+		glm::mat4 MVP = glm::mat4(1.0f);
+		glm::vec3 cameraPos = glm::vec3(0.0f);
+		// Merged and sorted output of the jobs.
+		PacketBuffer merged;
+		// One buffer per job, so that the jobs never share one.
+		PacketBuffer* jobBuffers = nullptr;
+	};
+
 	// TriangleMesh Public Methods.
 	TriangleMesh(const std::filesystem::path&, const bool);
 	~TriangleMesh();
@@ -35,28 +104,139 @@ public:
 
 	/**
 	 * @brief Render the mesh.
+	 *
+	 * Each submesh is drawn with the variant having only the features its
+	 * material and the non-null lights need, in the order of the packets.
 	 * 
-	 * @param shaderProg
-	 * @param worldMatrix
+	 * @param shaderPermutations
+	 * @param frame Made by Prepare.
 	 * @param ambientLight
 	 * @param dirLight
 	 * @param pointLight
 	 * @param spotLight
-	 * @param camera
+	 * @param shadowAtlas Null to render without shadows, including the point light shadow.
 	*/
 	void Render(
-		const std::shared_ptr<PhongShadingDemoShaderProg>&,
-		const glm::mat4&,
+		ShaderPermutations<PhongShadingDemoShaderProg>&,
+		const PreparedFrame&,
 		const glm::vec3&, 
 		const std::shared_ptr<DirectionalLight>&,
 		const std::shared_ptr<PointLight>&, 
 		const std::shared_ptr<SpotLight>&,
-		const std::shared_ptr<Camera>&) const;
+		const std::shared_ptr<ShadowAtlas>&) const;
+
+	/**
+	 * @brief Cull the submeshes and their clusters for the camera on the job
+	 * system, and sort the visible submeshes into draw packets.
+	 *
+	 * @param worldMatrix
+	 * @param camera
+	 * @param jobSystem
+	 * @param arena Holds the packets and draw ranges of the frame.
+	 * @param frame Overwritten, reused from frame to frame.
+	*/
+	void Prepare(
+		const glm::mat4&,
+		const std::shared_ptr<Camera>&,
+		JobSystem&,
+		FrameArena&,
+		PreparedFrame&) const;
+
+	/**
+	 * @brief Render only the depth of the mesh with the position-only vertex stream.
+	 *
+	 * @param shaderProg
+	 * @param frame Made by Prepare.
+	*/
+	void RenderDepth(
+		const std::shared_ptr<DepthOnlyShaderProg>&,
+		const PreparedFrame&) const;
+
+	/**
+	 * @brief Render the depth of every triangle from a light, without cluster culling.
+	 *
+	 * @param shaderProg
+	 * @param worldMatrix
+	 * @param lightViewProj
+	*/
+	void RenderShadow(
+		const std::shared_ptr<DepthOnlyShaderProg>&,
+		const glm::mat4&,
+		const glm::mat4&) const;
+
+	/**
+	 * @brief Draw every triangle with the position-only vertex stream.
+	 *
+	 * @note The caller binds the program and sets its uniforms.
+	 *
+	 * @param numInstances
+	*/
+	void DrawPositions(const int) const;
+
+	/**
+	 * @brief Write the submesh and triangle IDs of the visible clusters into a bound visibility buffer.
+	 *
+	 * @param shaderProg
+	 * @param frame Made by Prepare.
+	*/
+	void RenderVisibility(
+		const std::shared_ptr<VisibilityShaderProg>&,
+		const PreparedFrame&) const;
+
+	/**
+	 * @brief Shade every pixel of the visibility buffer exactly once, with the
+	 * vertex attributes of its triangle fetched from the mesh buffers.
+	 *
+	 * @note Requires OpenGL 4.3 for the shader storage buffers.
+	 *
+	 * @param shaderPermutations
+	 * @param visibilityBuffer Filled by RenderVisibility with the same frame.
+	 * @param frame Made by Prepare.
+	 * @param ambientLight
+	 * @param dirLight
+	 * @param pointLight
+	 * @param spotLight
+	 * @param shadowAtlas Null to render without shadows, including the point light shadow.
+	*/
+	void ResolveVisibility(
+		ShaderPermutations<VisibilityResolveShaderProg>&,
+		const VisibilityBuffer&,
+		const PreparedFrame&,
+		const glm::vec3&,
+		const std::shared_ptr<DirectionalLight>&,
+		const std::shared_ptr<PointLight>&,
+		const std::shared_ptr<SpotLight>&,
+		const std::shared_ptr<ShadowAtlas>&) const;
+
+	/**
+	 * @brief Enable or disable the CPU cluster cone culling.
+	 *
+	 * @note Back faces inside the visible clusters are still rejected by glCullFace.
+	*/
+	void SetClusterCulling(const bool enabled);
 
 	int GetNumVertices() const;
 	int GetNumTriangles() const;
 	int GetNumIndices() const;
+	int GetNumClusters() const;
+	int GetNumTrianglesDrawn() const;
+	int GetNumDrawCalls() const;
 	glm::vec3 GetObjCenter() const;
+	/**
+	 * @brief Bounding sphere of the vertices in object space (xyz: center, w: radius).
+	*/
+	glm::vec4 GetBoundingSphere() const;
+	const LoadStats& GetLoadStats() const;
+
+	/**
+	 * @brief Buffers made by CreateBuffers, for tools drawing the mesh their own way.
+	 *
+	 * The vertex buffer interleaves a vec3 position, a vec3 normal and a vec2 texcoord.
+	*/
+	GLuint GetVertexBuffer() const;
+	int GetNumSubMeshes() const;
+	GLuint GetSubMeshIndexBuffer(const int subMesh) const;
+	int GetSubMeshNumIndices(const int subMesh) const;
 
 	void PrintMeshInfo() const;
 
@@ -64,6 +244,7 @@ private:
 
 	// VertexPTN Declarations.
 	struct VertexPTN;
+	struct Cluster;
 	struct SubMesh;
 
 	/**
@@ -97,11 +278,28 @@ private:
 	bool LoadMtllib(const std::filesystem::path&);
 
 	/**
-	 * @brief Render the submesh.
-	 * 
+	 * @brief Split every submesh into clusters and compute their normal cones.
+	*/
+	void BuildClusters();
+
+	/**
+	 * @brief Append the draw ranges of the clusters which may face the camera.
+	 *
 	 * @param subMesh
+	 * @param cameraPos Camera position in object space.
+	 * @param buffer
+	 *
+	 * @return The number of ranges appended.
+	 */
+	int CullClusters(const SubMesh&, const glm::vec3&, PacketBuffer&) const;
+
+	/**
+	 * @brief Render the draw ranges of a packet.
+	 * 
+	 * @param frame
+	 * @param packet
 	 */
-	void RenderSubMesh(const SubMesh&) const;
+	void RenderSubMesh(const PreparedFrame&, const DrawPacket&) const;
 };
 
 }
\ No newline at end of file
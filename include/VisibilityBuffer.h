@@ -0,0 +1,55 @@
+#pragma once
+
+// OpenGL headers.
+#include <GL/glew.h>
+
+/**
+ * @brief VisibilityBuffer class.
+ *
+ * Stores the submesh (draw ID) and the triangle index of every pixel in an
+ * RG32UI target, plus depth. TriangleMesh::ResolveVisibility then shades each
+ * pixel once from these IDs, so sub-pixel triangles cost no quad overshading
+ * in the phong pass. Pixels without geometry keep the ID kEmptyId.
+*/
+class VisibilityBuffer
+{
+public:
+	static constexpr GLuint kEmptyId = 0xFFFFFFFFu;
+	// Texture units of the resolve pass, after the ones of the phong shader.
+	static constexpr GLenum kIdTextureUnit = GL_TEXTURE3;
+	static constexpr GLenum kDepthTextureUnit = GL_TEXTURE4;
+
+	// VisibilityBuffer Public Methods.
+	VisibilityBuffer(const int width, const int height);
+	~VisibilityBuffer();
+
+	void Resize(const int width, const int height);
+
+	/**
+	 * @brief Bind and clear the buffer. Render the meshes with RenderVisibility afterwards.
+	*/
+	void BeginGeometryPass();
+	void EndGeometryPass();
+
+	/**
+	 * @brief Bind the IDs and the depth to kIdTextureUnit and kDepthTextureUnit.
+	*/
+	void Bind() const;
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+
+private:
+	// VisibilityBuffer Private Methods.
+	void CreateTargets();
+	void ReleaseTargets();
+
+	// VisibilityBuffer Private Data.
+	int width;
+	int height;
+	GLuint fboId;
+	// Framebuffer bound before the geometry pass, restored after it.
+	GLint prevFboId;
+	GLuint idTexId;
+	GLuint depthTexId;
+};
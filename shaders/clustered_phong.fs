@@ -0,0 +1,132 @@
+#version 430 core
+
+// Features injected by ShaderPermutations, see PhongFeature.
+// HAS_MAP_KD:    sample mapKd instead of using Kd.
+// USE_DIR_LIGHT: evaluate the directional light.
+
+// Transformation matrix.
+uniform mat4 viewMatrix;
+
+// Material properties.
+uniform vec3 Ka;
+uniform vec3 Kd;
+uniform vec3 Ks;
+uniform float Ns;
+uniform sampler2D mapKd;
+// Light data.
+uniform vec3 dirLightDir;
+uniform vec3 dirLightRadiance;
+uniform vec3 ambientLight;
+
+// Cluster grid, shared by all programs, see LightClusterGrid::Upload.
+layout (std140, binding = 0) uniform ClusterParams
+{
+    uvec4 clusterDims;      // xyz: tiles and slices.
+    vec4 clusterScreen;     // xy: screen size, z: near depth, w: slices per log depth.
+};
+
+// Point and spot lights in view space, see LightClusterGrid::Light.
+struct Light
+{
+    vec4 positionRange;
+    vec4 intensityType;
+    vec4 direction;
+    vec4 spotParams;
+};
+
+layout (std430, binding = 0) readonly buffer LightBuffer
+{
+    Light lights[];
+};
+
+// Offset into lightIndices and number of lights of each cluster.
+layout (std430, binding = 1) readonly buffer ClusterBuffer
+{
+    uvec2 clusterRanges[];
+};
+
+layout (std430, binding = 2) readonly buffer LightIndexBuffer
+{
+    uint lightIndices[];
+};
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTexCoord;
+
+out vec4 FragColor;
+
+vec3 Ambient(vec3 Ka, vec3 I)
+{
+    return Ka * I;
+}
+
+vec3 Diffuse(vec3 texColor, vec3 I, vec3 N, vec3 lightDir)
+{
+    return texColor * I * max(0, dot(N, lightDir));
+}
+
+vec3 Specular(vec3 Ks, vec3 I, vec3 L, vec3 N, vec3 E, float shininess)
+{
+    vec3 H = normalize(L + E);
+    return Ks * I * pow(max(0, dot(N, H)), shininess);
+}
+
+// Same mapping as LightClusterGrid::GetClusterIndex.
+uint ClusterIndex()
+{
+    uvec2 tile = uvec2(gl_FragCoord.xy / clusterScreen.xy * vec2(clusterDims.xy));
+    tile = min(tile, clusterDims.xy - 1u);
+    float slice = log(max(-fPosition.z, clusterScreen.z) / clusterScreen.z) * clusterScreen.w;
+    uint z = min(uint(slice), clusterDims.z - 1u);
+    return tile.x + clusterDims.x * (tile.y + clusterDims.y * z);
+}
+
+void main()
+{
+    // Ambient light.
+    vec3 color = Ambient(Ka, ambientLight);
+
+    // Eye vector, the camera is at the origin of the view space.
+    vec3 E = normalize(-fPosition);
+
+    // Texture color.
+#ifdef HAS_MAP_KD
+    vec3 texColor = texture(mapKd, fTexCoord).rgb;
+#else
+    vec3 texColor = Kd;
+#endif
+
+    vec3 N = normalize(fNormal);
+
+#ifdef USE_DIR_LIGHT
+    // Directional light.
+    vec3 vDirLightDir = vec3(viewMatrix * vec4(dirLightDir, 0.0));
+    vDirLightDir = normalize(vDirLightDir);
+    color += Diffuse(texColor, dirLightRadiance, N, vDirLightDir);
+    color += Specular(Ks, dirLightRadiance, vDirLightDir, N, E, Ns);
+#endif
+
+    // Point and spot lights of this cluster.
+    uvec2 range = clusterRanges[ClusterIndex()];
+    for (uint i = 0u; i < range.y; ++i) {
+        Light light = lights[lightIndices[range.x + i]];
+        vec3 lightDist = light.positionRange.xyz - fPosition;
+        float distSqr = dot(lightDist, lightDist);
+        vec3 L = lightDist * inversesqrt(distSqr);
+
+        // Inverse square falloff, windowed to reach zero at the light range.
+        float window = clamp(1.0 - distSqr / (light.positionRange.w * light.positionRange.w), 0.0, 1.0);
+        vec3 I = light.intensityType.xyz * window * window / distSqr;
+
+        if (light.intensityType.w > 0.5) {
+            float deltaDeg = degrees(acos(clamp(dot(L, -light.direction.xyz), -1.0, 1.0)));
+            I *= clamp((light.spotParams.x - deltaDeg) / light.spotParams.y, 0, 1);
+        }
+
+        color += Diffuse(texColor, I, N, L);
+        color += Specular(Ks, I, L, N, E, Ns);
+    }
+
+    FragColor = vec4(color, 1.0);
+}
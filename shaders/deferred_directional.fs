@@ -0,0 +1,69 @@
+#version 330 core
+
+// G-buffer, see gbuffer.fs.
+uniform sampler2D gAlbedoNs;
+uniform sampler2D gSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gAmbient;
+uniform sampler2D gDepth;
+uniform mat4 invProjMatrix;
+// Light data in view space, zero radiance without a directional light.
+uniform vec3 dirLightDir;
+uniform vec3 dirLightRadiance;
+
+out vec4 FragColor;
+
+vec3 Diffuse(vec3 texColor, vec3 I, vec3 N, vec3 lightDir)
+{
+    return texColor * I * max(0, dot(N, lightDir));
+}
+
+vec3 Specular(vec3 Ks, vec3 I, vec3 L, vec3 N, vec3 E, float shininess)
+{
+    vec3 H = normalize(L + E);
+    return Ks * I * pow(max(0, dot(N, H)), shininess);
+}
+
+vec2 SignNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// e is the octahedral normal remapped to [0, 1], as stored in the G-buffer.
+vec3 OctDecode(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+    }
+    return normalize(n);
+}
+
+// Ambient and directional light of every covered pixel. Also copies the depth
+// of the G-buffer so that the skybox and the light markers are depth tested.
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0) {
+        discard;
+    }
+
+    vec4 ndc = vec4(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 viewPos = invProjMatrix * ndc;
+    vec3 P = viewPos.xyz / viewPos.w;
+
+    vec4 albedoNs = texelFetch(gAlbedoNs, pixel, 0);
+    vec3 Ks = texelFetch(gSpecular, pixel, 0).rgb;
+    vec3 N = OctDecode(texelFetch(gNormal, pixel, 0).xy);
+    float Ns = exp2(albedoNs.a * 11.0) - 1.0;
+    vec3 E = normalize(-P);
+
+    vec3 color = texelFetch(gAmbient, pixel, 0).rgb;
+    color += Diffuse(albedoNs.rgb, dirLightRadiance, N, dirLightDir);
+    color += Specular(Ks, dirLightRadiance, dirLightDir, N, E, Ns);
+
+    FragColor = vec4(color, 1.0);
+    gl_FragDepth = depth;
+}
@@ -0,0 +1,9 @@
+#version 330 core
+
+// Full-screen triangle in clip space.
+layout (location = 0) in vec2 Position;
+
+void main()
+{
+    gl_Position = vec4(Position, 0.0, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 330 core
+
+// Unit cube around the light, scaled to its range.
+layout (location = 0) in vec3 Position;
+// Per-instance light in view space, see LightClusterGrid::Light.
+layout (location = 1) in vec4 LightPositionRange;
+layout (location = 2) in vec4 LightIntensityType;
+layout (location = 3) in vec4 LightDirection;
+layout (location = 4) in vec4 LightSpotParams;
+
+uniform mat4 projMatrix;
+
+flat out vec4 fLightPositionRange;
+flat out vec4 fLightIntensityType;
+flat out vec4 fLightDirection;
+flat out vec4 fLightSpotParams;
+
+void main()
+{
+    gl_Position = projMatrix * vec4(LightPositionRange.xyz + Position * LightPositionRange.w, 1.0);
+    fLightPositionRange = LightPositionRange;
+    fLightIntensityType = LightIntensityType;
+    fLightDirection = LightDirection;
+    fLightSpotParams = LightSpotParams;
+}
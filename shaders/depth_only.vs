@@ -0,0 +1,13 @@
+#version 330 core
+
+layout (location = 0) in vec3 Position;
+
+uniform mat4 MVP;
+
+// Must match the depth of phong_shading_demo.vs exactly for the GL_EQUAL test.
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = MVP * vec4(Position, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec3 fNormal;
+in vec2 fTexCoord;
+flat in vec3 fKa;
+flat in vec3 fKd;
+flat in vec3 fKs;
+
+out vec4 FragColor;
+
+// Cheap enough that the draw submission, not the shading, dominates.
+void main()
+{
+    const vec3 lightDir = vec3(0.267, 0.802, 0.535);
+    vec3 N = normalize(fNormal);
+    float diffuse = max(dot(N, lightDir), 0.0);
+    float specular = pow(max(N.z, 0.0), 16.0);
+    FragColor = vec4(fKa + fKd * diffuse + fKs * specular, 1.0);
+}
@@ -0,0 +1,41 @@
+#version 330 core
+
+layout (location = 0) in vec3 Position;
+layout (location = 1) in vec3 Normal;
+layout (location = 2) in vec2 TexCoord;
+
+// Per-draw data, set with glUniform or bound as a range of one uniform buffer.
+#ifdef PER_DRAW_UBO
+layout (std140) uniform DrawBlock
+{
+    mat4 MVP;
+    mat4 worldMatrix;
+    mat4 normalMatrix;
+    vec4 Ka;
+    vec4 Kd;
+    vec4 Ks;
+};
+#else
+uniform mat4 MVP;
+uniform mat4 worldMatrix;
+uniform mat4 normalMatrix;
+uniform vec4 Ka;
+uniform vec4 Kd;
+uniform vec4 Ks;
+#endif
+
+out vec3 fNormal;
+out vec2 fTexCoord;
+flat out vec3 fKa;
+flat out vec3 fKd;
+flat out vec3 fKs;
+
+void main()
+{
+    gl_Position = MVP * vec4(Position, 1.0);
+    fNormal = normalize(vec3(normalMatrix * vec4(Normal, 0.0)));
+    fTexCoord = TexCoord;
+    fKa = Ka.rgb;
+    fKd = Kd.rgb;
+    fKs = Ks.rgb;
+}
@@ -0,0 +1,39 @@
+#version 430 core
+
+layout (location = 0) in vec3 Position;
+layout (location = 1) in vec3 Normal;
+layout (location = 2) in vec2 TexCoord;
+// Per-instance attribute advanced by the base instance of each indirect command.
+layout (location = 3) in uint DrawId;
+
+struct DrawData
+{
+    mat4 MVP;
+    mat4 worldMatrix;
+    mat4 normalMatrix;
+    vec4 Ka;
+    vec4 Kd;
+    vec4 Ks;
+};
+
+layout (std430, binding = 0) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
+
+out vec3 fNormal;
+out vec2 fTexCoord;
+flat out vec3 fKa;
+flat out vec3 fKd;
+flat out vec3 fKs;
+
+void main()
+{
+    DrawData draw = draws[DrawId];
+    gl_Position = draw.MVP * vec4(Position, 1.0);
+    fNormal = normalize(vec3(draw.normalMatrix * vec4(Normal, 0.0)));
+    fTexCoord = TexCoord;
+    fKa = draw.Ka.rgb;
+    fKd = draw.Kd.rgb;
+    fKs = draw.Ks.rgb;
+}
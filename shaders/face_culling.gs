@@ -1,28 +0,0 @@
-#version 330 core
-
-layout (triangles) in;
-layout (triangle_strip, max_vertices = 3) out;
-
-in vec3 vPosition[];
-in vec3 vNormal[];
-in vec2 vTexCoord[];
-
-out vec3 fPosition;
-out vec3 fNormal;
-out vec2 fTexCoord;
-
-void main() {
-    vec3 normal = normalize(cross(vPosition[1] - vPosition[0], vPosition[2] - vPosition[0]));
-    if (dot(normal, vPosition[0]) > 0) {
-        return;
-    }
-
-    for (int i = 0; i < 3; i++) {
-        fPosition = vPosition[i];
-        fNormal = vNormal[i];
-        fTexCoord = vTexCoord[i];
-        gl_Position = gl_in[i].gl_Position;
-        EmitVertex();
-    }
-    EndPrimitive();
-}
\ No newline at end of file
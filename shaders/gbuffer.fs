@@ -0,0 +1,49 @@
+#version 330 core
+
+// Features injected by ShaderPermutations, see PhongFeature.
+// HAS_MAP_KD: sample mapKd instead of using Kd.
+
+// Material properties.
+uniform vec3 Ka;
+uniform vec3 Kd;
+uniform vec3 Ks;
+uniform float Ns;
+uniform sampler2D mapKd;
+// Light data.
+uniform vec3 ambientLight;
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTexCoord;
+
+// G-buffer, see DeferredRenderer.
+layout (location = 0) out vec4 gAlbedoNs;   // rgb: diffuse color, a: log2(Ns + 1) / 11.
+layout (location = 1) out vec4 gSpecular;   // rgb: Ks.
+layout (location = 2) out vec2 gNormal;     // Octahedral view space normal in [0, 1].
+layout (location = 3) out vec4 gAmbient;    // rgb: Ka * ambientLight.
+
+vec2 SignNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Project the unit sphere onto an octahedron and unfold it into [-1, 1]^2.
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+}
+
+void main()
+{
+#ifdef HAS_MAP_KD
+    vec3 texColor = texture(mapKd, fTexCoord).rgb;
+#else
+    vec3 texColor = Kd;
+#endif
+
+    gAlbedoNs = vec4(texColor, clamp(log2(Ns + 1.0) / 11.0, 0.0, 1.0));
+    gSpecular = vec4(Ks, 0.0);
+    gNormal = OctEncode(normalize(fNormal)) * 0.5 + 0.5;
+    gAmbient = vec4(Ka * ambientLight, 0.0);
+}
@@ -1,5 +1,16 @@
 #version 330 core
 
+// Features injected by ShaderPermutations, see PhongFeature.
+// HAS_MAP_KD:       sample mapKd instead of using Kd.
+// USE_DIR_LIGHT:    evaluate the directional light.
+// NUM_POINT_LIGHTS: number of point lights (0 or 1).
+// USE_SPOT:         evaluate the spot light.
+// USE_SHADOWS:      shadow the directional and spot lights with the shadow atlas.
+// USE_POINT_SHADOW: shadow the point light with its cube map.
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 0
+#endif
+
 // Transformation matrix.
 uniform mat4 worldMatrix;
 uniform mat4 viewMatrix;
@@ -27,6 +38,21 @@ uniform vec3 ambientLight;
 // Camera position.
 uniform vec3 locCameraPos;
 
+#ifdef USE_SHADOWS
+// Must match ShadowAtlas::kNumCascades.
+#define NUM_SHADOW_CASCADES 3
+// Shadow data, the matrices map view space to the atlas.
+uniform sampler2DShadow shadowAtlas;
+uniform mat4 cascadeShadowMatrices[NUM_SHADOW_CASCADES];
+uniform vec3 cascadeSplits;
+uniform mat4 spotShadowMatrix;
+#endif
+#ifdef USE_POINT_SHADOW
+uniform samplerCubeShadow pointShadowMap;
+// Depth of a distance d along the major axis is x + y / d.
+uniform vec2 pointShadowDepth;
+#endif
+
 in vec3 fPosition;
 in vec3 fNormal;
 in vec2 fTexCoord;
@@ -49,51 +75,95 @@ vec3 Specular(vec3 Ks, vec3 I, vec3 L, vec3 N, vec3 E, float shininess)
     return Ks * I * pow(max(0, dot(N, H)), shininess);
 }
 
-void main()
+#ifdef USE_SHADOWS
+float Shadow(mat4 shadowMatrix, vec3 P)
 {
-    vec3 vDirLightDir = vec3(viewMatrix * vec4(dirLightDir, 0.0));
-    vDirLightDir = normalize(vDirLightDir);
+    return textureProj(shadowAtlas, shadowMatrix * vec4(P, 1.0));
+}
 
-    vec3 vPointLightPos = vec3(viewMatrix * vec4(pointLightPos, 1.0));
-    vec3 pointLightDist = vPointLightPos - fPosition;
-    float pointLightDistSqr = dot(pointLightDist, pointLightDist);
-    vec3 vPointLightIntensity = pointLightIntensity / pointLightDistSqr;
+float CascadeShadow(vec3 P)
+{
+    float depth = -P.z;
+    for (int i = 0; i < NUM_SHADOW_CASCADES; ++i) {
+        if (depth < cascadeSplits[i]) {
+            return Shadow(cascadeShadowMatrices[i], P);
+        }
+    }
+    // Beyond the shadow distance.
+    return 1.0;
+}
+#endif
 
-    vec3 vSpotLightPos = vec3(viewMatrix * vec4(spotLightPos, 1.0));
-    vec3 vSpotLightDir = vec3(viewMatrix * vec4(spotLightDir, 0.0));
-    vSpotLightDir = normalize(vSpotLightDir);
-    vec3 spotLightDist = vSpotLightPos - fPosition;
-    float spotLightDistSqr = dot(spotLightDist, spotLightDist);
-    float deltaDeg = degrees(acos(dot(normalize(spotLightDist), -normalize(vSpotLightDir))));
-    float factor = clamp((spotLightTotalWidth - deltaDeg) / spotLightCutoff, 0, 1);
-    vec3 vSpotLightIntensity = spotLightIntensity * factor / spotLightDistSqr;
+#ifdef USE_POINT_SHADOW
+float PointShadow(vec3 lightToPoint)
+{
+    vec3 d = abs(lightToPoint);
+    float depth = pointShadowDepth.x + pointShadowDepth.y / max(d.x, max(d.y, d.z));
+    return texture(pointShadowMap, vec4(lightToPoint, depth));
+}
+#endif
 
+void main()
+{
     // Ambient light.
-    vec3 ambient = Ambient(Ka, ambientLight);
+    vec3 color = Ambient(Ka, ambientLight);
 
     // Eye vector.
     vec3 E = normalize(locCameraPos - fPosition);
 
     // Texture color.
+#ifdef HAS_MAP_KD
     vec3 texColor = texture(mapKd, fTexCoord).rgb;
-    if (texColor == vec3(0.0))
-        texColor = Kd;
+#else
+    vec3 texColor = Kd;
+#endif
 
     vec3 N = normalize(fNormal);
 
+#ifdef USE_DIR_LIGHT
     // Directional light.
-    vec3 dirLight = Diffuse(texColor, dirLightRadiance, N, vDirLightDir);
-    dirLight += Specular(Ks, dirLightRadiance, vDirLightDir, N, E, Ns);
-
+    vec3 vDirLightDir = vec3(viewMatrix * vec4(dirLightDir, 0.0));
+    vDirLightDir = normalize(vDirLightDir);
+    vec3 vDirLightRadiance = dirLightRadiance;
+#ifdef USE_SHADOWS
+    vDirLightRadiance *= CascadeShadow(fPosition);
+#endif
+    color += Diffuse(texColor, vDirLightRadiance, N, vDirLightDir);
+    color += Specular(Ks, vDirLightRadiance, vDirLightDir, N, E, Ns);
+#endif
+
+#if NUM_POINT_LIGHTS > 0
     // Point light.
-    vec3 P = normalize(vPointLightPos - fPosition);
-    vec3 pointLight = Diffuse(texColor, vPointLightIntensity, N, P);
-    pointLight += Specular(Ks, vPointLightIntensity, P, N, E, Ns);
-
+    vec3 vPointLightPos = vec3(viewMatrix * vec4(pointLightPos, 1.0));
+    vec3 pointLightDist = vPointLightPos - fPosition;
+    float pointLightDistSqr = dot(pointLightDist, pointLightDist);
+    vec3 vPointLightIntensity = pointLightIntensity / pointLightDistSqr;
+#ifdef USE_POINT_SHADOW
+    // The cube map is in world space, the view matrix only rotates and translates.
+    vPointLightIntensity *= PointShadow(transpose(mat3(viewMatrix)) * -pointLightDist);
+#endif
+    vec3 P = normalize(pointLightDist);
+    color += Diffuse(texColor, vPointLightIntensity, N, P);
+    color += Specular(Ks, vPointLightIntensity, P, N, E, Ns);
+#endif
+
+#ifdef USE_SPOT
     // Spot light.
-    vec3 S = normalize(vSpotLightPos - fPosition);
-    vec3 spotLight = Diffuse(texColor, vSpotLightIntensity, N, S);
-    spotLight += Specular(Ks, vSpotLightIntensity, S, N, E, Ns);
-
-    FragColor = vec4(ambient + dirLight + pointLight + spotLight, 1.0);
+    vec3 vSpotLightPos = vec3(viewMatrix * vec4(spotLightPos, 1.0));
+    vec3 vSpotLightDir = vec3(viewMatrix * vec4(spotLightDir, 0.0));
+    vSpotLightDir = normalize(vSpotLightDir);
+    vec3 spotLightDist = vSpotLightPos - fPosition;
+    float spotLightDistSqr = dot(spotLightDist, spotLightDist);
+    vec3 S = normalize(spotLightDist);
+    float deltaDeg = degrees(acos(dot(S, -vSpotLightDir)));
+    float factor = clamp((spotLightTotalWidth - deltaDeg) / spotLightCutoff, 0, 1);
+    vec3 vSpotLightIntensity = spotLightIntensity * factor / spotLightDistSqr;
+#ifdef USE_SHADOWS
+    vSpotLightIntensity *= Shadow(spotShadowMatrix, fPosition);
+#endif
+    color += Diffuse(texColor, vSpotLightIntensity, N, S);
+    color += Specular(Ks, vSpotLightIntensity, S, N, E, Ns);
+#endif
+
+    FragColor = vec4(color, 1.0);
 }
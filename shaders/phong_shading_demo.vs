@@ -11,16 +11,19 @@ uniform mat4 normalMatrix;
 uniform mat4 MVP;
 
 // Data pass to fragment shader.
-out vec3 vPosition;
-out vec3 vNormal;
-out vec2 vTexCoord;
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoord;
+
+// Must match the depth of depth_only.vs exactly for the GL_EQUAL test.
+invariant gl_Position;
 
 void main()
 {
     gl_Position = MVP * vec4(Position, 1.0);
 
     vec4 tmpPos = viewMatrix * worldMatrix * vec4(Position, 1.0);
-    vPosition = vec3(tmpPos) / tmpPos.w;
-    vNormal = normalize(vec3(normalMatrix * vec4(Normal, 0.0)));
-    vTexCoord = TexCoord;
+    fPosition = vec3(tmpPos) / tmpPos.w;
+    fNormal = normalize(vec3(normalMatrix * vec4(Normal, 0.0)));
+    fTexCoord = TexCoord;
 }
\ No newline at end of file
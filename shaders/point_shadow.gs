@@ -0,0 +1,17 @@
+#version 330 core
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+flat in int vLayer[];
+
+// Route the triangle to the cube face of its instance.
+void main()
+{
+    for (int i = 0; i < 3; ++i) {
+        gl_Layer = vLayer[0];
+        gl_Position = gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+// VS_LAYER: the vertex shader selects the cube face, otherwise point_shadow.gs does.
+#ifdef VS_LAYER
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
+#endif
+
+layout (location = 0) in vec3 Position;
+
+// Transformation matrix.
+uniform mat4 worldMatrix;
+// View-projection matrix and cube face of every instance, only the faces with casters.
+uniform mat4 faceViewProj[6];
+uniform int faceLayers[6];
+
+#ifndef VS_LAYER
+flat out int vLayer;
+#endif
+
+void main()
+{
+    gl_Position = faceViewProj[gl_InstanceID] * worldMatrix * vec4(Position, 1.0);
+#ifdef VS_LAYER
+    gl_Layer = faceLayers[gl_InstanceID];
+#else
+    vLayer = faceLayers[gl_InstanceID];
+#endif
+}
@@ -1,17 +1,18 @@
 #version 330 core
 
-layout (location = 0) in vec3 Position;
-layout (location = 1) in vec2 TexCoord;
+layout (location = 0) in vec2 Position;
 
-out vec2 iTexCoord;
+out vec3 iDirection;
 
-uniform mat4 MVP;
+uniform mat4 invViewProj;
 
 
 void main()
 {
-    gl_Position = MVP * vec4(Position, 1.0);
-    
-    // Pass 
-    iTexCoord = TexCoord;
-}
\ No newline at end of file
+    // Put the triangle on the far plane.
+    gl_Position = vec4(Position, 1.0, 1.0);
+
+    // The w of an unprojected far plane point is a positive constant,
+    // so xyz is a direction which interpolates linearly.
+    iDirection = (invViewProj * vec4(Position, 1.0, 1.0)).xyz;
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+// Scene rendered at a lower resolution, upscaled with bilinear filtering.
+uniform sampler2D sceneTexture;
+uniform vec2 outputSize;
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(texture(sceneTexture, gl_FragCoord.xy / outputSize).rgb, 1.0);
+}
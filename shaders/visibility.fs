@@ -0,0 +1,12 @@
+#version 330 core
+
+// Submesh of the draw, and index of the first triangle of the draw in the submesh.
+uniform uint drawId;
+uniform uint firstTriangle;
+
+layout (location = 0) out uvec2 Ids;
+
+void main()
+{
+    Ids = uvec2(drawId, firstTriangle + uint(gl_PrimitiveID));
+}
@@ -0,0 +1,11 @@
+#version 330 core
+
+layout (location = 0) in vec3 Position;
+
+// Transformation matrix.
+uniform mat4 MVP;
+
+void main()
+{
+    gl_Position = MVP * vec4(Position, 1.0);
+}
@@ -0,0 +1,237 @@
+#version 430 core
+
+// Features injected by ShaderPermutations, see PhongFeature and phong_shading_demo.fs.
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 0
+#endif
+
+// Mesh buffers of TriangleMesh, pulled per pixel.
+// A vertex is a VertexPTN: position, normal and texcoord as 8 floats.
+layout (std430, binding = 0) readonly buffer Vertices
+{
+    float vertexData[];
+};
+// Index buffer of the submesh being resolved.
+layout (std430, binding = 1) readonly buffer Indices
+{
+    uint vertexIndices[];
+};
+
+// Visibility buffer.
+uniform usampler2D visibilityIds;
+uniform sampler2D visibilityDepth;
+uniform uint drawId;
+uniform vec2 screenSize;
+
+// Transformation matrix.
+uniform mat4 worldMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 normalMatrix;
+uniform mat4 MVP;
+
+// Material properties.
+uniform vec3 Ka;
+uniform vec3 Kd;
+uniform vec3 Ks;
+uniform float Ns;
+uniform sampler2D mapKd;
+// Light data.
+uniform vec3 dirLightDir;
+uniform vec3 dirLightRadiance;
+uniform vec3 pointLightPos;
+uniform vec3 pointLightIntensity;
+uniform vec3 spotLightPos;
+uniform vec3 spotLightDir;
+uniform vec3 spotLightIntensity;
+uniform float spotLightCutoff;
+uniform float spotLightTotalWidth;
+uniform vec3 ambientLight;
+
+#ifdef USE_SHADOWS
+// Must match ShadowAtlas::kNumCascades.
+#define NUM_SHADOW_CASCADES 3
+// Shadow data, the matrices map view space to the atlas.
+uniform sampler2DShadow shadowAtlas;
+uniform mat4 cascadeShadowMatrices[NUM_SHADOW_CASCADES];
+uniform vec3 cascadeSplits;
+uniform mat4 spotShadowMatrix;
+#endif
+#ifdef USE_POINT_SHADOW
+uniform samplerCubeShadow pointShadowMap;
+// Depth of a distance d along the major axis is x + y / d.
+uniform vec2 pointShadowDepth;
+#endif
+
+out vec4 FragColor;
+
+struct Vertex
+{
+    vec3 position;
+    vec3 normal;
+    vec2 texCoord;
+};
+
+Vertex FetchVertex(uint index)
+{
+    uint base = index * 8u;
+    Vertex v;
+    v.position = vec3(vertexData[base], vertexData[base + 1u], vertexData[base + 2u]);
+    v.normal = vec3(vertexData[base + 3u], vertexData[base + 4u], vertexData[base + 5u]);
+    v.texCoord = vec2(vertexData[base + 6u], vertexData[base + 7u]);
+    return v;
+}
+
+// Perspective correct barycentrics of an NDC position, from the inverse of the
+// matrix whose columns are the (x, y, w) clip coordinates of the vertices.
+// Stays valid when a vertex is behind the camera.
+vec3 Barycentrics(mat3 invClipXYW, vec2 ndc)
+{
+    vec3 b = invClipXYW * vec3(ndc, 1.0);
+    return b / (b.x + b.y + b.z);
+}
+
+vec3 Ambient(vec3 Ka, vec3 I)
+{
+    return Ka * I;
+}
+
+vec3 Diffuse(vec3 texColor, vec3 I, vec3 N, vec3 lightDir)
+{
+    return texColor * I * max(0, dot(N, lightDir));
+}
+
+vec3 Specular(vec3 Ks, vec3 I, vec3 L, vec3 N, vec3 E, float shininess)
+{
+    vec3 H = normalize(L + E);
+    return Ks * I * pow(max(0, dot(N, H)), shininess);
+}
+
+#ifdef USE_SHADOWS
+float Shadow(mat4 shadowMatrix, vec3 P)
+{
+    return textureProj(shadowAtlas, shadowMatrix * vec4(P, 1.0));
+}
+
+float CascadeShadow(vec3 P)
+{
+    float depth = -P.z;
+    for (int i = 0; i < NUM_SHADOW_CASCADES; ++i) {
+        if (depth < cascadeSplits[i]) {
+            return Shadow(cascadeShadowMatrices[i], P);
+        }
+    }
+    // Beyond the shadow distance.
+    return 1.0;
+}
+#endif
+
+#ifdef USE_POINT_SHADOW
+float PointShadow(vec3 lightToPoint)
+{
+    vec3 d = abs(lightToPoint);
+    float depth = pointShadowDepth.x + pointShadowDepth.y / max(d.x, max(d.y, d.z));
+    return texture(pointShadowMap, vec4(lightToPoint, depth));
+}
+#endif
+
+void main()
+{
+    // Only the pixels of this submesh are shaded.
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uvec2 ids = texelFetch(visibilityIds, pixel, 0).xy;
+    if (ids.x != drawId) {
+        discard;
+    }
+    gl_FragDepth = texelFetch(visibilityDepth, pixel, 0).r;
+
+    // Pull the triangle.
+    uint triangle = ids.y;
+    Vertex v0 = FetchVertex(vertexIndices[triangle * 3u]);
+    Vertex v1 = FetchVertex(vertexIndices[triangle * 3u + 1u]);
+    Vertex v2 = FetchVertex(vertexIndices[triangle * 3u + 2u]);
+
+    vec4 c0 = MVP * vec4(v0.position, 1.0);
+    vec4 c1 = MVP * vec4(v1.position, 1.0);
+    vec4 c2 = MVP * vec4(v2.position, 1.0);
+    mat3 invClipXYW = inverse(mat3(c0.xyw, c1.xyw, c2.xyw));
+    vec2 ndc = gl_FragCoord.xy / screenSize * 2.0 - 1.0;
+    vec3 lambda = Barycentrics(invClipXYW, ndc);
+    // Barycentrics of the neighbouring pixels for the texture derivatives.
+    vec3 lambdaX = Barycentrics(invClipXYW, ndc + vec2(2.0 / screenSize.x, 0.0));
+    vec3 lambdaY = Barycentrics(invClipXYW, ndc + vec2(0.0, 2.0 / screenSize.y));
+
+    // Same attributes as phong_shading_demo.vs.
+    vec3 objPosition = mat3(v0.position, v1.position, v2.position) * lambda;
+    vec4 tmpPos = viewMatrix * worldMatrix * vec4(objPosition, 1.0);
+    vec3 fPosition = vec3(tmpPos) / tmpPos.w;
+    vec3 n0 = normalize(vec3(normalMatrix * vec4(v0.normal, 0.0)));
+    vec3 n1 = normalize(vec3(normalMatrix * vec4(v1.normal, 0.0)));
+    vec3 n2 = normalize(vec3(normalMatrix * vec4(v2.normal, 0.0)));
+    vec3 fNormal = mat3(n0, n1, n2) * lambda;
+    mat3x2 texCoords = mat3x2(v0.texCoord, v1.texCoord, v2.texCoord);
+    vec2 fTexCoord = texCoords * lambda;
+
+    // Ambient light.
+    vec3 color = Ambient(Ka, ambientLight);
+
+    // Eye vector, the camera is at the origin of view space.
+    vec3 E = normalize(-fPosition);
+
+    // Texture color.
+#ifdef HAS_MAP_KD
+    vec2 dUVdx = texCoords * lambdaX - fTexCoord;
+    vec2 dUVdy = texCoords * lambdaY - fTexCoord;
+    vec3 texColor = textureGrad(mapKd, fTexCoord, dUVdx, dUVdy).rgb;
+#else
+    vec3 texColor = Kd;
+#endif
+
+    vec3 N = normalize(fNormal);
+
+#ifdef USE_DIR_LIGHT
+    // Directional light.
+    vec3 vDirLightDir = vec3(viewMatrix * vec4(dirLightDir, 0.0));
+    vDirLightDir = normalize(vDirLightDir);
+    vec3 vDirLightRadiance = dirLightRadiance;
+#ifdef USE_SHADOWS
+    vDirLightRadiance *= CascadeShadow(fPosition);
+#endif
+    color += Diffuse(texColor, vDirLightRadiance, N, vDirLightDir);
+    color += Specular(Ks, vDirLightRadiance, vDirLightDir, N, E, Ns);
+#endif
+
+#if NUM_POINT_LIGHTS > 0
+    // Point light.
+    vec3 vPointLightPos = vec3(viewMatrix * vec4(pointLightPos, 1.0));
+    vec3 pointLightDist = vPointLightPos - fPosition;
+    float pointLightDistSqr = dot(pointLightDist, pointLightDist);
+    vec3 vPointLightIntensity = pointLightIntensity / pointLightDistSqr;
+#ifdef USE_POINT_SHADOW
+    // The cube map is in world space, the view matrix only rotates and translates.
+    vPointLightIntensity *= PointShadow(transpose(mat3(viewMatrix)) * -pointLightDist);
+#endif
+    vec3 P = normalize(pointLightDist);
+    color += Diffuse(texColor, vPointLightIntensity, N, P);
+    color += Specular(Ks, vPointLightIntensity, P, N, E, Ns);
+#endif
+
+#ifdef USE_SPOT
+    // Spot light.
+    vec3 vSpotLightPos = vec3(viewMatrix * vec4(spotLightPos, 1.0));
+    vec3 vSpotLightDir = vec3(viewMatrix * vec4(spotLightDir, 0.0));
+    vSpotLightDir = normalize(vSpotLightDir);
+    vec3 spotLightDist = vSpotLightPos - fPosition;
+    float spotLightDistSqr = dot(spotLightDist, spotLightDist);
+    vec3 S = normalize(spotLightDist);
+    float deltaDeg = degrees(acos(dot(S, -vSpotLightDir)));
+    float factor = clamp((spotLightTotalWidth - deltaDeg) / spotLightCutoff, 0, 1);
+    vec3 vSpotLightIntensity = spotLightIntensity * factor / spotLightDistSqr;
+#ifdef USE_SHADOWS
+    vSpotLightIntensity *= Shadow(spotShadowMatrix, fPosition);
+#endif
+    color += Diffuse(texColor, vSpotLightIntensity, N, S);
+    color += Specular(Ks, vSpotLightIntensity, S, N, E, Ns);
+#endif
+
+    FragColor = vec4(color, 1.0);
+}
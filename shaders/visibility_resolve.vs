@@ -0,0 +1,8 @@
+#version 430 core
+
+// Full-screen triangle generated from gl_VertexID, without vertex buffers.
+void main()
+{
+    vec2 uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,66 @@
+#include "AllocationCounters.h"
+
+// C++ STL headers.
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<uint64_t> numAllocations{ 0 };
+}
+
+uint64_t AllocationCounters::GetNumAllocations() {
+	return numAllocations.load(std::memory_order_relaxed);
+}
+
+#ifdef ALLOCATION_COUNTERS
+
+// Desc: The replacements of the global operator new and delete. The nothrow
+// and array forms call these ones by default.
+void* operator new(const std::size_t size) {
+	numAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+	numAllocations.fetch_add(1, std::memory_order_relaxed);
+	// aligned_alloc needs a multiple of the alignment.
+	const std::size_t align = (std::size_t)alignment;
+	const std::size_t rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#ifdef _WIN32
+	void* memory = _aligned_malloc(rounded, align);
+#else
+	void* memory = std::aligned_alloc(align, rounded);
+#endif
+	if (memory != nullptr) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, const std::align_val_t) noexcept {
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void operator delete(void* memory, const std::size_t) noexcept {
+	operator delete(memory);
+}
+
+void operator delete(void* memory, const std::size_t, const std::align_val_t alignment) noexcept {
+	operator delete(memory, alignment);
+}
+
+#endif
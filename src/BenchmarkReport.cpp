@@ -0,0 +1,190 @@
+#include "BenchmarkReport.h"
+
+// C++ STL headers.
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Project headers.
+#include "AllocationCounters.h"
+
+BenchmarkReport::BenchmarkReport(const std::string& name) {
+	this->name = name;
+	numFrames = 0;
+	drawCallSum = 0.0;
+	triangleSum = 0.0;
+	numCountedFrames = 0;
+	allocationSum = 0;
+	maxAllocations = 0;
+	numAllocatingFrames = 0;
+	drawCalls = 0.0;
+	triangles = 0.0;
+}
+
+void BenchmarkReport::AddFrame(const double cpuFrameTime, const double gpuFrameTime, const int numDrawCalls, const int numTriangles) {
+	++numFrames;
+	cpuSamples.push_back(cpuFrameTime);
+	if (gpuFrameTime >= 0.0) {
+		gpuSamples.push_back(gpuFrameTime);
+	}
+	drawCallSum += numDrawCalls;
+	triangleSum += numTriangles;
+}
+
+// Desc: The sums reuse the Counts fields, the GL calls of a run fit easily in them.
+void BenchmarkReport::AddGLCallCounts(const GLCallCounters::Counts& counts) {
+	++numCountedFrames;
+	glCallSum.calls += counts.calls;
+	glCallSum.draws += counts.draws;
+	glCallSum.programSwitches += counts.programSwitches;
+	glCallSum.redundantProgramSwitches += counts.redundantProgramSwitches;
+	glCallSum.bufferBinds += counts.bufferBinds;
+	glCallSum.vertexArrayBinds += counts.vertexArrayBinds;
+	glCallSum.textureBinds += counts.textureBinds;
+	glCallSum.framebufferBinds += counts.framebufferBinds;
+	glCallSum.redundantBinds += counts.redundantBinds;
+	glCallSum.stateChanges += counts.stateChanges;
+	glCallSum.uniformUploads += counts.uniformUploads;
+	glCallSum.bufferBytes += counts.bufferBytes;
+	glCallSum.textureBytes += counts.textureBytes;
+}
+
+void BenchmarkReport::AddAllocations(const uint64_t numAllocations) {
+	allocationSum += numAllocations;
+	maxAllocations = std::max(maxAllocations, numAllocations);
+	if (numAllocations > 0) {
+		++numAllocatingFrames;
+	}
+}
+
+void BenchmarkReport::Summarize() {
+	cpuFrameTime = ComputePercentiles(cpuSamples);
+	gpuFrameTime = ComputePercentiles(gpuSamples);
+	drawCalls = numFrames > 0 ? drawCallSum / numFrames : 0.0;
+	triangles = numFrames > 0 ? triangleSum / numFrames : 0.0;
+}
+
+bool BenchmarkReport::WriteJson(const std::filesystem::path& filePath) const {
+	std::ofstream fout(filePath);
+	if (!fout) {
+		std::cerr << "[ERROR] Cannot write benchmark report " << filePath << std::endl;
+		return false;
+	}
+	auto writePercentiles = [&fout](const Percentiles& p) {
+		fout << "{ \"p50\": " << p.p50 << ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 << " }";
+	};
+	fout << "{\n";
+	fout << "  \"name\": \"" << name << "\",\n";
+	fout << "  \"frames\": " << numFrames << ",\n";
+	fout << "  \"cpu_ms\": ";
+	writePercentiles(cpuFrameTime);
+	fout << ",\n  \"gpu_ms\": ";
+	writePercentiles(gpuFrameTime);
+	fout << ",\n  \"draw_calls\": " << drawCalls << ",\n";
+	fout << "  \"triangles\": " << triangles;
+	if (GLCallCounters::IsEnabled() && numCountedFrames > 0) {
+		// Averages per frame.
+		const double n = numCountedFrames;
+		fout << ",\n  \"gl_calls\": { \"calls\": " << glCallSum.calls / n
+			<< ", \"draws\": " << glCallSum.draws / n
+			<< ", \"program_switches\": " << glCallSum.programSwitches / n
+			<< ", \"redundant_program_switches\": " << glCallSum.redundantProgramSwitches / n
+			<< ", \"buffer_binds\": " << glCallSum.bufferBinds / n
+			<< ", \"vertex_array_binds\": " << glCallSum.vertexArrayBinds / n
+			<< ", \"texture_binds\": " << glCallSum.textureBinds / n
+			<< ", \"framebuffer_binds\": " << glCallSum.framebufferBinds / n
+			<< ", \"redundant_binds\": " << glCallSum.redundantBinds / n
+			<< ", \"state_changes\": " << glCallSum.stateChanges / n
+			<< ", \"uniform_uploads\": " << glCallSum.uniformUploads / n
+			<< ", \"buffer_bytes\": " << glCallSum.bufferBytes / n
+			<< ", \"texture_bytes\": " << glCallSum.textureBytes / n << " }";
+	}
+	if (AllocationCounters::IsEnabled() && numFrames > 0) {
+		fout << ",\n  \"allocations\": { \"per_frame\": " << (double)allocationSum / numFrames
+			<< ", \"max\": " << maxAllocations
+			<< ", \"allocating_frames\": " << numAllocatingFrames << " }";
+	}
+	fout << "\n}\n";
+	return true;
+}
+
+// Desc: Only reads the files written by WriteJson: every number is looked up
+// by its key, the percentiles after the key of their object.
+bool BenchmarkReport::LoadJson(const std::filesystem::path& filePath) {
+	std::ifstream fin(filePath);
+	if (!fin) {
+		std::cerr << "[ERROR] Cannot open benchmark baseline " << filePath << std::endl;
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << fin.rdbuf();
+	const std::string json = buffer.str();
+
+	auto readNumber = [&json](const std::string& key, size_t from, double& value) {
+		size_t pos = json.find("\"" + key + "\"", from);
+		if (pos == std::string::npos || (pos = json.find(':', pos)) == std::string::npos) {
+			return false;
+		}
+		value = std::strtod(json.c_str() + pos + 1, nullptr);
+		return true;
+	};
+	auto readPercentiles = [&json, &readNumber](const std::string& key, Percentiles& p) {
+		size_t pos = json.find("\"" + key + "\"");
+		return pos != std::string::npos
+			&& readNumber("p50", pos, p.p50) && readNumber("p95", pos, p.p95) && readNumber("p99", pos, p.p99);
+	};
+	double frames = 0.0;
+	if (!readNumber("frames", 0, frames) || !readPercentiles("cpu_ms", cpuFrameTime) || !readPercentiles("gpu_ms", gpuFrameTime)
+		|| !readNumber("draw_calls", 0, drawCalls) || !readNumber("triangles", 0, triangles)) {
+		std::cerr << "[ERROR] Invalid benchmark baseline " << filePath << std::endl;
+		return false;
+	}
+	numFrames = (int)frames;
+	return true;
+}
+
+int BenchmarkReport::CountRegressions(const BenchmarkReport& baseline, const double threshold) const {
+	int numRegressions = 0;
+	auto check = [&numRegressions, threshold](const char* metric, const double value, const double baselineValue) {
+		// Metrics missing from either run are not compared.
+		if (value < 0.0 || baselineValue <= 0.0) {
+			return;
+		}
+		const double ratio = value / baselineValue;
+		const bool regressed = ratio > 1.0 + threshold;
+		std::cout << "[Benchmark] " << metric << ": " << value << " vs " << baselineValue
+			<< " (" << (ratio - 1.0) * 100.0 << "%)" << (regressed ? "  REGRESSION" : "") << std::endl;
+		if (regressed) {
+			++numRegressions;
+		}
+	};
+	check("CPU p50 ms", cpuFrameTime.p50, baseline.cpuFrameTime.p50);
+	check("CPU p95 ms", cpuFrameTime.p95, baseline.cpuFrameTime.p95);
+	check("CPU p99 ms", cpuFrameTime.p99, baseline.cpuFrameTime.p99);
+	check("GPU p50 ms", gpuFrameTime.p50, baseline.gpuFrameTime.p50);
+	check("GPU p95 ms", gpuFrameTime.p95, baseline.gpuFrameTime.p95);
+	check("GPU p99 ms", gpuFrameTime.p99, baseline.gpuFrameTime.p99);
+	check("Draw calls", drawCalls, baseline.drawCalls);
+	check("Triangles", triangles, baseline.triangles);
+	return numRegressions;
+}
+
+// Desc: Nearest-rank percentiles.
+BenchmarkReport::Percentiles BenchmarkReport::ComputePercentiles(std::vector<double> samples) {
+	Percentiles p;
+	if (samples.empty()) {
+		return p;
+	}
+	std::sort(samples.begin(), samples.end());
+	auto rank = [&samples](const double q) {
+		size_t index = (size_t)std::max(0.0, std::ceil(q * samples.size()) - 1.0);
+		return samples[std::min(index, samples.size() - 1)];
+	};
+	p.p50 = rank(0.50);
+	p.p95 = rank(0.95);
+	p.p99 = rank(0.99);
+	return p;
+}
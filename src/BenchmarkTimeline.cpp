@@ -0,0 +1,112 @@
+#include "BenchmarkTimeline.h"
+
+// C++ STL headers.
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+BenchmarkTimeline::BenchmarkTimeline() {
+	timeStep = 1.0 / 60.0;
+	numWarmupFrames = 60;
+	numMeasuredFrames = 600;
+}
+
+bool BenchmarkTimeline::LoadFromFile(const std::filesystem::path& filePath) {
+	std::ifstream fin(filePath);
+	if (!fin) {
+		std::cerr << "[ERROR] Cannot open benchmark timeline " << filePath << std::endl;
+		return false;
+	}
+	name = filePath.stem().string();
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(fin, line)) {
+		++lineNumber;
+		line = line.substr(0, line.find('#'));
+		std::istringstream iss(line);
+		std::string command;
+		if (!(iss >> command)) {
+			continue;
+		}
+
+		bool ok = true;
+		if (command == "model") {
+			ok = (bool)(iss >> model);
+		}
+		else if (command == "skybox") {
+			ok = (bool)(iss >> skybox);
+		}
+		else if (command == "timestep") {
+			ok = (bool)(iss >> timeStep) && timeStep > 0.0;
+		}
+		else if (command == "warmup") {
+			ok = (bool)(iss >> numWarmupFrames) && numWarmupFrames >= 0;
+		}
+		else if (command == "frames") {
+			ok = (bool)(iss >> numMeasuredFrames) && numMeasuredFrames > 0;
+		}
+		else if (command == "camera") {
+			Key key;
+			ok = (bool)(iss >> key.time >> key.a.x >> key.a.y >> key.a.z >> key.b.x >> key.b.y >> key.b.z);
+			cameraKeys.push_back(key);
+		}
+		else if (command == "pointlight" || command == "spotlight") {
+			Key key;
+			key.b = glm::vec3(0.0f);
+			ok = (bool)(iss >> key.time >> key.a.x >> key.a.y >> key.a.z);
+			(command == "pointlight" ? pointLightKeys : spotLightKeys).push_back(key);
+		}
+		else {
+			ok = false;
+		}
+		if (!ok) {
+			std::cerr << "[ERROR] " << filePath << ":" << lineNumber << ": cannot parse \"" << line << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	auto byTime = [](const Key& lhs, const Key& rhs) { return lhs.time < rhs.time; };
+	std::stable_sort(cameraKeys.begin(), cameraKeys.end(), byTime);
+	std::stable_sort(pointLightKeys.begin(), pointLightKeys.end(), byTime);
+	std::stable_sort(spotLightKeys.begin(), spotLightKeys.end(), byTime);
+	return true;
+}
+
+bool BenchmarkTimeline::SampleCamera(const double time, glm::vec3& eye, glm::vec3& target) const {
+	return Sample(cameraKeys, time, eye, target);
+}
+
+bool BenchmarkTimeline::SamplePointLight(const double time, glm::vec3& position) const {
+	glm::vec3 unused;
+	return Sample(pointLightKeys, time, position, unused);
+}
+
+bool BenchmarkTimeline::SampleSpotLight(const double time, glm::vec3& position) const {
+	glm::vec3 unused;
+	return Sample(spotLightKeys, time, position, unused);
+}
+
+bool BenchmarkTimeline::Sample(const std::vector<Key>& keys, const double time, glm::vec3& a, glm::vec3& b) {
+	if (keys.empty()) {
+		return false;
+	}
+	auto next = std::upper_bound(keys.begin(), keys.end(), time,
+		[](const double t, const Key& key) { return t < key.time; });
+	if (next == keys.begin()) {
+		a = keys.front().a;
+		b = keys.front().b;
+	}
+	else if (next == keys.end()) {
+		a = keys.back().a;
+		b = keys.back().b;
+	}
+	else {
+		const Key& prev = *(next - 1);
+		const float t = (float)((time - prev.time) / (next->time - prev.time));
+		a = glm::mix(prev.a, next->a, t);
+		b = glm::mix(prev.b, next->b, t);
+	}
+	return true;
+}
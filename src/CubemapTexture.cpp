@@ -0,0 +1,156 @@
+#include "CubemapTexture.h"
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "GLCallCounters.h"
+#include "TraceRecorder.h"
+
+CubemapTexture::CubemapTexture(const std::filesystem::path& panoramaPath)
+	: texFilePath(panoramaPath)
+{
+	textureObj = 0;
+	faceSize = 0;
+	numChannels = 0;
+
+	auto image = DecodePanorama(panoramaPath);
+	if (image != nullptr) {
+		Upload(*image);
+	}
+}
+
+CubemapTexture::CubemapTexture(const CubemapImage& image)
+	: texFilePath(image.texFilePath)
+{
+	textureObj = 0;
+	faceSize = 0;
+	numChannels = 0;
+
+	Upload(image);
+}
+
+CubemapTexture::~CubemapTexture()
+{
+	glDeleteTextures(1, &textureObj);
+}
+
+void CubemapTexture::Bind(GLenum textureUnit)
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureObj);
+}
+
+size_t CubemapTexture::GetSizeInBytes() const
+{
+	// The mip chain adds a third of the base level.
+	return (size_t)6 * faceSize * faceSize * numChannels * 4 / 3;
+}
+
+std::shared_ptr<CubemapImage> CubemapTexture::DecodePanorama(const std::filesystem::path& panoramaPath)
+{
+	TraceScope trace("DecodePanorama");
+	// Try to load panorama image.
+	cv::Mat panorama = cv::imread(panoramaPath.string());
+	if (panorama.rows == 0 || panorama.cols == 0) {
+		std::cerr << "[ERROR] Failed to load panorama: " << panoramaPath << std::endl;
+		return nullptr;
+	}
+
+	// A face covers 90 degrees of the 360 degrees panorama width.
+	auto image = std::make_shared<CubemapImage>();
+	image->texFilePath = panoramaPath;
+	image->faceSize = panorama.cols / 4;
+	image->numChannels = panorama.channels();
+	ConvertPanorama(panorama, image->faceSize, image->faces);
+	return image;
+}
+
+void CubemapTexture::Upload(const CubemapImage& image)
+{
+	GLenum format = GL_BGR;
+	GLint internalFormat = GL_RGB;
+	switch (image.numChannels) {
+	case 1:
+		format = GL_RED;
+		internalFormat = GL_RED;
+		break;
+	case 3:
+		break;
+	case 4:
+		format = GL_BGRA;
+		internalFormat = GL_RGBA;
+		break;
+	default:
+		std::cerr << "[ERROR] Unsupport texture format" << std::endl;
+		return;
+	}
+	faceSize = image.faceSize;
+	numChannels = image.numChannels;
+
+	glGenTextures(1, &textureObj);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureObj);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < 6; ++i) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internalFormat, faceSize, faceSize,
+						0, format, GL_UNSIGNED_BYTE, image.faces[i].ptr());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	// Generate mipmaps.
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+// Desc: Build a remap table per face from the GL cube map direction of each texel to the
+// panorama pixel seen in that direction, and let cv::remap (vectorized) do the resampling.
+void CubemapTexture::ConvertPanorama(const cv::Mat& panorama, const int faceSize, cv::Mat faces[6])
+{
+	const float width = (float)panorama.cols;
+	const float height = (float)panorama.rows;
+	cv::Mat mapX(faceSize, faceSize, CV_32FC1);
+	cv::Mat mapY(faceSize, faceSize, CV_32FC1);
+
+	for (int face = 0; face < 6; ++face) {
+		for (int j = 0; j < faceSize; ++j) {
+			float* rowX = mapX.ptr<float>(j);
+			float* rowY = mapY.ptr<float>(j);
+			// Row 0 of an uploaded face is t = 0.
+			float tc = 2.0f * ((float)j + 0.5f) / (float)faceSize - 1.0f;
+			for (int i = 0; i < faceSize; ++i) {
+				float sc = 2.0f * ((float)i + 0.5f) / (float)faceSize - 1.0f;
+				glm::vec3 dir;
+				switch (face) {
+				case 0: dir = glm::vec3(1.0f, -tc, -sc); break;		// +X
+				case 1: dir = glm::vec3(-1.0f, -tc, sc); break;		// -X
+				case 2: dir = glm::vec3(sc, 1.0f, tc); break;		// +Y
+				case 3: dir = glm::vec3(sc, -1.0f, -tc); break;		// -Y
+				case 4: dir = glm::vec3(sc, -tc, 1.0f); break;		// +Z
+				default: dir = glm::vec3(-sc, -tc, -1.0f); break;	// -Z
+				}
+				dir = glm::normalize(dir);
+
+				// Same parameterization as the former skybox sphere:
+				// u follows phi = atan2(z, x), v goes from +Y (top row) to -Y.
+				float phi = std::atan2(dir.z, dir.x);
+				if (phi < 0.0f) {
+					phi += 2.0f * glm::pi<float>();
+				}
+				float theta = std::asin(glm::clamp(dir.y, -1.0f, 1.0f));
+				float u = phi / (2.0f * glm::pi<float>());
+				float v = (0.5f * glm::pi<float>() - theta) / glm::pi<float>();
+				rowX[i] = u * width - 0.5f;
+				rowY[i] = v * height - 0.5f;
+			}
+		}
+		cv::remap(panorama, faces[face], mapX, mapY, cv::INTER_LINEAR, cv::BORDER_WRAP);
+	}
+}
@@ -0,0 +1,231 @@
+#include "DeferredRenderer.h"
+
+// GLM headers.
+#include <glm/gtc/type_ptr.hpp>
+
+// C++ STL headers.
+#include <algorithm>
+#include <iostream>
+
+// Project headers.
+#include "GLCallCounters.h"
+
+// Formats of the color targets, see the layout in DeferredRenderer.h. Every one
+// of them is required to be color-renderable, unlike the snorm formats.
+static const GLenum kColorFormats[4] = { GL_RGBA8, GL_RGBA8, GL_RG16, GL_RGB10_A2 };
+static const GLenum kColorPixelFormats[4] = { GL_RGBA, GL_RGBA, GL_RG, GL_RGBA };
+
+DeferredRenderer::DeferredRenderer(const int width, const int height) {
+	this->width = width;
+	this->height = height;
+	fboId = 0;
+	prevFboId = 0;
+	depthTexId = 0;
+	for (int i = 0; i < kNumColorTargets; ++i) {
+		colorTexIds[i] = 0;
+	}
+	CreateTargets();
+
+	// Create a triangle covering the whole screen in clip space.
+	const glm::vec2 triangle[3] = {
+		glm::vec2(-1.0f, -1.0f),
+		glm::vec2(3.0f, -1.0f),
+		glm::vec2(-1.0f, 3.0f)
+	};
+	glGenBuffers(1, &triangleVboId);
+	glBindBuffer(GL_ARRAY_BUFFER, triangleVboId);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STATIC_DRAW);
+
+	// Create the [-1, 1]^3 box with counter-clockwise faces seen from outside.
+	std::vector<glm::vec3> boxVertices;
+	for (int i = 0; i < 8; ++i) {
+		boxVertices.push_back(glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f));
+	}
+	std::vector<unsigned int> boxIndices;
+	for (int axis = 0; axis < 3; ++axis) {
+		for (int side = 0; side < 2; ++side) {
+			// Corners of the face in cyclic order.
+			const int u = 1 << ((axis + 1) % 3);
+			const int v = 1 << ((axis + 2) % 3);
+			const int base = side ? (1 << axis) : 0;
+			unsigned int quad[4] = { (unsigned int)base, (unsigned int)(base | u), (unsigned int)(base | u | v), (unsigned int)(base | v) };
+			glm::vec3 normal = glm::vec3(0.0f, 0.0f, 0.0f);
+			normal[axis] = side ? 1.0f : -1.0f;
+			const glm::vec3 faceNormal = glm::cross(boxVertices[quad[1]] - boxVertices[quad[0]], boxVertices[quad[2]] - boxVertices[quad[0]]);
+			if (glm::dot(faceNormal, normal) < 0.0f) {
+				std::swap(quad[1], quad[3]);
+			}
+			boxIndices.insert(boxIndices.end(), { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] });
+		}
+	}
+	numBoxIndices = (int)boxIndices.size();
+	glGenBuffers(1, &boxVboId);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVboId);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * boxVertices.size(), boxVertices.data(), GL_STATIC_DRAW);
+	glGenBuffers(1, &boxIboId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxIboId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * boxIndices.size(), boxIndices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &lightVboId);
+}
+
+DeferredRenderer::~DeferredRenderer() {
+	ReleaseTargets();
+	glDeleteBuffers(1, &triangleVboId);
+	glDeleteBuffers(1, &boxVboId);
+	glDeleteBuffers(1, &boxIboId);
+	glDeleteBuffers(1, &lightVboId);
+}
+
+void DeferredRenderer::Resize(const int width, const int height) {
+	if (width == this->width && height == this->height) {
+		return;
+	}
+	this->width = width;
+	this->height = height;
+	ReleaseTargets();
+	CreateTargets();
+}
+
+void DeferredRenderer::CreateTargets() {
+	glGenFramebuffers(1, &fboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+	glGenTextures(kNumColorTargets, colorTexIds);
+	GLenum drawBuffers[kNumColorTargets];
+	for (int i = 0; i < kNumColorTargets; ++i) {
+		glBindTexture(GL_TEXTURE_2D, colorTexIds[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, kColorFormats[i], width, height, 0, kColorPixelFormats[i], GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorTexIds[i], 0);
+		drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	glDrawBuffers(kNumColorTargets, drawBuffers);
+
+	glGenTextures(1, &depthTexId);
+	glBindTexture(GL_TEXTURE_2D, depthTexId);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexId, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "[ERROR] G-buffer framebuffer is incomplete" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::ReleaseTargets() {
+	glDeleteFramebuffers(1, &fboId);
+	glDeleteTextures(kNumColorTargets, colorTexIds);
+	glDeleteTextures(1, &depthTexId);
+	fboId = 0;
+	depthTexId = 0;
+	for (int i = 0; i < kNumColorTargets; ++i) {
+		colorTexIds[i] = 0;
+	}
+}
+
+// Desc: The colors of pixels without geometry are never read, so only the depth is cleared.
+void DeferredRenderer::BeginGeometryPass() {
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::EndGeometryPass() {
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
+
+void DeferredRenderer::RenderLighting(
+	const std::shared_ptr<Camera>& camera,
+	const std::shared_ptr<DirectionalLight>& dirLight,
+	const std::vector<LightClusterGrid::Light>& lights,
+	const std::shared_ptr<DeferredLightingShaderProg>& directionalShader,
+	const std::shared_ptr<DeferredLightingShaderProg>& lightShader
+) {
+	const glm::mat4& P = camera->GetProjMatrix();
+	const glm::mat4 invP = glm::inverse(P);
+
+	// Ambient and directional light, writing the depth of the G-buffer.
+	glm::vec3 dirLightDir = glm::vec3(0.0f, 0.0f, 1.0f);
+	glm::vec3 dirLightRadiance = glm::vec3(0.0f, 0.0f, 0.0f);
+	if (dirLight != nullptr) {
+		dirLightDir = glm::normalize(glm::vec3(camera->GetViewMatrix() * glm::vec4(dirLight->GetDirection(), 0.0f)));
+		dirLightRadiance = dirLight->GetRadiance();
+	}
+	glDepthFunc(GL_ALWAYS);
+	directionalShader->Bind();
+	BindGBuffer(directionalShader);
+	glUniformMatrix4fv(directionalShader->GetLocInvP(), 1, GL_FALSE, glm::value_ptr(invP));
+	glUniform3fv(directionalShader->GetLocDirLightDir(), 1, glm::value_ptr(dirLightDir));
+	glUniform3fv(directionalShader->GetLocDirLightRadiance(), 1, glm::value_ptr(dirLightRadiance));
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, triangleVboId);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), 0);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDisableVertexAttribArray(0);
+	directionalShader->Unbind();
+	glDepthFunc(GL_LESS);
+
+	if (lights.empty()) {
+		return;
+	}
+
+	// Point and spot lights, added by the back faces of their boxes so that every
+	// covered pixel is shaded once per light, even with the camera inside a box.
+	glBindBuffer(GL_ARRAY_BUFFER, lightVboId);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(LightClusterGrid::Light) * lights.size(), lights.data(), GL_STREAM_DRAW);
+
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glCullFace(GL_FRONT);
+
+	lightShader->Bind();
+	BindGBuffer(lightShader);
+	glUniformMatrix4fv(lightShader->GetLocP(), 1, GL_FALSE, glm::value_ptr(P));
+	glUniformMatrix4fv(lightShader->GetLocInvP(), 1, GL_FALSE, glm::value_ptr(invP));
+
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVboId);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+	glBindBuffer(GL_ARRAY_BUFFER, lightVboId);
+	for (int i = 0; i < 4; ++i) {
+		glEnableVertexAttribArray(1 + i);
+		glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(LightClusterGrid::Light), (void*)(i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(1 + i, 1);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxIboId);
+	glDrawElementsInstanced(GL_TRIANGLES, numBoxIndices, GL_UNSIGNED_INT, 0, (GLsizei)lights.size());
+	// The other passes use the same attribute slots without instancing.
+	for (int i = 0; i < 4; ++i) {
+		glVertexAttribDivisor(1 + i, 0);
+		glDisableVertexAttribArray(1 + i);
+	}
+	glDisableVertexAttribArray(0);
+	lightShader->Unbind();
+
+	glCullFace(GL_BACK);
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void DeferredRenderer::BindGBuffer(const std::shared_ptr<DeferredLightingShaderProg>& shader) const {
+	const GLint locs[kNumColorTargets] = {
+		shader->GetLocAlbedoNs(), shader->GetLocSpecular(), shader->GetLocNormal(), shader->GetLocAmbient()
+	};
+	for (int i = 0; i < kNumColorTargets; ++i) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, colorTexIds[i]);
+		glUniform1i(locs[i], i);
+	}
+	glActiveTexture(GL_TEXTURE0 + kNumColorTargets);
+	glBindTexture(GL_TEXTURE_2D, depthTexId);
+	glUniform1i(shader->GetLocDepth(), kNumColorTargets);
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,72 @@
+#include "FrameArena.h"
+
+// C++ STL headers.
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <new>
+
+FrameArena::FrameArena(const size_t capacity) {
+	this->capacity = std::max(capacity, kBlockAlignment);
+	block = static_cast<char*>(::operator new(this->capacity, std::align_val_t(kBlockAlignment)));
+	offset = 0;
+	overflowBytes = 0;
+	numOverflows = 0;
+}
+
+FrameArena::~FrameArena() {
+	Reset();
+	::operator delete(block, std::align_val_t(kBlockAlignment));
+}
+
+// Desc: After a frame overflowed, the block grows to hold the whole frame, so
+// that the same frame fits the next time.
+void FrameArena::Reset() {
+	const size_t usedBytes = GetUsedBytes();
+	for (const auto& overflow : overflows) {
+		::operator delete(overflow.memory, std::align_val_t(overflow.alignment));
+	}
+	overflows.clear();
+	if (overflowBytes > 0) {
+		::operator delete(block, std::align_val_t(kBlockAlignment));
+		capacity = std::max(2 * capacity, usedBytes + usedBytes / 2);
+		block = static_cast<char*>(::operator new(capacity, std::align_val_t(kBlockAlignment)));
+		overflowBytes = 0;
+	}
+	offset.store(0, std::memory_order_relaxed);
+}
+
+// Desc: Reserve the worst case padding along with the size, so that one
+// fetch_add claims an aligned range whatever the other threads take.
+void* FrameArena::Allocate(const size_t size, const size_t alignment) {
+	const size_t begin = offset.fetch_add(size + alignment - 1, std::memory_order_relaxed);
+	const size_t aligned = (begin + alignment - 1) & ~(alignment - 1);
+	if (aligned + size <= capacity && alignment <= kBlockAlignment) {
+		return block + aligned;
+	}
+
+	const size_t overflowAlignment = std::max(alignment, alignof(std::max_align_t));
+	void* memory = ::operator new(std::max<size_t>(size, 1), std::align_val_t(overflowAlignment));
+	std::lock_guard<std::mutex> lock(overflowMutex);
+	overflows.push_back({ memory, overflowAlignment });
+	overflowBytes += size;
+	++numOverflows;
+	return memory;
+}
+
+const char* FrameArena::Format(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	const int length = std::max(0, std::vsnprintf(nullptr, 0, format, argsCopy));
+	va_end(argsCopy);
+	char* text = AllocateArray<char>((size_t)length + 1);
+	std::vsnprintf(text, (size_t)length + 1, format, args);
+	va_end(args);
+	return text;
+}
+
+size_t FrameArena::GetUsedBytes() const {
+	return std::min(offset.load(std::memory_order_relaxed), capacity) + overflowBytes;
+}
@@ -0,0 +1,489 @@
+// The wrappers call the GL 1.1 entry points themselves.
+#define GL_CALL_COUNTERS_IMPLEMENTATION
+#include "GLCallCounters.h"
+
+namespace
+{
+	GLCallCounters::Counts current;
+	GLCallCounters::Counts last;
+
+	// Objects bound by the wrapped calls, to detect redundant binds. Deleting
+	// an object unbinds it behind the wrappers' back, so deletes forget them.
+	constexpr GLuint kUnknown = ~0u;
+	constexpr int kMaxTextureUnits = 32;
+	enum BufferTarget { kArrayBuffer, kElementArrayBuffer, kUniformBuffer, kShaderStorageBuffer, kDrawIndirectBuffer, kNumBufferTargets };
+	enum TextureTarget { kTexture2D, kTextureCubeMap, kTexture2DArray, kNumTextureTargets };
+	GLuint boundProgram = kUnknown;
+	GLuint boundVertexArray = kUnknown;
+	GLuint boundDrawFramebuffer = kUnknown;
+	GLuint boundReadFramebuffer = kUnknown;
+	GLuint boundBuffers[kNumBufferTargets];
+	GLuint boundTextures[kMaxTextureUnits][kNumTextureTargets];
+	int activeTextureUnit = 0;
+
+	void ForgetBindings() {
+		boundProgram = kUnknown;
+		boundVertexArray = kUnknown;
+		boundDrawFramebuffer = kUnknown;
+		boundReadFramebuffer = kUnknown;
+		for (auto& buffer : boundBuffers) {
+			buffer = kUnknown;
+		}
+		for (auto& unit : boundTextures) {
+			for (auto& texture : unit) {
+				texture = kUnknown;
+			}
+		}
+	}
+
+	int GetBufferTarget(const GLenum target) {
+		switch (target) {
+		case GL_ARRAY_BUFFER: return kArrayBuffer;
+		case GL_ELEMENT_ARRAY_BUFFER: return kElementArrayBuffer;
+		case GL_UNIFORM_BUFFER: return kUniformBuffer;
+		case GL_SHADER_STORAGE_BUFFER: return kShaderStorageBuffer;
+		case GL_DRAW_INDIRECT_BUFFER: return kDrawIndirectBuffer;
+		default: return -1;
+		}
+	}
+
+	int GetTextureTarget(const GLenum target) {
+		switch (target) {
+		case GL_TEXTURE_2D: return kTexture2D;
+		case GL_TEXTURE_CUBE_MAP: return kTextureCubeMap;
+		case GL_TEXTURE_2D_ARRAY: return kTexture2DArray;
+		default: return -1;
+		}
+	}
+
+	// Record a bind, and whether the object was already bound.
+	void CountBind(GLuint& bound, const GLuint object) {
+		if (bound == object) {
+			++current.redundantBinds;
+		}
+		bound = object;
+	}
+
+	// Size of the client pixels of an upload, ignoring the unpack row alignment.
+	int64_t GetImageBytes(const GLsizei width, const GLsizei height, const GLsizei depth, const GLenum format, const GLenum type) {
+		int64_t numComponents = 4;
+		switch (format) {
+		case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_ALPHA: case GL_LUMINANCE:
+			numComponents = 1;
+			break;
+		case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL: case GL_LUMINANCE_ALPHA:
+			numComponents = 2;
+			break;
+		case GL_RGB: case GL_BGR: case GL_RGB_INTEGER:
+			numComponents = 3;
+			break;
+		}
+		int64_t pixelBytes = numComponents;
+		switch (type) {
+		case GL_UNSIGNED_BYTE: case GL_BYTE:
+			break;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+			pixelBytes *= 2;
+			break;
+		case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+			pixelBytes *= 4;
+			break;
+		default:
+			// Packed types hold a whole pixel, e.g. GL_UNSIGNED_INT_24_8.
+			pixelBytes = 4;
+			break;
+		}
+		return pixelBytes * width * height * depth;
+	}
+
+#ifdef GL_CALL_COUNTERS
+	// Entry points loaded by GLEW, wrapped by Install.
+	decltype(__glewUseProgram) realUseProgram;
+	decltype(__glewBindBuffer) realBindBuffer;
+	decltype(__glewBindBufferBase) realBindBufferBase;
+	decltype(__glewBindBufferRange) realBindBufferRange;
+	decltype(__glewBindVertexArray) realBindVertexArray;
+	decltype(__glewBindFramebuffer) realBindFramebuffer;
+	decltype(__glewActiveTexture) realActiveTexture;
+	decltype(__glewDeleteBuffers) realDeleteBuffers;
+	decltype(__glewDeleteVertexArrays) realDeleteVertexArrays;
+	decltype(__glewDeleteFramebuffers) realDeleteFramebuffers;
+	decltype(__glewDeleteProgram) realDeleteProgram;
+	decltype(__glewBufferData) realBufferData;
+	decltype(__glewBufferSubData) realBufferSubData;
+	decltype(__glewTexImage3D) realTexImage3D;
+	decltype(__glewDrawArraysInstanced) realDrawArraysInstanced;
+	decltype(__glewDrawElementsInstanced) realDrawElementsInstanced;
+	decltype(__glewMultiDrawElements) realMultiDrawElements;
+	decltype(__glewMultiDrawElementsIndirect) realMultiDrawElementsIndirect;
+	decltype(__glewUniform1i) realUniform1i;
+	decltype(__glewUniform1iv) realUniform1iv;
+	decltype(__glewUniform1ui) realUniform1ui;
+	decltype(__glewUniform1f) realUniform1f;
+	decltype(__glewUniform2f) realUniform2f;
+	decltype(__glewUniform2fv) realUniform2fv;
+	decltype(__glewUniform3fv) realUniform3fv;
+	decltype(__glewUniform4fv) realUniform4fv;
+	decltype(__glewUniformMatrix3fv) realUniformMatrix3fv;
+	decltype(__glewUniformMatrix4fv) realUniformMatrix4fv;
+
+	void GLAPIENTRY CountedUseProgram(GLuint program) {
+		++current.calls;
+		if (program == boundProgram) {
+			++current.redundantProgramSwitches;
+		}
+		else {
+			++current.programSwitches;
+		}
+		boundProgram = program;
+		realUseProgram(program);
+	}
+
+	void GLAPIENTRY CountedBindBuffer(GLenum target, GLuint buffer) {
+		++current.calls;
+		++current.bufferBinds;
+		const int index = GetBufferTarget(target);
+		if (index >= 0) {
+			CountBind(boundBuffers[index], buffer);
+		}
+		realBindBuffer(target, buffer);
+	}
+
+	// The indexed binds also replace the generic binding of the target.
+	void GLAPIENTRY CountedBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+		++current.calls;
+		++current.bufferBinds;
+		const int bufferTarget = GetBufferTarget(target);
+		if (bufferTarget >= 0) {
+			boundBuffers[bufferTarget] = buffer;
+		}
+		realBindBufferBase(target, index, buffer);
+	}
+
+	void GLAPIENTRY CountedBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+		++current.calls;
+		++current.bufferBinds;
+		const int bufferTarget = GetBufferTarget(target);
+		if (bufferTarget >= 0) {
+			boundBuffers[bufferTarget] = buffer;
+		}
+		realBindBufferRange(target, index, buffer, offset, size);
+	}
+
+	// The element array binding belongs to the vertex array.
+	void GLAPIENTRY CountedBindVertexArray(GLuint array) {
+		++current.calls;
+		++current.vertexArrayBinds;
+		if (array != boundVertexArray) {
+			boundBuffers[kElementArrayBuffer] = kUnknown;
+		}
+		CountBind(boundVertexArray, array);
+		realBindVertexArray(array);
+	}
+
+	void GLAPIENTRY CountedBindFramebuffer(GLenum target, GLuint framebuffer) {
+		++current.calls;
+		++current.framebufferBinds;
+		if (target == GL_READ_FRAMEBUFFER) {
+			CountBind(boundReadFramebuffer, framebuffer);
+		}
+		else if (target == GL_DRAW_FRAMEBUFFER) {
+			CountBind(boundDrawFramebuffer, framebuffer);
+		}
+		else {
+			if (boundDrawFramebuffer == framebuffer && boundReadFramebuffer == framebuffer) {
+				++current.redundantBinds;
+			}
+			boundDrawFramebuffer = framebuffer;
+			boundReadFramebuffer = framebuffer;
+		}
+		realBindFramebuffer(target, framebuffer);
+	}
+
+	void GLAPIENTRY CountedActiveTexture(GLenum texture) {
+		++current.calls;
+		++current.stateChanges;
+		activeTextureUnit = (int)(texture - GL_TEXTURE0);
+		realActiveTexture(texture);
+	}
+
+	void GLAPIENTRY CountedDeleteBuffers(GLsizei n, const GLuint* buffers) {
+		++current.calls;
+		ForgetBindings();
+		realDeleteBuffers(n, buffers);
+	}
+
+	void GLAPIENTRY CountedDeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+		++current.calls;
+		ForgetBindings();
+		realDeleteVertexArrays(n, arrays);
+	}
+
+	void GLAPIENTRY CountedDeleteFramebuffers(GLsizei n, const GLuint* framebuffers) {
+		++current.calls;
+		ForgetBindings();
+		realDeleteFramebuffers(n, framebuffers);
+	}
+
+	void GLAPIENTRY CountedDeleteProgram(GLuint program) {
+		++current.calls;
+		ForgetBindings();
+		realDeleteProgram(program);
+	}
+
+	void GLAPIENTRY CountedBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+		++current.calls;
+		if (data != nullptr) {
+			current.bufferBytes += size;
+		}
+		realBufferData(target, size, data, usage);
+	}
+
+	void GLAPIENTRY CountedBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+		++current.calls;
+		current.bufferBytes += size;
+		realBufferSubData(target, offset, size, data);
+	}
+
+	void GLAPIENTRY CountedTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+		GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels) {
+		++current.calls;
+		if (pixels != nullptr) {
+			current.textureBytes += GetImageBytes(width, height, depth, format, type);
+		}
+		realTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+	}
+
+	void GLAPIENTRY CountedDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount) {
+		++current.calls;
+		++current.draws;
+		realDrawArraysInstanced(mode, first, count, instanceCount);
+	}
+
+	void GLAPIENTRY CountedDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount) {
+		++current.calls;
+		++current.draws;
+		realDrawElementsInstanced(mode, count, type, indices, instanceCount);
+	}
+
+	// Multi-draws count every draw they submit.
+	void GLAPIENTRY CountedMultiDrawElements(GLenum mode, const GLsizei* count, GLenum type, const void* const* indices, GLsizei drawCount) {
+		++current.calls;
+		current.draws += drawCount;
+		realMultiDrawElements(mode, count, type, indices, drawCount);
+	}
+
+	void GLAPIENTRY CountedMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride) {
+		++current.calls;
+		current.draws += drawCount;
+		realMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+	}
+
+	void GLAPIENTRY CountedUniform1i(GLint location, GLint v0) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform1i(location, v0);
+	}
+
+	void GLAPIENTRY CountedUniform1iv(GLint location, GLsizei count, const GLint* value) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform1iv(location, count, value);
+	}
+
+	void GLAPIENTRY CountedUniform1ui(GLint location, GLuint v0) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform1ui(location, v0);
+	}
+
+	void GLAPIENTRY CountedUniform1f(GLint location, GLfloat v0) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform1f(location, v0);
+	}
+
+	void GLAPIENTRY CountedUniform2f(GLint location, GLfloat v0, GLfloat v1) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform2f(location, v0, v1);
+	}
+
+	void GLAPIENTRY CountedUniform2fv(GLint location, GLsizei count, const GLfloat* value) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform2fv(location, count, value);
+	}
+
+	void GLAPIENTRY CountedUniform3fv(GLint location, GLsizei count, const GLfloat* value) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform3fv(location, count, value);
+	}
+
+	void GLAPIENTRY CountedUniform4fv(GLint location, GLsizei count, const GLfloat* value) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniform4fv(location, count, value);
+	}
+
+	void GLAPIENTRY CountedUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniformMatrix3fv(location, count, transpose, value);
+	}
+
+	void GLAPIENTRY CountedUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+		++current.calls;
+		++current.uniformUploads;
+		realUniformMatrix4fv(location, count, transpose, value);
+	}
+#endif
+}
+
+// Desc: Entry points the driver does not provide keep their null GLEW pointer.
+// The casts only bridge the const qualifiers that differ between GLEW versions.
+void GLCallCounters::Install() {
+#ifdef GL_CALL_COUNTERS
+	ForgetBindings();
+#define WRAP_GLEW_FUNCTION(name) \
+	if (__glew##name != nullptr && real##name == nullptr) { \
+		real##name = __glew##name; \
+		__glew##name = reinterpret_cast<decltype(__glew##name)>(Counted##name); \
+	}
+	WRAP_GLEW_FUNCTION(UseProgram)
+	WRAP_GLEW_FUNCTION(BindBuffer)
+	WRAP_GLEW_FUNCTION(BindBufferBase)
+	WRAP_GLEW_FUNCTION(BindBufferRange)
+	WRAP_GLEW_FUNCTION(BindVertexArray)
+	WRAP_GLEW_FUNCTION(BindFramebuffer)
+	WRAP_GLEW_FUNCTION(ActiveTexture)
+	WRAP_GLEW_FUNCTION(DeleteBuffers)
+	WRAP_GLEW_FUNCTION(DeleteVertexArrays)
+	WRAP_GLEW_FUNCTION(DeleteFramebuffers)
+	WRAP_GLEW_FUNCTION(DeleteProgram)
+	WRAP_GLEW_FUNCTION(BufferData)
+	WRAP_GLEW_FUNCTION(BufferSubData)
+	WRAP_GLEW_FUNCTION(TexImage3D)
+	WRAP_GLEW_FUNCTION(DrawArraysInstanced)
+	WRAP_GLEW_FUNCTION(DrawElementsInstanced)
+	WRAP_GLEW_FUNCTION(MultiDrawElements)
+	WRAP_GLEW_FUNCTION(MultiDrawElementsIndirect)
+	WRAP_GLEW_FUNCTION(Uniform1i)
+	WRAP_GLEW_FUNCTION(Uniform1iv)
+	WRAP_GLEW_FUNCTION(Uniform1ui)
+	WRAP_GLEW_FUNCTION(Uniform1f)
+	WRAP_GLEW_FUNCTION(Uniform2f)
+	WRAP_GLEW_FUNCTION(Uniform2fv)
+	WRAP_GLEW_FUNCTION(Uniform3fv)
+	WRAP_GLEW_FUNCTION(Uniform4fv)
+	WRAP_GLEW_FUNCTION(UniformMatrix3fv)
+	WRAP_GLEW_FUNCTION(UniformMatrix4fv)
+#undef WRAP_GLEW_FUNCTION
+#endif
+}
+
+void GLCallCounters::BeginFrame() {
+	last = current;
+	current = Counts();
+}
+
+const GLCallCounters::Counts& GLCallCounters::GetCurrentFrame() {
+	return current;
+}
+
+const GLCallCounters::Counts& GLCallCounters::GetLastFrame() {
+	return last;
+}
+
+void GLAPIENTRY GLCallCounters::DrawArrays(GLenum mode, GLint first, GLsizei count) {
+	++current.calls;
+	++current.draws;
+	glDrawArrays(mode, first, count);
+}
+
+void GLAPIENTRY GLCallCounters::DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+	++current.calls;
+	++current.draws;
+	glDrawElements(mode, count, type, indices);
+}
+
+void GLAPIENTRY GLCallCounters::BindTexture(GLenum target, GLuint texture) {
+	++current.calls;
+	++current.textureBinds;
+	const int index = GetTextureTarget(target);
+	if (index >= 0 && activeTextureUnit >= 0 && activeTextureUnit < kMaxTextureUnits) {
+		CountBind(boundTextures[activeTextureUnit][index], texture);
+	}
+	glBindTexture(target, texture);
+}
+
+void GLAPIENTRY GLCallCounters::DeleteTextures(GLsizei n, const GLuint* textures) {
+	++current.calls;
+	ForgetBindings();
+	glDeleteTextures(n, textures);
+}
+
+void GLAPIENTRY GLCallCounters::TexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+	GLint border, GLenum format, GLenum type, const void* pixels) {
+	++current.calls;
+	if (pixels != nullptr) {
+		current.textureBytes += GetImageBytes(width, height, 1, format, type);
+	}
+	glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+}
+
+void GLAPIENTRY GLCallCounters::TexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+	GLenum format, GLenum type, const void* pixels) {
+	++current.calls;
+	current.textureBytes += GetImageBytes(width, height, 1, format, type);
+	glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
+
+void GLAPIENTRY GLCallCounters::Enable(GLenum cap) {
+	++current.calls;
+	++current.stateChanges;
+	glEnable(cap);
+}
+
+void GLAPIENTRY GLCallCounters::Disable(GLenum cap) {
+	++current.calls;
+	++current.stateChanges;
+	glDisable(cap);
+}
+
+void GLAPIENTRY GLCallCounters::DepthMask(GLboolean flag) {
+	++current.calls;
+	++current.stateChanges;
+	glDepthMask(flag);
+}
+
+void GLAPIENTRY GLCallCounters::DepthFunc(GLenum func) {
+	++current.calls;
+	++current.stateChanges;
+	glDepthFunc(func);
+}
+
+void GLAPIENTRY GLCallCounters::CullFace(GLenum mode) {
+	++current.calls;
+	++current.stateChanges;
+	glCullFace(mode);
+}
+
+void GLAPIENTRY GLCallCounters::BlendFunc(GLenum sfactor, GLenum dfactor) {
+	++current.calls;
+	++current.stateChanges;
+	glBlendFunc(sfactor, dfactor);
+}
+
+void GLAPIENTRY GLCallCounters::ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+	++current.calls;
+	++current.stateChanges;
+	glColorMask(red, green, blue, alpha);
+}
+
+void GLAPIENTRY GLCallCounters::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	++current.calls;
+	++current.stateChanges;
+	glViewport(x, y, width, height);
+}
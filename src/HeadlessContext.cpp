@@ -0,0 +1,159 @@
+#include "HeadlessContext.h"
+
+// OpenCV headers.
+#include <opencv2/opencv.hpp>
+
+// C++ STL headers.
+#include <iostream>
+
+// Project headers.
+#include "GLCallCounters.h"
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext() {
+	display = nullptr;
+	context = nullptr;
+	width = 0;
+	height = 0;
+	fboId = 0;
+	colorRboId = 0;
+	depthRboId = 0;
+}
+
+HeadlessContext::~HeadlessContext() {
+	if (fboId != 0) {
+		glDeleteFramebuffers(1, &fboId);
+		glDeleteRenderbuffers(1, &colorRboId);
+		glDeleteRenderbuffers(1, &depthRboId);
+	}
+#ifdef HEADLESS_EGL
+	if (context != nullptr) {
+		eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+	}
+	if (display != nullptr) {
+		eglTerminate((EGLDisplay)display);
+	}
+#endif
+}
+
+// Desc: Prefer the surfaceless platform of Mesa, which needs neither a display
+// server nor a GPU, and fall back to the default display of the EGL vendor.
+bool HeadlessContext::Create() {
+#ifdef HEADLESS_EGL
+	EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != nullptr) {
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (eglDisplay == EGL_NO_DISPLAY) {
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major = 0;
+	EGLint minor = 0;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+		std::cerr << "[ERROR] Cannot initialize an EGL display" << std::endl;
+		return false;
+	}
+	display = eglDisplay;
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		std::cerr << "[ERROR] EGL does not support desktop OpenGL" << std::endl;
+		return false;
+	}
+	// The window is replaced by a framebuffer object, so the config needs no surface.
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, 0,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = nullptr;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+		std::cerr << "[ERROR] No EGL config for desktop OpenGL" << std::endl;
+		return false;
+	}
+	// The renderer relies on the compatibility profile, like the GLUT window.
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+	if (eglContext == EGL_NO_CONTEXT) {
+		// Without GL 4.3 only the visibility buffer is unavailable.
+		const EGLint fallbackAttribs[] = {
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+			EGL_NONE
+		};
+		eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, fallbackAttribs);
+	}
+	if (eglContext == EGL_NO_CONTEXT) {
+		std::cerr << "[ERROR] Cannot create an EGL context" << std::endl;
+		return false;
+	}
+	context = eglContext;
+	if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		std::cerr << "[ERROR] Cannot make the surfaceless EGL context current" << std::endl;
+		return false;
+	}
+	std::cout << "Headless EGL " << major << "." << minor << " context created" << std::endl;
+	return true;
+#else
+	std::cerr << "[ERROR] Headless rendering requires building with HEADLESS_EGL" << std::endl;
+	return false;
+#endif
+}
+
+bool HeadlessContext::CreateTargets(const int width, const int height) {
+	this->width = width;
+	this->height = height;
+	glGenFramebuffers(1, &fboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+	glGenRenderbuffers(1, &colorRboId);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorRboId);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRboId);
+
+	glGenRenderbuffers(1, &depthRboId);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRboId);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRboId);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!complete) {
+		std::cerr << "[ERROR] Headless framebuffer is incomplete" << std::endl;
+	}
+	return complete;
+}
+
+void HeadlessContext::Bind() const {
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	glViewport(0, 0, width, height);
+}
+
+bool HeadlessContext::SaveImage(const std::filesystem::path& filePath) const {
+	GLint prevFboId = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prevFboId);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	cv::Mat image(height, width, CV_8UC3);
+	glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, image.data);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prevFboId);
+
+	// OpenGL rows start at the bottom.
+	cv::flip(image, image, 0);
+	if (!cv::imwrite(filePath.string(), image)) {
+		std::cerr << "[ERROR] Cannot write image " << filePath << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -1,8 +1,14 @@
 #include "ImageTexture.h"
 
+#include "GLCallCounters.h"
+#include "TraceRecorder.h"
+
+bool ImageTexture::uploadEnabled = true;
+
 ImageTexture::ImageTexture(const std::filesystem::path& filePath)
 	: texFilePath(filePath)
 {
+	TraceScope trace("ImageTexture");
 	imageWidth = 0;
 	imageHeight = 0;
 	numChannels = 0;
@@ -21,6 +27,9 @@ ImageTexture::ImageTexture(const std::filesystem::path& filePath)
 	// Flip texture in vertical direction.
 	// OpenCV has smaller y coordinate on top; while OpenGL has larger.
 	cv::flip(texImage, texImage, 0);
+	if (!uploadEnabled) {
+		return;
+	}
 
 	glGenTextures(1, &textureObj);
     glBindTexture(GL_TEXTURE_2D, textureObj);
@@ -56,7 +65,9 @@ ImageTexture::ImageTexture(const std::filesystem::path& filePath)
 
 ImageTexture::~ImageTexture()
 {
-	glDeleteTextures(1, &textureObj);
+	if (textureObj != 0) {
+		glDeleteTextures(1, &textureObj);
+	}
 	texImage.release();
 }
 
@@ -0,0 +1,259 @@
+#include "JobSystem.h"
+
+// C++ STL headers.
+#include <algorithm>
+
+// Project headers.
+#include "TraceRecorder.h"
+
+namespace
+{
+	// Worker running on the calling thread, -1 on threads that are not workers.
+	thread_local const JobSystem* currentSystem = nullptr;
+	thread_local int currentWorker = -1;
+}
+
+JobSystem::JobSystem(const int numWorkers) {
+	nextWorker = 0;
+	glThreadId = std::this_thread::get_id();
+	numQueuedJobs = 0;
+	numBackgroundJobs = 0;
+	quit = false;
+
+	int count = numWorkers > 0 ? numWorkers : (int)std::thread::hardware_concurrency() - 1;
+	count = std::max(1, count);
+	for (int i = 0; i < count; ++i) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+	// Start the threads once every deque exists, they steal from each other.
+	for (int i = 0; i < count; ++i) {
+		workers[i]->thread = std::thread(&JobSystem::WorkerMain, this, i);
+	}
+}
+
+// Desc: The workers finish the queued jobs before they exit.
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	wakeUp.notify_all();
+	for (auto& worker : workers) {
+		worker->thread.join();
+	}
+}
+
+void JobSystem::Run(Job job, JobCounter* counter, JobCounter* dependency) {
+	Queue({ std::move(job), counter }, dependency, false);
+}
+
+void JobSystem::RunOnGLThread(Job job, JobCounter* counter, JobCounter* dependency) {
+	Queue({ std::move(job), counter }, dependency, true);
+}
+
+void JobSystem::RunBackground(Job job, JobCounter* counter) {
+	if (counter != nullptr) {
+		counter->value.fetch_add(1, std::memory_order_relaxed);
+	}
+	{
+		std::lock_guard<std::mutex> lock(backgroundMutex);
+		backgroundJobs.PushBack({ std::move(job), counter });
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		++numBackgroundJobs;
+	}
+	wakeUp.notify_one();
+}
+
+// Desc: Never takes a background job, a thread waiting on a short job could
+// otherwise be held up by a long one.
+void JobSystem::Wait(JobCounter& counter) {
+	while (!counter.IsDone()) {
+		if (!RunOne()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+// Desc: Jobs queued by these jobs wait for the next call.
+void JobSystem::RunGLJobs() {
+	size_t numJobs = 0;
+	{
+		std::lock_guard<std::mutex> lock(glMutex);
+		numJobs = glJobs.GetSize();
+	}
+	for (size_t i = 0; i < numJobs; ++i) {
+		QueuedJob job;
+		{
+			std::lock_guard<std::mutex> lock(glMutex);
+			if (glJobs.IsEmpty()) {
+				return;
+			}
+			job = glJobs.PopFront();
+		}
+		Execute(job);
+	}
+}
+
+void JobSystem::WorkerMain(const int index) {
+	currentSystem = this;
+	currentWorker = index;
+	TraceRecorder::SetThreadName("Job worker");
+	while (true) {
+		if (RunOne() || RunBackgroundJob()) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		if (quit && numQueuedJobs.load() == 0 && numBackgroundJobs.load() == 0) {
+			return;
+		}
+		wakeUp.wait(lock, [this]() { return quit || numQueuedJobs.load() > 0 || numBackgroundJobs.load() > 0; });
+	}
+}
+
+// Desc: The counter counts the job from now on. A job depending on an
+// unfinished counter is queued by the job that finishes the counter.
+void JobSystem::Queue(QueuedJob job, JobCounter* dependency, const bool glThread) {
+	if (job.counter != nullptr) {
+		job.counter->value.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (dependency != nullptr) {
+		std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+		if (dependency->value.load(std::memory_order_acquire) != 0) {
+			dependency->continuations.push_back([this, job, glThread]() { Push(job, glThread); });
+			return;
+		}
+	}
+	Push(std::move(job), glThread);
+}
+
+// Desc: Workers push to the back of their own deque, other threads spread
+// their jobs over all deques.
+void JobSystem::Push(QueuedJob job, const bool glThread) {
+	if (glThread) {
+		std::lock_guard<std::mutex> lock(glMutex);
+		glJobs.PushBack(std::move(job));
+		return;
+	}
+	const int index = currentSystem == this ? currentWorker : (int)(nextWorker++ % workers.size());
+	{
+		std::lock_guard<std::mutex> lock(workers[index]->mutex);
+		workers[index]->jobs.PushBack(std::move(job));
+	}
+	{
+		// Taking the lock orders the count against a worker about to sleep.
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		++numQueuedJobs;
+	}
+	wakeUp.notify_one();
+}
+
+bool JobSystem::RunOne() {
+	QueuedJob job;
+	bool found = false;
+	if (IsGLThread()) {
+		std::lock_guard<std::mutex> lock(glMutex);
+		if (!glJobs.IsEmpty()) {
+			job = glJobs.PopFront();
+			found = true;
+		}
+	}
+	if (!found && !PopOrSteal(job)) {
+		return false;
+	}
+	Execute(job);
+	return true;
+}
+
+// Desc: Take the newest job of the calling worker, or else the oldest job of
+// another deque, which is the largest piece of work left there.
+bool JobSystem::PopOrSteal(QueuedJob& job) {
+	const int numWorkers = (int)workers.size();
+	if (currentSystem == this) {
+		Worker& own = *workers[currentWorker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.IsEmpty()) {
+			job = own.jobs.PopBack();
+			--numQueuedJobs;
+			return true;
+		}
+	}
+	const int start = currentSystem == this ? currentWorker + 1 : (int)(nextWorker.load() % numWorkers);
+	for (int i = 0; i < numWorkers; ++i) {
+		Worker& victim = *workers[(start + i) % numWorkers];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.IsEmpty()) {
+			job = victim.jobs.PopFront();
+			--numQueuedJobs;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::RunBackgroundJob() {
+	QueuedJob job;
+	{
+		std::lock_guard<std::mutex> lock(backgroundMutex);
+		if (backgroundJobs.IsEmpty()) {
+			return false;
+		}
+		job = backgroundJobs.PopFront();
+		--numBackgroundJobs;
+	}
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(QueuedJob& job) {
+	job.job();
+	if (job.counter != nullptr) {
+		Finish(job.counter);
+	}
+}
+
+// Desc: The count drops under the mutex of the counter, so that a dependent
+// job is either queued here or sees the counter done when it is added.
+void JobSystem::Finish(JobCounter* counter) {
+	std::vector<std::function<void()>> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->continuationMutex);
+		if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			ready.swap(counter->continuations);
+		}
+	}
+	for (auto& continuation : ready) {
+		continuation();
+	}
+}
+
+// Desc: A full ring is unrolled into one twice as large.
+void JobSystem::JobQueue::PushBack(QueuedJob job) {
+	if (GetSize() == slots.size()) {
+		std::vector<QueuedJob> grown(std::max<size_t>(16, 2 * slots.size()));
+		for (size_t i = head; i < tail; ++i) {
+			grown[i - head] = std::move(slots[i % slots.size()]);
+		}
+		tail -= head;
+		head = 0;
+		slots.swap(grown);
+	}
+	slots[tail % slots.size()] = std::move(job);
+	++tail;
+}
+
+// Desc: The slot is emptied so that the captures of the job are released with it.
+JobSystem::QueuedJob JobSystem::JobQueue::PopBack() {
+	--tail;
+	QueuedJob job = std::move(slots[tail % slots.size()]);
+	slots[tail % slots.size()] = QueuedJob();
+	return job;
+}
+
+JobSystem::QueuedJob JobSystem::JobQueue::PopFront() {
+	QueuedJob job = std::move(slots[head % slots.size()]);
+	slots[head % slots.size()] = QueuedJob();
+	++head;
+	return job;
+}
@@ -0,0 +1,200 @@
+#include "LightClusterGrid.h"
+
+// C++ STL headers.
+#include <algorithm>
+
+LightClusterGrid::LightClusterGrid(const int dimX, const int dimY, const int dimZ, const float zNear, const float zFar) {
+	this->dimX = dimX;
+	this->dimY = dimY;
+	this->dimZ = dimZ;
+	this->zNear = zNear;
+	this->zFar = zFar;
+	clusterRanges.assign(GetNumClusters(), glm::uvec2(0, 0));
+
+	glGenBuffers(1, &lightSsbo);
+	glGenBuffers(1, &clusterSsbo);
+	glGenBuffers(1, &indexSsbo);
+	glGenBuffers(1, &paramsUbo);
+}
+
+LightClusterGrid::~LightClusterGrid() {
+	glDeleteBuffers(1, &lightSsbo);
+	glDeleteBuffers(1, &clusterSsbo);
+	glDeleteBuffers(1, &indexSsbo);
+	glDeleteBuffers(1, &paramsUbo);
+}
+
+LightClusterGrid::Light LightClusterGrid::MakePointLight(const glm::vec3& position, const glm::vec3& intensity, const glm::mat4& viewMatrix) {
+	float maxIntensity = std::max(intensity.x, std::max(intensity.y, intensity.z));
+	Light light;
+	light.positionRange = glm::vec4(glm::vec3(viewMatrix * glm::vec4(position, 1.0f)), std::sqrt(maxIntensity / kAttenuationCutoff));
+	light.intensityType = glm::vec4(intensity, 0.0f);
+	light.direction = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	light.spotParams = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	return light;
+}
+
+LightClusterGrid::Light LightClusterGrid::MakeSpotLight(const SpotLight& spotLight, const glm::mat4& viewMatrix) {
+	Light light = MakePointLight(spotLight.GetPosition(), spotLight.GetIntensity(), viewMatrix);
+	light.intensityType.w = 1.0f;
+	light.direction = glm::vec4(glm::normalize(glm::vec3(viewMatrix * glm::vec4(spotLight.GetDirection(), 0.0f))), 0.0f);
+	light.spotParams = glm::vec4(spotLight.GetTotalWidthDeg(), spotLight.GetCutoffDeg(), 0.0f, 0.0f);
+	return light;
+}
+
+// Desc: Depth of the near boundary of a slice. Slices are spaced exponentially
+// so that froxels keep roughly the same shape at every depth.
+float LightClusterGrid::GetSliceDepth(const int slice) const {
+	return zNear * std::pow(zFar / zNear, (float)slice / (float)dimZ);
+}
+
+int LightClusterGrid::GetClusterIndex(const glm::vec2& ndc, const float viewDepth) const {
+	int x = std::clamp((int)std::floor((ndc.x * 0.5f + 0.5f) * dimX), 0, dimX - 1);
+	int y = std::clamp((int)std::floor((ndc.y * 0.5f + 0.5f) * dimY), 0, dimY - 1);
+	int z = std::clamp((int)std::floor(std::log(std::max(viewDepth, zNear) / zNear) * GetLogDepthScale()), 0, dimZ - 1);
+	return x + dimX * (y + dimY * z);
+}
+
+std::vector<unsigned int> LightClusterGrid::GetClusterLights(const int clusterIndex) const {
+	const glm::uvec2& range = clusterRanges[clusterIndex];
+	return std::vector<unsigned int>(lightIndices.begin() + range.x, lightIndices.begin() + range.x + range.y);
+}
+
+// Desc: For every light, find the block of froxels covered by the screen space bounds
+// and depth range of its sphere, then keep the froxels whose view space AABB
+// intersects the sphere. The squared distance is separable per axis, so the x, y and
+// z terms are computed once per slice, row and column.
+void LightClusterGrid::Build(const glm::mat4& projMatrix, const std::vector<Light>& lights) {
+	const float p00 = projMatrix[0][0];
+	const float p11 = projMatrix[1][1];
+
+	std::fill(clusterRanges.begin(), clusterRanges.end(), glm::uvec2(0, 0));
+	pairs.clear();
+
+	dx2.resize(dimX);
+	for (unsigned int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+		const glm::vec3 center = glm::vec3(lights[lightIndex].positionRange);
+		const float radius = lights[lightIndex].positionRange.w;
+		const float radius2 = radius * radius;
+		const float depthMin = -center.z - radius;
+		const float depthMax = -center.z + radius;
+		if (depthMax < zNear || depthMin > zFar) {
+			continue;
+		}
+
+		// Depth slices.
+		const float logScale = GetLogDepthScale();
+		int z0 = std::clamp((int)std::floor(std::log(std::max(depthMin, zNear) / zNear) * logScale), 0, dimZ - 1);
+		int z1 = std::clamp((int)std::floor(std::log(std::min(depthMax, zFar) / zNear) * logScale), 0, dimZ - 1);
+
+		// Screen tiles from the projected corners of the bounding box of the sphere.
+		// A sphere crossing the near plane may cover any tile.
+		int x0 = 0, x1 = dimX - 1, y0 = 0, y1 = dimY - 1;
+		if (depthMin > zNear) {
+			glm::vec2 ndcMin = glm::vec2(1e9f, 1e9f);
+			glm::vec2 ndcMax = glm::vec2(-1e9f, -1e9f);
+			for (const float depth : { depthMin, depthMax }) {
+				for (const float sign : { -1.0f, 1.0f }) {
+					glm::vec2 ndc = glm::vec2(p00 * (center.x + sign * radius), p11 * (center.y + sign * radius)) / depth;
+					ndcMin = glm::min(ndcMin, ndc);
+					ndcMax = glm::max(ndcMax, ndc);
+				}
+			}
+			if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f) {
+				continue;
+			}
+			x0 = std::clamp((int)std::floor((ndcMin.x * 0.5f + 0.5f) * dimX), 0, dimX - 1);
+			x1 = std::clamp((int)std::floor((ndcMax.x * 0.5f + 0.5f) * dimX), 0, dimX - 1);
+			y0 = std::clamp((int)std::floor((ndcMin.y * 0.5f + 0.5f) * dimY), 0, dimY - 1);
+			y1 = std::clamp((int)std::floor((ndcMax.y * 0.5f + 0.5f) * dimY), 0, dimY - 1);
+		}
+
+		for (int z = z0; z <= z1; ++z) {
+			const float nearDepth = GetSliceDepth(z);
+			const float farDepth = GetSliceDepth(z + 1);
+			const float dz = std::max(0.0f, std::max(nearDepth - (-center.z), (-center.z) - farDepth));
+			const float dz2 = dz * dz;
+			if (dz2 > radius2) {
+				continue;
+			}
+
+			// The tile frustum is widest at the far depth, so the AABB of a tile spans
+			// the extreme of both depths on each side.
+			for (int x = x0; x <= x1; ++x) {
+				const float ndc0 = 2.0f * (float)x / (float)dimX - 1.0f;
+				const float ndc1 = 2.0f * (float)(x + 1) / (float)dimX - 1.0f;
+				const float minX = std::min(ndc0 * nearDepth, ndc0 * farDepth) / p00;
+				const float maxX = std::max(ndc1 * nearDepth, ndc1 * farDepth) / p00;
+				const float dx = std::max(0.0f, std::max(minX - center.x, center.x - maxX));
+				dx2[x] = dx * dx;
+			}
+
+			for (int y = y0; y <= y1; ++y) {
+				const float ndc0 = 2.0f * (float)y / (float)dimY - 1.0f;
+				const float ndc1 = 2.0f * (float)(y + 1) / (float)dimY - 1.0f;
+				const float minY = std::min(ndc0 * nearDepth, ndc0 * farDepth) / p11;
+				const float maxY = std::max(ndc1 * nearDepth, ndc1 * farDepth) / p11;
+				const float dy = std::max(0.0f, std::max(minY - center.y, center.y - maxY));
+				const float dyz2 = dy * dy + dz2;
+				if (dyz2 > radius2) {
+					continue;
+				}
+
+				const int rowBase = dimX * (y + dimY * z);
+				for (int x = x0; x <= x1; ++x) {
+					if (dx2[x] + dyz2 <= radius2) {
+						pairs.emplace_back(rowBase + x, lightIndex);
+						++clusterRanges[rowBase + x].y;
+					}
+				}
+			}
+		}
+	}
+
+	// Prefix sum of the counts, then scatter the light indices (counting sort by froxel).
+	unsigned int offset = 0;
+	for (auto& range : clusterRanges) {
+		range.x = offset;
+		offset += range.y;
+		range.y = 0;
+	}
+	lightIndices.resize(pairs.size());
+	for (const auto& pair : pairs) {
+		glm::uvec2& range = clusterRanges[pair.x];
+		lightIndices[range.x + range.y] = pair.y;
+		++range.y;
+	}
+}
+
+void LightClusterGrid::Upload(const std::vector<Light>& lights, const glm::vec2& screenSize) {
+	// Never allocate an empty buffer, which cannot be bound as an SSBO.
+	auto upload = [](GLuint ssbo, const void* data, size_t size) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(size, (size_t)16), nullptr, GL_STREAM_DRAW);
+		if (size > 0) {
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+		}
+	};
+	upload(lightSsbo, lights.data(), lights.size() * sizeof(Light));
+	upload(clusterSsbo, clusterRanges.data(), clusterRanges.size() * sizeof(glm::uvec2));
+	upload(indexSsbo, lightIndices.data(), lightIndices.size() * sizeof(unsigned int));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// std140 layout of ClusterParams in clustered_phong.fs.
+	struct {
+		glm::uvec4 dims;
+		glm::vec4 screen;
+	} params;
+	params.dims = glm::uvec4(dimX, dimY, dimZ, 0);
+	params.screen = glm::vec4(screenSize, zNear, GetLogDepthScale());
+	glBindBuffer(GL_UNIFORM_BUFFER, paramsUbo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(params), &params, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void LightClusterGrid::Bind() const {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lightSsbo);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, clusterSsbo);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indexSsbo);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, paramsUbo);
+}
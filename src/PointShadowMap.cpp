@@ -0,0 +1,193 @@
+#include "PointShadowMap.h"
+
+// GLM headers.
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// C++ STL headers.
+#include <algorithm>
+#include <iostream>
+
+// Project headers.
+#include "GLCallCounters.h"
+
+// Looking direction and up vector of the cube faces in the GL_TEXTURE_CUBE_MAP_POSITIVE_X order.
+static const glm::vec3 kFaceDirections[6] = {
+	{ 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+	{ 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+	{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+};
+static const glm::vec3 kFaceUps[6] = {
+	{ 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+	{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+	{ 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }
+};
+
+PointShadowMap::PointShadowMap(const int size) {
+	this->size = size;
+	zNear = 0.05f;
+	zFar = 1.0f;
+	valid = false;
+	lightPosition = glm::vec3(0.0f, 0.0f, 0.0f);
+	casterKey = 0;
+	numPassesRendered = 0;
+	numPassesSkipped = 0;
+	numFacesRendered = 0;
+
+	// Depth cube map compared by a samplerCubeShadow.
+	glGenTextures(1, &texId);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texId);
+	for (int face = 0; face < 6; ++face) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+			GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	// Attach the whole cube map so that gl_Layer selects the face.
+	glGenFramebuffers(1, &fboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texId, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "[ERROR] Point shadow framebuffer is incomplete" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+PointShadowMap::~PointShadowMap() {
+	glDeleteFramebuffers(1, &fboId);
+	glDeleteTextures(1, &texId);
+}
+
+void PointShadowMap::Update(
+	const glm::vec3& lightPosition,
+	const std::vector<ShadowCaster>& casters,
+	FrameArena& arena,
+	const std::shared_ptr<PointShadowShaderProg>& shader
+) {
+	// The depth range covers every caster.
+	glm::vec4* casterSpheres = arena.AllocateArray<glm::vec4>(casters.size());
+	float maxDist = 0.0f;
+	for (size_t i = 0; i < casters.size(); ++i) {
+		glm::vec4 sphere = casters[i].GetBoundingSphere();
+		casterSpheres[i] = sphere;
+		maxDist = std::max(maxDist, glm::length(glm::vec3(sphere) - lightPosition) + sphere.w);
+	}
+	float farPlane = std::max(zNear + 0.01f, maxDist);
+
+	glm::mat4 faceProj = glm::perspective(glm::radians(90.0f), 1.0f, zNear, farPlane);
+	glm::mat4 faceViewProj[6];
+	for (int face = 0; face < 6; ++face) {
+		faceViewProj[face] = faceProj * glm::lookAt(lightPosition, lightPosition + kFaceDirections[face], kFaceUps[face]);
+	}
+
+	// Skip the cube faces without casters, and hash the casters of the others.
+	uint64_t hash = 14695981039346656037ull;
+	auto hashBytes = [&hash](const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+	// Bit f of a mask is set when the caster reaches face f.
+	uint8_t* casterFaces = arena.AllocateArray<uint8_t>(casters.size());
+	uint8_t visibleFaces = 0;
+	for (size_t i = 0; i < casters.size(); ++i) {
+		casterFaces[i] = 0;
+		for (int face = 0; face < 6; ++face) {
+			if (ShadowAtlas::IntersectsFrustum(faceViewProj[face], casterSpheres[i])) {
+				casterFaces[i] |= (uint8_t)(1 << face);
+			}
+		}
+		visibleFaces |= casterFaces[i];
+		if (casterFaces[i] != 0) {
+			const opengl_homework::TriangleMesh* mesh = casters[i].mesh;
+			hashBytes(&mesh, sizeof(mesh));
+			hashBytes(&casters[i].worldMatrix, sizeof(glm::mat4));
+		}
+	}
+
+	if (valid && this->lightPosition == lightPosition && casterKey == hash && zFar == farPlane) {
+		numPassesRendered = 0;
+		numPassesSkipped = 1;
+		numFacesRendered = 0;
+		return;
+	}
+	valid = true;
+	this->lightPosition = lightPosition;
+	casterKey = hash;
+	zFar = farPlane;
+	numPassesRendered = 1;
+	numPassesSkipped = 0;
+
+	numFacesRendered = 0;
+	for (int face = 0; face < 6; ++face) {
+		if (visibleFaces & (1 << face)) {
+			++numFacesRendered;
+		}
+	}
+
+	GLint viewport[4];
+	GLint prevFboId = 0;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	glViewport(0, 0, size, size);
+	// Clears all six faces, the faces without casters stay at the far plane.
+	glClear(GL_DEPTH_BUFFER_BIT);
+	if (numFacesRendered > 0) {
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+		glDisable(GL_CULL_FACE);
+
+		shader->Bind();
+		for (size_t i = 0; i < casters.size(); ++i) {
+			if (casterFaces[i] == 0) {
+				continue;
+			}
+			// Instance j draws to the j-th face reached by the caster.
+			glm::mat4 instanceViewProj[6];
+			GLint instanceLayers[6];
+			int numInstances = 0;
+			for (int face = 0; face < 6; ++face) {
+				if (casterFaces[i] & (1 << face)) {
+					instanceViewProj[numInstances] = faceViewProj[face];
+					instanceLayers[numInstances] = face;
+					++numInstances;
+				}
+			}
+			glUniformMatrix4fv(shader->GetLocFaceViewProj(), numInstances, GL_FALSE, glm::value_ptr(instanceViewProj[0]));
+			glUniform1iv(shader->GetLocFaceLayers(), numInstances, instanceLayers);
+			glUniformMatrix4fv(shader->GetLocM(), 1, GL_FALSE, glm::value_ptr(casters[i].worldMatrix));
+			casters[i].mesh->DrawPositions(numInstances);
+		}
+		shader->Unbind();
+
+		glEnable(GL_CULL_FACE);
+		glDisable(GL_POLYGON_OFFSET_FILL);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void PointShadowMap::Bind(const GLenum textureUnit) const {
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texId);
+}
+
+// Desc: A point at distance d along the view axis of a face has NDC depth
+// (f + n) / (f - n) - 2fn / ((f - n) d), mapped to [0, 1] by the viewport.
+glm::vec2 PointShadowMap::GetDepthParams() const {
+	float a = 0.5f * (zFar + zNear) / (zFar - zNear) + 0.5f;
+	float b = -zFar * zNear / (zFar - zNear);
+	return glm::vec2(a, b);
+}
@@ -0,0 +1,161 @@
+#include "Profiler.h"
+
+// C++ STL headers.
+#include <algorithm>
+#include <iostream>
+
+Profiler::Profiler() {
+	frameIndex = 0;
+	numDroppedFrames = 0;
+}
+
+Profiler::~Profiler() {
+	for (auto& slot : frames) {
+		if (!slot.queries.empty()) {
+			glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+		}
+	}
+}
+
+// Desc: Read every finished frame, oldest first, then reuse the slot of the
+// oldest frame. Its results are dropped if the GPU has not finished it yet.
+void Profiler::BeginFrame() {
+	for (int i = kFrameLatency - 1; i >= 1; --i) {
+		if (frameIndex < (uint64_t)i) {
+			continue;
+		}
+		FrameSlot& slot = frames[(frameIndex - i) % kFrameLatency];
+		if (slot.pending && !ReadFrame(slot)) {
+			// Later frames cannot be finished before this one.
+			break;
+		}
+	}
+
+	FrameSlot& slot = frames[frameIndex % kFrameLatency];
+	if (slot.pending && !ReadFrame(slot)) {
+		++numDroppedFrames;
+	}
+	slot.pending = false;
+	slot.numQueriesUsed = 0;
+	slot.scopes.clear();
+	openScopes.clear();
+}
+
+void Profiler::EndFrame() {
+	if (!openScopes.empty()) {
+		std::cerr << "[ERROR] Profiler scope " << scopes[openScopes.back().scope].name << " is still open" << std::endl;
+		openScopes.clear();
+	}
+	FrameSlot& slot = frames[frameIndex % kFrameLatency];
+	slot.pending = !slot.scopes.empty();
+	++frameIndex;
+}
+
+// Desc: Allocates only the first time a scope is opened.
+void Profiler::BeginScope(const std::string_view name) {
+	OpenScope open;
+	open.scope = FindScope(name, (int)openScopes.size());
+	open.cpuStart = clock.GetElapsedTime();
+	open.gpuBeginQuery = AllocateQuery();
+	glQueryCounter(frames[frameIndex % kFrameLatency].queries[open.gpuBeginQuery], GL_TIMESTAMP);
+	openScopes.push_back(open);
+}
+
+void Profiler::EndScope() {
+	if (openScopes.empty()) {
+		return;
+	}
+	OpenScope open = openScopes.back();
+	openScopes.pop_back();
+
+	FrameSlot& slot = frames[frameIndex % kFrameLatency];
+	int endQuery = AllocateQuery();
+	glQueryCounter(slot.queries[endQuery], GL_TIMESTAMP);
+	slot.scopes.push_back({ open.scope, open.gpuBeginQuery, endQuery });
+
+	Scope& scope = scopes[open.scope];
+	AddSample(scope.cpuSamples, scope.cpuNext, (clock.GetElapsedTime() - open.cpuStart) * 1000.0);
+}
+
+std::vector<Profiler::ScopeStats> Profiler::GetStats() const {
+	std::vector<ScopeStats> stats;
+	for (const auto& scope : scopes) {
+		ScopeStats s;
+		s.name = scope.name;
+		s.depth = scope.depth;
+		ComputeStats(scope.cpuSamples, s.cpuMin, s.cpuAvg, s.cpuP99);
+		ComputeStats(scope.gpuSamples, s.gpuMin, s.gpuAvg, s.gpuP99);
+		stats.push_back(s);
+	}
+	return stats;
+}
+
+int Profiler::FindScope(const std::string_view name, const int depth) {
+	for (size_t i = 0; i < scopes.size(); ++i) {
+		if (scopes[i].name == name) {
+			return (int)i;
+		}
+	}
+	Scope scope;
+	scope.name = name;
+	scope.depth = depth;
+	scope.cpuSamples.reserve(kHistorySize);
+	scope.gpuSamples.reserve(kHistorySize);
+	scopes.push_back(std::move(scope));
+	return (int)scopes.size() - 1;
+}
+
+// Desc: Get the next query of the current frame, creating more the first time a frame needs them.
+int Profiler::AllocateQuery() {
+	FrameSlot& slot = frames[frameIndex % kFrameLatency];
+	if (slot.numQueriesUsed == (int)slot.queries.size()) {
+		slot.queries.push_back(0);
+		glGenQueries(1, &slot.queries.back());
+	}
+	return slot.numQueriesUsed++;
+}
+
+// Desc: The queries complete in order, so the frame is finished when its last query is.
+bool Profiler::ReadFrame(FrameSlot& slot) {
+	GLint available = 0;
+	glGetQueryObjectiv(slot.queries[slot.numQueriesUsed - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return false;
+	}
+	for (const auto& gpuScope : slot.scopes) {
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(slot.queries[gpuScope.beginQuery], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(slot.queries[gpuScope.endQuery], GL_QUERY_RESULT, &end);
+		Scope& scope = scopes[gpuScope.scope];
+		AddSample(scope.gpuSamples, scope.gpuNext, (double)(end - begin) * 1e-6);
+	}
+	slot.pending = false;
+	return true;
+}
+
+void Profiler::AddSample(std::vector<double>& samples, int& next, const double value) {
+	if ((int)samples.size() < kHistorySize) {
+		samples.push_back(value);
+	}
+	else {
+		samples[next] = value;
+	}
+	next = (next + 1) % kHistorySize;
+}
+
+void Profiler::ComputeStats(const std::vector<double>& samples, double& minValue, double& avgValue, double& p99Value) {
+	if (samples.empty()) {
+		minValue = avgValue = p99Value = -1.0;
+		return;
+	}
+	std::vector<double> sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (double sample : sorted) {
+		sum += sample;
+	}
+	minValue = sorted.front();
+	avgValue = sum / sorted.size();
+	p99Value = sorted[std::min(sorted.size() - 1, (size_t)(0.99 * sorted.size()))];
+}
@@ -0,0 +1,105 @@
+#include "QualityGovernor.h"
+
+// C++ STL headers.
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Weight of the newest frame in the moving averages.
+static constexpr double kSmoothing = 0.1;
+// Lower the quality above kDowngradeRatio * target, raise it below kUpgradeRatio * target.
+// The gap between the two ratios is the hysteresis.
+static constexpr double kDowngradeRatio = 1.05;
+static constexpr double kUpgradeRatio = 0.7;
+static constexpr int kDowngradeFrames = 10;
+static constexpr int kUpgradeFrames = 90;
+// Frames ignored after a change, long enough for the averages to settle.
+static constexpr int kCooldownFrames = 30;
+
+QualityGovernor::QualityGovernor(const double targetFrameTime) {
+	// Ordered from the best quality to the cheapest one.
+	levels = {
+		{ 1.00f, 4, 1024, 0.0f },
+		{ 1.00f, 2, 1024, 0.0f },
+		{ 0.85f, 1, 1024, 0.5f },
+		{ 0.75f, 1, 512, 0.5f },
+		{ 0.60f, 1, 512, 1.0f },
+		{ 0.50f, 1, 256, 1.5f },
+	};
+	levelIndex = 0;
+	this->targetFrameTime = targetFrameTime;
+	smoothedCpuTime = -1.0;
+	smoothedGpuTime = -1.0;
+	framesOverBudget = 0;
+	framesUnderBudget = 0;
+	cooldownFrames = 0;
+	numDecisions = 0;
+}
+
+bool QualityGovernor::Update(const double cpuFrameTime, const double gpuFrameTime) {
+	smoothedCpuTime = smoothedCpuTime < 0.0 ? cpuFrameTime : smoothedCpuTime + kSmoothing * (cpuFrameTime - smoothedCpuTime);
+	if (gpuFrameTime >= 0.0) {
+		smoothedGpuTime = smoothedGpuTime < 0.0 ? gpuFrameTime : smoothedGpuTime + kSmoothing * (gpuFrameTime - smoothedGpuTime);
+	}
+	if (cooldownFrames > 0) {
+		--cooldownFrames;
+		return false;
+	}
+	// Without a GPU timer the CPU time is all we know.
+	const double gpuTime = smoothedGpuTime >= 0.0 ? smoothedGpuTime : smoothedCpuTime;
+	const double frameTime = std::max(smoothedCpuTime, gpuTime);
+
+	framesOverBudget = frameTime > kDowngradeRatio * targetFrameTime ? framesOverBudget + 1 : 0;
+	framesUnderBudget = frameTime < kUpgradeRatio * targetFrameTime ? framesUnderBudget + 1 : 0;
+
+	if (framesOverBudget >= kDowngradeFrames) {
+		framesOverBudget = 0;
+		if (gpuTime <= kDowngradeRatio * targetFrameTime) {
+			// Lowering the resolution would not help a CPU bound frame.
+			if (lastDecision.rfind("CPU bound", 0) != 0) {
+				lastDecision = "CPU bound, level kept (" + FormatReason(gpuTime) + ")";
+				++numDecisions;
+				std::cout << "[Governor] " << lastDecision << std::endl;
+			}
+			return false;
+		}
+		if (levelIndex + 1 < (int)levels.size()) {
+			ChangeLevel(levelIndex + 1, FormatReason(gpuTime));
+			return true;
+		}
+	}
+	else if (framesUnderBudget >= kUpgradeFrames) {
+		framesUnderBudget = 0;
+		if (levelIndex > 0) {
+			ChangeLevel(levelIndex - 1, FormatReason(gpuTime));
+			return true;
+		}
+	}
+	return false;
+}
+
+// Desc: Only called once a decision is made, the frames without one allocate nothing.
+std::string QualityGovernor::FormatReason(const double gpuTime) const {
+	std::ostringstream reason;
+	reason << std::fixed << std::setprecision(2)
+		<< "CPU " << smoothedCpuTime << " ms, GPU " << gpuTime << " ms, target " << targetFrameTime << " ms";
+	return reason.str();
+}
+
+// Desc: Switch to a level, log the decision and wait for the next measurements.
+void QualityGovernor::ChangeLevel(const int newLevelIndex, const std::string& reason) {
+	const QualityLevel& level = levels[newLevelIndex];
+	std::ostringstream decision;
+	decision << "Level " << levelIndex << " -> " << newLevelIndex
+		<< " (scale " << level.renderScale << ", MSAA " << level.msaaSamples
+		<< "x, shadows " << level.shadowTileSize << ", LOD bias " << level.lodBias
+		<< "): " << reason;
+	levelIndex = newLevelIndex;
+	lastDecision = decision.str();
+	++numDecisions;
+	cooldownFrames = kCooldownFrames;
+	framesOverBudget = 0;
+	framesUnderBudget = 0;
+	std::cout << "[Governor] " << lastDecision << std::endl;
+}
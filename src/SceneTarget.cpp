@@ -0,0 +1,138 @@
+#include "SceneTarget.h"
+
+// GLM headers.
+#include <glm/glm.hpp>
+
+// C++ STL headers.
+#include <algorithm>
+#include <iostream>
+
+// Project headers.
+#include "GLCallCounters.h"
+
+SceneTarget::SceneTarget(const int width, const int height, const int samples) {
+	this->width = width;
+	this->height = height;
+	this->samples = samples;
+	fboId = 0;
+	colorRboId = 0;
+	depthRboId = 0;
+	resolveFboId = 0;
+	resolveTexId = 0;
+	CreateTargets();
+
+	// Create a triangle covering the whole screen in clip space.
+	const glm::vec2 triangle[3] = {
+		glm::vec2(-1.0f, -1.0f),
+		glm::vec2(3.0f, -1.0f),
+		glm::vec2(-1.0f, 3.0f)
+	};
+	glGenBuffers(1, &triangleVboId);
+	glBindBuffer(GL_ARRAY_BUFFER, triangleVboId);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STATIC_DRAW);
+}
+
+SceneTarget::~SceneTarget() {
+	ReleaseTargets();
+	glDeleteBuffers(1, &triangleVboId);
+}
+
+void SceneTarget::Resize(const int width, const int height, const int samples) {
+	if (width == this->width && height == this->height && samples == this->samples) {
+		return;
+	}
+	this->width = width;
+	this->height = height;
+	this->samples = samples;
+	ReleaseTargets();
+	CreateTargets();
+}
+
+void SceneTarget::CreateTargets() {
+	GLint maxSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	samples = std::clamp(samples, 1, std::max(1, (int)maxSamples));
+
+	glGenTextures(1, &resolveTexId);
+	glBindTexture(GL_TEXTURE_2D, resolveTexId);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	if (samples > 1) {
+		glGenRenderbuffers(1, &colorRboId);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorRboId);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRboId);
+
+		// The samples are resolved into the texture by a blit.
+		glGenFramebuffers(1, &resolveFboId);
+		glBindFramebuffer(GL_FRAMEBUFFER, resolveFboId);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolveTexId, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	}
+	else {
+		// Render straight into the texture.
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolveTexId, 0);
+	}
+	glGenRenderbuffers(1, &depthRboId);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRboId);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRboId);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "[ERROR] Scene framebuffer is incomplete" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SceneTarget::ReleaseTargets() {
+	glDeleteFramebuffers(1, &fboId);
+	glDeleteFramebuffers(1, &resolveFboId);
+	glDeleteRenderbuffers(1, &colorRboId);
+	glDeleteRenderbuffers(1, &depthRboId);
+	glDeleteTextures(1, &resolveTexId);
+	fboId = 0;
+	resolveFboId = 0;
+	colorRboId = 0;
+	depthRboId = 0;
+	resolveTexId = 0;
+}
+
+void SceneTarget::Bind() const {
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	glViewport(0, 0, width, height);
+}
+
+// Desc: The default framebuffer of GLUT may be multisampled, which rules out a
+// scaling blit into it, so the upscale is a textured full-screen triangle.
+void SceneTarget::Present(const GLuint outputFboId, const int windowWidth, const int windowHeight,
+	const std::shared_ptr<UpscaleShaderProg>& shader) {
+	if (samples > 1) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFboId);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFboId);
+	glViewport(0, 0, windowWidth, windowHeight);
+
+	glDisable(GL_DEPTH_TEST);
+	shader->Bind();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, resolveTexId);
+	glUniform1i(shader->GetLocSceneTexture(), 0);
+	glUniform2f(shader->GetLocOutputSize(), (float)windowWidth, (float)windowHeight);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, triangleVboId);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), 0);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDisableVertexAttribArray(0);
+	shader->Unbind();
+	glEnable(GL_DEPTH_TEST);
+}
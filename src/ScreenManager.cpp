@@ -10,23 +10,50 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 // C++ STL headers.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <random>
 
 // My headers.
 #include "TriangleMesh.h"
+#include "GLCallCounters.h"
 #include "ShaderProg.h"
 #include "Light.h"
 #include "Camera.h"
 #include "Skybox.h"
+#include "SkyboxCache.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "AllocationCounters.h"
+#include "SpscQueue.h"
+#include "LightClusterGrid.h"
+#include "ShadowAtlas.h"
+#include "PointShadowMap.h"
+#include "DeferredRenderer.h"
+#include "VisibilityBuffer.h"
+#include "QualityGovernor.h"
+#include "SceneTarget.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
+#include "HeadlessContext.h"
+#include "BenchmarkTimeline.h"
+#include "BenchmarkReport.h"
 #include "Clock.h"
 
 namespace opengl_homework {
 
 using MeshPtr = std::shared_ptr<opengl_homework::TriangleMesh>;
 
+// Passed to the passes when no shadow map was rendered this frame.
+static const std::shared_ptr<ShadowAtlas> kNoShadowAtlas;
+
 std::shared_ptr<ScreenManager> ScreenManager::GetInstance() {
     static std::shared_ptr<ScreenManager> instance(new ScreenManager());
     return instance;
@@ -64,6 +91,78 @@ struct SceneLight
     glm::vec3 visColor;
 };
 
+// DemoLight (animated point light to populate the clustered shading demo).
+struct DemoLight
+{
+    DemoLight() {
+        intensity = glm::vec3(1.0f, 1.0f, 1.0f);
+        orbitRadius = 1.0f;
+        height = 0.0f;
+        speed = 1.0f;
+        phase = 0.0f;
+    }
+
+    glm::vec3 GetPosition(const float time) const {
+        float angle = phase + speed * time;
+        return glm::vec3(orbitRadius * std::cos(angle), height, orbitRadius * std::sin(angle));
+    }
+
+    glm::vec3 intensity;
+    float orbitRadius;
+    float height;
+    float speed;
+    float phase;
+};
+
+// Input recorded by the GLUT callbacks, applied in order by the simulation.
+struct ScreenManager::InputEvent
+{
+    enum class Type { Key, SpecialKey, ModelMenu, SkyboxMenu };
+    Type type = Type::Key;
+    int value = 0;
+};
+
+// State stepped by the simulation, owned by the simulation thread while it runs.
+struct SimulationState
+{
+    Clock clock;
+    double elapsedTime = 0.0;
+    bool rotationPaused = false;
+    bool hasPointLight = false;
+    bool hasSpotLight = false;
+    glm::vec3 pointLightPosition = glm::vec3(0.0f);
+    glm::vec3 spotLightPosition = glm::vec3(0.0f);
+    std::vector<DemoLight> demoLights;
+    uint64_t numInputEvents = 0;
+};
+
+// One simulation step, read-only for the render thread once it is queued.
+struct ScreenManager::FrameSnapshot
+{
+    // Demo light at the time of the snapshot.
+    struct DemoLightInstance
+    {
+        glm::vec3 position;
+        glm::vec3 intensity;
+    };
+
+    double deltaTime = 0.0;
+    double elapsedTime = 0.0;
+    float rotationAngle = 0.0f;
+    bool rotationPaused = false;
+    // The lights are only moved when the simulation moved them, so that the
+    // benchmark timeline can place them directly.
+    bool pointLightMoved = false;
+    bool spotLightMoved = false;
+    glm::vec3 pointLightPosition = glm::vec3(0.0f);
+    glm::vec3 spotLightPosition = glm::vec3(0.0f);
+    std::vector<DemoLightInstance> demoLights;
+    // Input handled by the render thread: render toggles and menu picks.
+    std::vector<InputEvent> renderEvents;
+    // Input events applied up to this snapshot.
+    uint64_t numInputEvents = 0;
+};
+
 // ------------------------------------------------------------------------
 // Private member implementations. ----------------------------------------
 // ------------------------------------------------------------------------
@@ -75,15 +174,32 @@ struct ScreenManager::Impl {
         sceneObj = std::make_unique<SceneObject>();
         pointLightObj = std::make_unique<SceneLight<PointLight>>();
         spotLightObj = std::make_unique<SceneLight<SpotLight>>();
+        jobSystem = std::make_unique<JobSystem>();
+        skyboxCache = std::make_unique<SkyboxCache>(skyboxBudgetBytes, *jobSystem);
+        frameArena = std::make_unique<FrameArena>(frameArenaBytes);
+        for (int i = 0; i < kNumSnapshots; ++i) {
+            freeSnapshots.Push(i);
+        }
     };
 
+    ~Impl() {
+        if (simulationThread.joinable()) {
+            simulationQuit = true;
+            ++numSnapshotsConsumed;
+            numSnapshotsConsumed.notify_one();
+            simulationThread.join();
+        }
+    }
+
     int width;
     int height;
-    Clock clock;
     std::vector<std::string> objNames;
     std::vector<std::string> skyboxNames;
     std::shared_ptr<FillColorShaderProg> fillColorShader;
-    std::shared_ptr<PhongShadingDemoShaderProg> phongShader;
+    std::unique_ptr<ShaderPermutations<PhongShadingDemoShaderProg>> phongShaders;
+    std::shared_ptr<DepthOnlyShaderProg> depthOnlyShader;
+    std::shared_ptr<PointShadowShaderProg> pointShadowShader;
+    std::unique_ptr<ShaderPermutations<PhongShadingDemoShaderProg>> clusteredPhongShaders;
     std::shared_ptr<SkyboxShaderProg> skyboxShader;
     std::unique_ptr<SceneObject> sceneObj;
     std::shared_ptr<Camera> camera;
@@ -91,8 +207,96 @@ struct ScreenManager::Impl {
     std::shared_ptr<SceneLight<PointLight>> pointLightObj;
     std::shared_ptr<SceneLight<SpotLight>> spotLightObj;
     std::shared_ptr<Skybox> skybox;
+    // Worker threads, and GL jobs run on this thread every frame. Outlives the users of its jobs.
+    std::unique_ptr<JobSystem> jobSystem;
+    std::unique_ptr<SkyboxCache> skyboxCache;
+    const size_t skyboxBudgetBytes = 64 * 1024 * 1024;
+    int pendingSkyboxIndex = -1;
+    // Clustered forward shading.
+    std::unique_ptr<LightClusterGrid> lightGrid;
+    std::vector<LightClusterGrid::Light> clusterLights;
+    bool clusteredShading = false;
+    // Deferred shading into a G-buffer.
+    std::unique_ptr<DeferredRenderer> deferredRenderer;
+    std::unique_ptr<ShaderPermutations<PhongShadingDemoShaderProg>> gbufferShaders;
+    std::shared_ptr<DeferredLightingShaderProg> deferredDirShader;
+    std::shared_ptr<DeferredLightingShaderProg> deferredLightShader;
+    bool deferredShading = false;
+    // Visibility buffer with one resolve pass per submesh.
+    std::unique_ptr<VisibilityBuffer> visibilityBuffer;
+    std::shared_ptr<VisibilityShaderProg> visibilityShader;
+    std::unique_ptr<ShaderPermutations<VisibilityResolveShaderProg>> visibilityResolveShaders;
+    bool visibilityRendering = false;
+    // On-demand rendering: frames are only drawn for input, reshapes, animation and pending loads.
+    std::atomic<bool> onDemandRendering = false;
+    bool animationTimerPending = false;
+    const int animationFrameRate = 30;
+    // Adaptive quality: the scene is rendered offscreen at the resolution of the governor's level.
+    std::unique_ptr<QualityGovernor> governor;
+    std::unique_ptr<SceneTarget> sceneTarget;
+    std::shared_ptr<UpscaleShaderProg> upscaleShader;
+    bool adaptiveQuality = true;
+    // Keeps the governor on in headless and benchmark runs, which are then not reproducible.
+    bool headlessAdaptiveQuality = false;
+    int renderWidth = 600;
+    int renderHeight = 600;
+    // Ring of GL_TIME_ELAPSED queries, read two frames later so that we never wait for the GPU.
+    GLuint gpuTimerQueries[3] = { 0, 0, 0 };
+    int gpuTimerIndex = 0;
+    double gpuFrameTime = -1.0;
+    // CPU and GPU times of the render passes.
+    std::unique_ptr<Profiler> profiler;
+    bool profilerOverlay = false;
+    // Chrome trace JSON written by 't' and, with --trace <file>, at exit.
+    std::filesystem::path traceFilePath = "trace.json";
+    // Headless mode: fixed frames into an offscreen target, without GLUT.
+    bool headless = false;
+    std::unique_ptr<HeadlessContext> headlessContext;
+    int headlessFrames = 0;
+    std::filesystem::path cameraPathFile;
+    std::filesystem::path outputDir = "headless_output";
+    bool saveFrames = false;
+    // Benchmark timeline, compared against the baseline report if one is given.
+    std::filesystem::path benchmarkFile;
+    std::filesystem::path baselineFile;
+    double regressionThreshold = 0.1;
+    // Animation step in seconds, 0 for the real time between frames.
+    double fixedTimeStep = 0.0;
+    // Cached shadow maps of the directional and spot lights.
+    std::shared_ptr<ShadowAtlas> shadowAtlas;
+    std::vector<ShadowCaster> shadowCasters;
+    bool shadows = true;
     glm::vec3 ambientLight;
     float lightMoveSpeed = 0.2f;
+    bool clusterCulling = true;
+    bool depthPrepass = false;
+    // Ping-pong GL_PRIMITIVES_GENERATED queries of the mesh pass.
+    GLuint primitivesQuery[2] = { 0, 0 };
+    int queryIndex = 0;
+    GLuint numPrimitives = 0;
+    // Simulation thread: the GLUT callbacks queue their input to it, and it steps
+    // the animation and the lights into snapshots rendered by this thread, one
+    // frame ahead. Headless runs simulate on this thread instead.
+    static constexpr int kNumSnapshots = 3;
+    SimulationState simulation;
+    FrameSnapshot snapshots[kNumSnapshots];
+    SpscQueue<InputEvent, 256> inputEvents;
+    SpscQueue<int, kNumSnapshots> freeSnapshots;
+    SpscQueue<int, kNumSnapshots> readySnapshots;
+    std::atomic<uint64_t> numSnapshotsConsumed = 0;
+    std::atomic<bool> simulationQuit = false;
+    // Set by loads on this thread so that their time is not animated.
+    std::atomic<bool> resetSimulationClock = false;
+    std::thread simulationThread;
+    uint64_t numInputEventsPushed = 0;
+    // Snapshot rendered by the current frame.
+    int currentSnapshot = -1;
+    const FrameSnapshot* frame = nullptr;
+    // Visible submeshes of the frame in draw order, made on the job system.
+    TriangleMesh::PreparedFrame preparedFrame;
+    // Temporaries of the current frame, reset when the next one starts.
+    std::unique_ptr<FrameArena> frameArena;
+    const size_t frameArenaBytes = 1024 * 1024;
 };
 
 // ------------------------------------------------------------------------
@@ -100,44 +304,141 @@ struct ScreenManager::Impl {
 // ------------------------------------------------------------------------
 
 void ScreenManager::Start(int argc, char** argv) {
-    // Setting window properties.
-    glutInit(&argc, argv);
-    glutSetOption(GLUT_MULTISAMPLE, 4);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH | GLUT_MULTISAMPLE);
-    glutInitWindowSize(pImpl->width, pImpl->height);
-    glutInitWindowPosition(100, 100);
-    glutCreateWindow("HW2: Lighting and Shading");
-
-    // Initialize GLEW.
-    // Must be done after glut is initialized!
-    GLenum res = glewInit();
-    if (res != GLEW_OK) {
-        std::cerr << "GLEW initialization error: "
-            << glewGetErrorString(res) << std::endl;
-        exit(EXIT_FAILURE);
+    // Our options, glutInit ignores them.
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--on-demand") {
+            pImpl->onDemandRendering = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            pImpl->traceFilePath = argv[++i];
+            std::atexit([]() { TraceRecorder::Dump(GetInstance()->pImpl->traceFilePath); });
+        }
+        else if (arg == "--headless") {
+            pImpl->headless = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            pImpl->headlessFrames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--camera-path" && i + 1 < argc) {
+            pImpl->cameraPathFile = argv[++i];
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            pImpl->outputDir = argv[++i];
+        }
+        else if (arg == "--benchmark" && i + 1 < argc) {
+            // Benchmarks always run headless, so that the window system does not add noise.
+            pImpl->benchmarkFile = argv[++i];
+            pImpl->headless = true;
+        }
+        else if (arg == "--baseline" && i + 1 < argc) {
+            pImpl->baselineFile = argv[++i];
+        }
+        else if (arg == "--threshold" && i + 1 < argc) {
+            pImpl->regressionThreshold = std::atof(argv[++i]);
+        }
+        else if (arg == "--adaptive-quality") {
+            pImpl->headlessAdaptiveQuality = true;
+        }
+        else if (arg == "--save-frames") {
+            pImpl->saveFrames = true;
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            int w = 0;
+            int h = 0;
+            if (std::sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+                pImpl->width = w;
+                pImpl->height = h;
+            }
+        }
+    }
+
+    if (pImpl->headless) {
+        pImpl->headlessContext = std::make_unique<HeadlessContext>();
+        if (!pImpl->headlessContext->Create()) {
+            exit(EXIT_FAILURE);
+        }
+        // glewInit would also look for a GLX display, which does not exist here.
+        glewExperimental = GL_TRUE;
+        GLenum res = glewContextInit();
+        if (res != GLEW_OK) {
+            std::cerr << "GLEW initialization error: "
+                << glewGetErrorString(res) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (!pImpl->headlessContext->CreateTargets(pImpl->width, pImpl->height)) {
+            exit(EXIT_FAILURE);
+        }
+        // Reproducible frames: a fixed animation step, and no resolution changes from the governor
+        // unless they were asked for.
+        pImpl->onDemandRendering = false;
+        pImpl->adaptiveQuality = pImpl->headlessAdaptiveQuality;
+        pImpl->fixedTimeStep = 1.0 / 60.0;
+    }
+    else {
+        // Setting window properties.
+        glutInit(&argc, argv);
+        glutSetOption(GLUT_MULTISAMPLE, 4);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH | GLUT_MULTISAMPLE);
+        glutInitWindowSize(pImpl->width, pImpl->height);
+        glutInitWindowPosition(100, 100);
+        glutCreateWindow("HW2: Lighting and Shading");
+
+        // Initialize GLEW.
+        // Must be done after glut is initialized!
+        GLenum res = glewInit();
+        if (res != GLEW_OK) {
+            std::cerr << "GLEW initialization error: "
+                << glewGetErrorString(res) << std::endl;
+            exit(EXIT_FAILURE);
+        }
     }
 
+    // Only wraps the GL entry points in builds with GL_CALL_COUNTERS.
+    GLCallCounters::Install();
+
     // Initialization.
+    TraceRecorder::SetThreadName("Main");
     SetupFilesystem();
     SetupRenderState();
     SetupLights();
     SetupCamera();
     SetupShaderLib();
-    SetupMenu();
+    if (!pImpl->headless) {
+        SetupMenu();
+    }
     SetupSkybox(0);
     SetupScene(0);
+    FinishShaderLib();
+
+    if (!pImpl->benchmarkFile.empty()) {
+        if (!RunBenchmark()) {
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    if (pImpl->headless) {
+        RunHeadless();
+        return;
+    }
 
     // Register callback functions.
+    // Input always produces a frame, which matters in the on-demand mode.
     glutDisplayFunc([]() { GetInstance()->RenderSceneCB(); });
-    glutIdleFunc([]() { glutPostRedisplay(); });
+    SetupRedisplay();
     glutReshapeFunc([](int w, int h) { GetInstance()->ReshapeCB(w, h); });
-    glutSpecialFunc([](int key, int x, int y) { GetInstance()->ProcessSpecialKeysCB(key, x, y); });
-    glutKeyboardFunc([](unsigned char key, int x, int y) { GetInstance()->ProcessKeysCB(key, x, y); });
+    glutSpecialFunc([](int key, int x, int y) { GetInstance()->ProcessSpecialKeysCB(key, x, y); glutPostRedisplay(); });
+    glutKeyboardFunc([](unsigned char key, int x, int y) { GetInstance()->ProcessKeysCB(key, x, y); glutPostRedisplay(); });
+    StartSimulation();
 
     // Start rendering loop.
     glutMainLoop();
 }
 
+const Profiler& ScreenManager::GetProfiler() const {
+    return *pImpl->profiler;
+}
+
 // ------------------------------------------------------------------------
 // Private member functions. ----------------------------------------------
 // ------------------------------------------------------------------------
@@ -166,37 +467,158 @@ int ScreenManager::CalculateFrameRate() {
 
 // Callback function for glutDisplayFunc.
 void ScreenManager::RenderSceneCB() {
+    TraceScope trace("RenderSceneCB");
+    Clock cpuClock;
+    GLCallCounters::BeginFrame();
+    pImpl->profiler->BeginFrame();
+    pImpl->jobSystem->RunGLJobs();
+    // Nothing of the last frame is in use anymore.
+    FrameArena& arena = *pImpl->frameArena;
+    arena.Reset();
+    pImpl->profiler->BeginScope("Frame");
+    glBeginQuery(GL_TIME_ELAPSED, pImpl->gpuTimerQueries[pImpl->gpuTimerIndex]);
+    if (pImpl->adaptiveQuality) {
+        pImpl->sceneTarget->Bind();
+    }
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    double deltaTime = pImpl->clock.GetElapsedTime();
-    pImpl->clock.Reset();
-    float rotationAngle = 0.1f * deltaTime;
-
-    // Calculate frame rate.
-    int frameRate = CalculateFrameRate();
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glRasterPos2f(-0.95f, 0.9f);
-    std::string frameRateStr = "FPS: " + std::to_string(frameRate);
-    glutBitmapString(GLUT_BITMAP_HELVETICA_18, (const unsigned char*)frameRateStr.c_str());
+    {
+        ProfileScope scope(*pImpl->profiler, "Simulation");
+        AcquireSnapshot();
+        ApplySnapshot(*pImpl->frame);
+    }
+    const float rotationAngle = pImpl->frame->rotationAngle;
 
     // Rotate the model.
     auto rotationAxis = glm::vec3(0.0f, 1.0f, 0.0f);
     glm::mat4x4 R = glm::rotate(glm::mat4x4(1.0f), rotationAngle, rotationAxis);
     pImpl->sceneObj->Update(R);
 
-    pImpl->sceneObj->mesh->Render(
-        pImpl->phongShader,
-        pImpl->sceneObj->worldMatrix,
-        pImpl->ambientLight,
-        pImpl->dirLight,
-        pImpl->pointLightObj->light,
-        pImpl->spotLightObj->light,
-        pImpl->camera
-    );
+    // Cull and sort the submeshes on the workers while the shadows and the light lists are built.
+    JobCounter prepareCounter;
+    pImpl->jobSystem->Run([this]() {
+        pImpl->sceneObj->mesh->Prepare(pImpl->sceneObj->worldMatrix, pImpl->camera, *pImpl->jobSystem,
+            *pImpl->frameArena, pImpl->preparedFrame);
+    }, &prepareCounter);
+
+    ShaderPermutations<PhongShadingDemoShaderProg>* meshShaders = pImpl->phongShaders.get();
+    bool shadowsRendered = false;
+    if (pImpl->deferredShading) {
+        ProfileScope scope(*pImpl->profiler, "Light gathering");
+        GatherLights();
+    }
+    else if (pImpl->clusteredShading) {
+        ProfileScope scope(*pImpl->profiler, "Light clusters");
+        UpdateLightClusters();
+        meshShaders = pImpl->clusteredPhongShaders.get();
+    }
+    else if (pImpl->shadows) {
+        ProfileScope scope(*pImpl->profiler, "Shadows");
+        // Only the tiles whose light or casters changed are rendered again.
+        pImpl->shadowCasters.clear();
+        pImpl->shadowCasters.push_back({ pImpl->sceneObj->mesh.get(), pImpl->sceneObj->worldMatrix });
+        pImpl->shadowAtlas->Update(pImpl->camera, pImpl->dirLight, pImpl->spotLightObj->light,
+            pImpl->shadowCasters, arena, pImpl->depthOnlyShader);
+        const auto& pointLight = pImpl->pointLightObj->light;
+        if (pointLight != nullptr && pointLight->GetShadowMap() != nullptr) {
+            pointLight->GetShadowMap()->Update(pointLight->GetPosition(), pImpl->shadowCasters, arena,
+                pImpl->pointShadowShader);
+        }
+        shadowsRendered = true;
+    }
+    const std::shared_ptr<ShadowAtlas>& shadowAtlas = shadowsRendered ? pImpl->shadowAtlas : kNoShadowAtlas;
+
+    pImpl->profiler->BeginScope("Mesh");
+    pImpl->jobSystem->Wait(prepareCounter);
+    const TriangleMesh::PreparedFrame& preparedFrame = pImpl->preparedFrame;
+    // The G-buffer already shades each pixel once, so it needs no depth pre-pass.
+    if (pImpl->deferredShading) {
+        pImpl->deferredRenderer->BeginGeometryPass();
+        glBeginQuery(GL_PRIMITIVES_GENERATED, pImpl->primitivesQuery[pImpl->queryIndex]);
+        pImpl->sceneObj->mesh->Render(
+            *pImpl->gbufferShaders,
+            preparedFrame,
+            pImpl->ambientLight,
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr
+        );
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        pImpl->deferredRenderer->EndGeometryPass();
+        ProfileScope scope(*pImpl->profiler, "Lighting");
+        pImpl->deferredRenderer->RenderLighting(pImpl->camera, pImpl->dirLight, pImpl->clusterLights,
+            pImpl->deferredDirShader, pImpl->deferredLightShader);
+    }
+    else if (pImpl->visibilityRendering) {
+        pImpl->visibilityBuffer->BeginGeometryPass();
+        glBeginQuery(GL_PRIMITIVES_GENERATED, pImpl->primitivesQuery[pImpl->queryIndex]);
+        pImpl->sceneObj->mesh->RenderVisibility(
+            pImpl->visibilityShader,
+            preparedFrame
+        );
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        pImpl->visibilityBuffer->EndGeometryPass();
+        ProfileScope scope(*pImpl->profiler, "Lighting");
+        pImpl->sceneObj->mesh->ResolveVisibility(
+            *pImpl->visibilityResolveShaders,
+            *pImpl->visibilityBuffer,
+            preparedFrame,
+            pImpl->ambientLight,
+            pImpl->dirLight,
+            pImpl->pointLightObj->light,
+            pImpl->spotLightObj->light,
+            shadowAtlas
+        );
+    }
+    else {
+        // Depth pre-pass: lay down the depth so the phong pass shades each pixel once.
+        if (pImpl->depthPrepass) {
+            ProfileScope scope(*pImpl->profiler, "Depth pre-pass");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            pImpl->sceneObj->mesh->RenderDepth(
+                pImpl->depthOnlyShader,
+                preparedFrame
+            );
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        glBeginQuery(GL_PRIMITIVES_GENERATED, pImpl->primitivesQuery[pImpl->queryIndex]);
+        pImpl->sceneObj->mesh->Render(
+            *meshShaders,
+            preparedFrame,
+            pImpl->ambientLight,
+            pImpl->dirLight,
+            pImpl->pointLightObj->light,
+            pImpl->spotLightObj->light,
+            shadowAtlas
+        );
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+
+        if (pImpl->depthPrepass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+    }
+    pImpl->profiler->EndScope();
+
+    // Read the query of the previous frame so that we never wait for the GPU.
+    pImpl->queryIndex = 1 - pImpl->queryIndex;
+    GLuint prevQuery = pImpl->primitivesQuery[pImpl->queryIndex];
+    if (glIsQuery(prevQuery)) {
+        GLint available = 0;
+        glGetQueryObjectiv(prevQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            glGetQueryObjectuiv(prevQuery, GL_QUERY_RESULT, &pImpl->numPrimitives);
+        }
+    }
 
     // Visualize the light with fill color. ------------------------------------------------------
+    pImpl->profiler->BeginScope("Light gizmos");
     // Bind shader and set parameters.
-    auto pointLight = pImpl->pointLightObj->light;
+    const auto& pointLight = pImpl->pointLightObj->light;
     if (pointLight != nullptr) {
         glm::mat4x4 T = glm::translate(glm::mat4x4(1.0f), (pointLight->GetPosition()));
         pImpl->pointLightObj->worldMatrix = T;
@@ -212,7 +634,7 @@ void ScreenManager::RenderSceneCB() {
 
         pImpl->fillColorShader->Unbind();
     }
-    auto spotLight = pImpl->spotLightObj->light;
+    const auto& spotLight = pImpl->spotLightObj->light;
     if (spotLight != nullptr) {
         glm::mat4x4 T = glm::translate(glm::mat4x4(1.0f), (spotLight->GetPosition()));
         pImpl->spotLightObj->worldMatrix = T;
@@ -228,12 +650,87 @@ void ScreenManager::RenderSceneCB() {
 
         pImpl->fillColorShader->Unbind();
     }
+    pImpl->profiler->EndScope();
+    // Switch to the requested skybox once it has been decoded.
+    if (pImpl->skyboxCache->Update() && pImpl->pendingSkyboxIndex >= 0) {
+        SetupSkybox(pImpl->pendingSkyboxIndex);
+    }
     if (pImpl->skybox != nullptr) {
+        ProfileScope scope(*pImpl->profiler, "Skybox");
         pImpl->skybox->SetRotation(pImpl->skybox->GetRotation() + rotationAngle);
         pImpl->skybox->Render(pImpl->camera, pImpl->skyboxShader);
     }
 
-    glutSwapBuffers();
+    if (pImpl->adaptiveQuality) {
+        ProfileScope scope(*pImpl->profiler, "Post");
+        const GLuint outputFboId = pImpl->headless ? pImpl->headlessContext->GetFramebuffer() : 0;
+        pImpl->sceneTarget->Present(outputFboId, pImpl->width, pImpl->height, pImpl->upscaleShader);
+    }
+
+    // Calculate frame rate.
+    pImpl->profiler->BeginScope("HUD");
+    int frameRate = CalculateFrameRate();
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glDisable(GL_DEPTH_TEST);
+    glRasterPos2f(-0.95f, 0.9f);
+    // The text is built in the frame arena, so that the HUD allocates nothing.
+    const char* frameRateStr = arena.Format("FPS: %d  Primitives: %u", frameRate, pImpl->numPrimitives);
+    if (pImpl->deferredShading) {
+        frameRateStr = arena.Format("%s  Deferred lights: %zu", frameRateStr, pImpl->clusterLights.size());
+    }
+    else if (pImpl->clusteredShading) {
+        frameRateStr = arena.Format("%s  Lights: %zu", frameRateStr, pImpl->clusterLights.size());
+    }
+    else if (pImpl->shadows) {
+        int numPassesRendered = pImpl->shadowAtlas->GetNumPassesRendered();
+        int numPassesSkipped = pImpl->shadowAtlas->GetNumPassesSkipped();
+        const auto& pointLight = pImpl->pointLightObj->light;
+        if (pointLight != nullptr && pointLight->GetShadowMap() != nullptr) {
+            numPassesRendered += pointLight->GetShadowMap()->GetNumPassesRendered();
+            numPassesSkipped += pointLight->GetShadowMap()->GetNumPassesSkipped();
+        }
+        frameRateStr = arena.Format("%s  Shadow passes: %d drawn / %d reused", frameRateStr,
+            numPassesRendered, numPassesSkipped);
+    }
+    if (pImpl->adaptiveQuality) {
+        const auto& level = pImpl->governor->GetLevel();
+        frameRateStr = arena.Format("%s  Quality: %d (%.2fx, %dx MSAA)  CPU %.1f ms  GPU %.1f ms  Decisions: %d",
+            frameRateStr, pImpl->governor->GetLevelIndex(), level.renderScale, level.msaaSamples,
+            pImpl->governor->GetSmoothedCpuFrameTime(), pImpl->governor->GetSmoothedGpuFrameTime(),
+            pImpl->governor->GetNumDecisions());
+    }
+    // Bitmap fonts need GLUT, the headless mode only writes the timings to disk.
+    if (!pImpl->headless) {
+        glutBitmapString(GLUT_BITMAP_HELVETICA_18, (const unsigned char*)frameRateStr);
+        if (pImpl->profilerOverlay) {
+            DrawProfilerOverlay();
+        }
+        if (GLCallCounters::IsEnabled()) {
+            DrawGLCallCounters();
+        }
+    }
+    glEnable(GL_DEPTH_TEST);
+    pImpl->profiler->EndScope();
+
+    pImpl->profiler->EndScope();
+    pImpl->profiler->EndFrame();
+    glEndQuery(GL_TIME_ELAPSED);
+    double cpuFrameTime = cpuClock.GetElapsedTime() * 1000.0;
+    UpdateQuality(cpuFrameTime);
+
+    // Schedule the next frame of the animation, at most animationFrameRate per second.
+    if (pImpl->onDemandRendering && !pImpl->animationTimerPending && IsAnimating()) {
+        pImpl->animationTimerPending = true;
+        int delay = std::max(0, (int)(1000.0 / pImpl->animationFrameRate - cpuFrameTime));
+        glutTimerFunc(delay, [](int) {
+            GetInstance()->pImpl->animationTimerPending = false;
+            glutPostRedisplay();
+        }, 0);
+    }
+
+    if (!pImpl->headless) {
+        glutSwapBuffers();
+    }
 }
 
 // Callback function for glutReshapeFunc.
@@ -242,33 +739,14 @@ void ScreenManager::ReshapeCB(int w, int h) {
     pImpl->width = w;
     pImpl->height = h;
     glViewport(0, 0, pImpl->width, pImpl->height);
+    ApplyQualityLevel();
     // Adjust camera and projection.
     pImpl->camera->UpdateAspectRatio((float)pImpl->width / (float)pImpl->height);
     pImpl->camera->UpdateProjection();
 }
 
 void ScreenManager::ProcessSpecialKeysCB(int key, int x, int y) {
-    // Light control.
-    switch (key) {
-    case GLUT_KEY_LEFT:
-        if (pImpl->pointLightObj->light != nullptr)
-            pImpl->pointLightObj->light->MoveLeft(pImpl->lightMoveSpeed);
-        break;
-    case GLUT_KEY_RIGHT:
-        if (pImpl->pointLightObj->light != nullptr)
-            pImpl->pointLightObj->light->MoveRight(pImpl->lightMoveSpeed);
-        break;
-    case GLUT_KEY_UP:
-        if (pImpl->pointLightObj->light != nullptr)
-            pImpl->pointLightObj->light->MoveUp(pImpl->lightMoveSpeed);
-        break;
-    case GLUT_KEY_DOWN:
-        if (pImpl->pointLightObj->light != nullptr)
-            pImpl->pointLightObj->light->MoveDown(pImpl->lightMoveSpeed);
-        break;
-    default:
-        break;
-    }
+    PushInput({ InputEvent::Type::SpecialKey, key });
 }
 
 // Callback function for glutKeyboardFunc.
@@ -277,18 +755,92 @@ void ScreenManager::ProcessKeysCB(unsigned char key, int x, int y) {
     if (key == 27) {
         exit(0);
     }
+    PushInput({ InputEvent::Type::Key, key });
+}
 
-    // Spot light control.
-    auto spotLight = pImpl->spotLightObj->light;
-    if (spotLight != nullptr) {
-        if (key == 'a')
-            spotLight->MoveLeft(pImpl->lightMoveSpeed);
-        if (key == 'd')
-            spotLight->MoveRight(pImpl->lightMoveSpeed);
-        if (key == 'w')
-            spotLight->MoveUp(pImpl->lightMoveSpeed);
-        if (key == 's')
-            spotLight->MoveDown(pImpl->lightMoveSpeed);
+// Render toggles, applied on this thread when their snapshot is rendered.
+void ScreenManager::ApplyRenderKey(unsigned char key) {
+    // Toggle the cluster cone culling.
+    if (key == 'c') {
+        pImpl->clusterCulling = !pImpl->clusterCulling;
+        pImpl->sceneObj->mesh->SetClusterCulling(pImpl->clusterCulling);
+        std::cout << "Cluster culling: " << (pImpl->clusterCulling ? "on" : "off") << std::endl;
+    }
+
+    // Toggle the clustered forward shading, '+' and '-' add or remove animated lights.
+    if (key == 'l') {
+        if (pImpl->clusteredPhongShaders == nullptr) {
+            std::cout << "Clustered shading requires OpenGL 4.3." << std::endl;
+        }
+        else {
+            pImpl->clusteredShading = !pImpl->clusteredShading;
+            std::cout << "Clustered shading: " << (pImpl->clusteredShading ? "on" : "off") << std::endl;
+        }
+    }
+
+    // Toggle the shadows, 'p' pauses the model rotation so that the shadow maps can be reused.
+    if (key == 'h') {
+        pImpl->shadows = !pImpl->shadows;
+        std::cout << "Shadows: " << (pImpl->shadows ? "on" : "off") << std::endl;
+    }
+
+    // Toggle the deferred shading, which shades the same lights as the clustered path.
+    if (key == 'g') {
+        if (pImpl->gbufferShaders == nullptr) {
+            std::cout << "Deferred shading is unavailable." << std::endl;
+        }
+        else {
+            pImpl->deferredShading = !pImpl->deferredShading;
+            std::cout << "Deferred shading: " << (pImpl->deferredShading ? "on" : "off") << std::endl;
+        }
+    }
+
+    // Toggle the visibility buffer, which shades each pixel once like the depth pre-pass
+    // but without rasterizing the phong attributes of sub-pixel triangles.
+    if (key == 'v') {
+        if (pImpl->visibilityResolveShaders == nullptr) {
+            std::cout << "Visibility buffer rendering requires OpenGL 4.3." << std::endl;
+        }
+        else {
+            pImpl->visibilityRendering = !pImpl->visibilityRendering;
+            std::cout << "Visibility buffer: " << (pImpl->visibilityRendering ? "on" : "off") << std::endl;
+        }
+    }
+
+    // Toggle the adaptive quality governor.
+    if (key == 'q') {
+        if (pImpl->upscaleShader == nullptr) {
+            std::cout << "Adaptive quality is unavailable." << std::endl;
+        }
+        else {
+            pImpl->adaptiveQuality = !pImpl->adaptiveQuality;
+            ApplyQualityLevel();
+            std::cout << "Adaptive quality: " << (pImpl->adaptiveQuality ? "on" : "off") << std::endl;
+        }
+    }
+
+    // Toggle between the continuous and the on-demand rendering.
+    if (key == 'o') {
+        pImpl->onDemandRendering = !pImpl->onDemandRendering;
+        SetupRedisplay();
+        std::cout << "On-demand rendering: " << (pImpl->onDemandRendering ? "on" : "off") << std::endl;
+    }
+
+    // Toggle the profiler overlay.
+    if (key == 'f') {
+        pImpl->profilerOverlay = !pImpl->profilerOverlay;
+        std::cout << "Profiler overlay: " << (pImpl->profilerOverlay ? "on" : "off") << std::endl;
+    }
+
+    // Dump the recent frames, loads and worker activity as a Chrome trace.
+    if (key == 't') {
+        TraceRecorder::Dump(pImpl->traceFilePath);
+    }
+
+    // Toggle the depth pre-pass.
+    if (key == 'z') {
+        pImpl->depthPrepass = !pImpl->depthPrepass;
+        std::cout << "Depth pre-pass: " << (pImpl->depthPrepass ? "on" : "off") << std::endl;
     }
 }
 
@@ -322,6 +874,28 @@ void ScreenManager::SetupFilesystem() {
 
 void ScreenManager::SetupRenderState() {
     glEnable(GL_DEPTH_TEST);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    // Back faces of the visible clusters are culled by the fixed-function stage.
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
+
+    glGenQueries(2, pImpl->primitivesQuery);
+
+    // 3 cascades over the first 8 units of depth and the spot light, 1024 x 1024 each.
+    pImpl->shadowAtlas = std::make_shared<ShadowAtlas>(1024, 8.0f);
+
+    pImpl->deferredRenderer = std::make_unique<DeferredRenderer>(pImpl->width, pImpl->height);
+    pImpl->visibilityBuffer = std::make_unique<VisibilityBuffer>(pImpl->width, pImpl->height);
+
+    // Aim at 60 FPS.
+    pImpl->governor = std::make_unique<QualityGovernor>(1000.0 / 60.0);
+    pImpl->sceneTarget = std::make_unique<SceneTarget>(pImpl->width, pImpl->height, 1);
+    glGenQueries(3, pImpl->gpuTimerQueries);
+    ApplyQualityLevel();
+
+    pImpl->profiler = std::make_unique<Profiler>();
 
     glm::vec4 clearColor = glm::vec4(0.44f, 0.57f, 0.75f, 1.00f);
     glClearColor(
@@ -335,6 +909,7 @@ void ScreenManager::SetupRenderState() {
 // Load a model from obj file and apply transformation.
 // You can alter the parameters for dynamically loading a model.
 void ScreenManager::SetupScene(int objIndex) {
+    TraceScope trace("SetupScene");
     glm::mat4x4 S = glm::scale(glm::mat4x4(1.0f), glm::vec3(1.5f, 1.5f, 1.5f));
     pImpl->sceneObj->worldMatrix = S;
     if (pImpl->sceneObj->mesh != nullptr) {
@@ -343,11 +918,20 @@ void ScreenManager::SetupScene(int objIndex) {
     auto objBasePath = std::filesystem::path("models");
     auto objFilePath = objBasePath / pImpl->objNames[objIndex] / (pImpl->objNames[objIndex] + ".obj");
     pImpl->sceneObj->mesh = std::make_shared<TriangleMesh>(objFilePath, true);
+    pImpl->sceneObj->mesh->SetClusterCulling(pImpl->clusterCulling);
     pImpl->sceneObj->mesh->CreateBuffers();
 
     pImpl->sceneObj->mesh->PrintMeshInfo();
 
-    pImpl->clock.Reset();
+    // The new mesh may reuse the address of the old one.
+    if (pImpl->shadowAtlas != nullptr) {
+        pImpl->shadowAtlas->InvalidateAll();
+    }
+    if (pImpl->pointLightObj->light != nullptr && pImpl->pointLightObj->light->GetShadowMap() != nullptr) {
+        pImpl->pointLightObj->light->GetShadowMap()->Invalidate();
+    }
+
+    pImpl->resetSimulationClock = true;
 }
 
 void ScreenManager::SetupLights() {
@@ -364,6 +948,7 @@ void ScreenManager::SetupLights() {
     pImpl->dirLight = std::make_unique<DirectionalLight>(dirLightDirection, dirLightRadiance);
     pImpl->pointLightObj->light = std::make_shared<PointLight>(pointLightPosition, pointLightIntensity);
     pImpl->pointLightObj->visColor = glm::normalize((pImpl->pointLightObj->light->GetIntensity()));
+    pImpl->pointLightObj->light->SetShadowMap(std::make_shared<PointShadowMap>(512));
     pImpl->spotLightObj->light = std::make_shared<SpotLight>(
         spotLightPosition,
         spotLightIntensity,
@@ -372,6 +957,12 @@ void ScreenManager::SetupLights() {
         spotLightTotalWidthInDegree);
     pImpl->spotLightObj->visColor = glm::normalize((pImpl->spotLightObj->light->GetIntensity()));
     pImpl->ambientLight = ambientLight;
+
+    // The simulation moves the lights from here on.
+    pImpl->simulation.hasPointLight = true;
+    pImpl->simulation.pointLightPosition = pointLightPosition;
+    pImpl->simulation.hasSpotLight = true;
+    pImpl->simulation.spotLightPosition = spotLightPosition;
 }
 
 void ScreenManager::SetupCamera() {
@@ -388,42 +979,687 @@ void ScreenManager::SetupCamera() {
     pImpl->camera->UpdateNearPlane(zNear);
     pImpl->camera->UpdateFarPlane(zFar);
     pImpl->camera->UpdateProjection();
+
+    // 16 x 9 screen tiles and 24 depth slices over the camera depth range.
+    pImpl->lightGrid = std::make_unique<LightClusterGrid>(16, 9, 24, zNear, zFar);
 }
 
+// Switch to a skybox if it is resident, otherwise keep the current one
+// until the panorama has been decoded in the background.
 void ScreenManager::SetupSkybox(int skyboxIndex) {
-    const int numSlices = 36;
-    const int numStacks = 18;
-    const float radius = 50.0f;
     auto skyboxDir = std::filesystem::path("textures") / pImpl->skyboxNames[skyboxIndex];
-    pImpl->skybox = std::make_shared<Skybox>(skyboxDir, numSlices, numStacks, radius);
+    auto skybox = pImpl->skyboxCache->Request(skyboxDir);
+    if (skybox == nullptr) {
+        pImpl->pendingSkyboxIndex = skyboxIndex;
+        return;
+    }
+
+    // Keep the current spin so the switch is seamless.
+    if (pImpl->skybox != nullptr) {
+        skybox->SetRotation(pImpl->skybox->GetRotation());
+    }
+    pImpl->skybox = skybox;
+    pImpl->pendingSkyboxIndex = -1;
 }
 
+// Submit every program without waiting, so that the driver compiles them
+// while the model and the skybox are loading.
 void ScreenManager::SetupShaderLib() {
+    ShaderProg::EnableParallelCompile();
+
     pImpl->fillColorShader = std::make_unique<FillColorShaderProg>();
-    pImpl->phongShader = std::make_unique<PhongShadingDemoShaderProg>();
+    // Defines of the PhongFeature bits.
+    pImpl->phongShaders = std::make_unique<ShaderPermutations<PhongShadingDemoShaderProg>>(
+        "shaders/phong_shading_demo.vs", "shaders/phong_shading_demo.fs", "",
+        std::vector<std::string>{ "HAS_MAP_KD", "USE_DIR_LIGHT", "NUM_POINT_LIGHTS 1", "USE_SPOT", "USE_SHADOWS", "USE_POINT_SHADOW" });
     pImpl->skyboxShader = std::make_unique<SkyboxShaderProg>();
+    pImpl->depthOnlyShader = std::make_unique<DepthOnlyShaderProg>();
+    pImpl->pointShadowShader = std::make_unique<PointShadowShaderProg>();
+
+    if (!pImpl->fillColorShader->Submit("shaders/fixed_color.vs", "shaders/fixed_color.fs", "")) {
+        std::cerr << "Failed to load fixed_color shader." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // The variant without features is the fallback while the others compile.
+    // The variant with every feature is compiled up front to catch errors in the sources.
+    pImpl->phongShaders->Submit(0);
+    pImpl->phongShaders->Submit(PHONG_HAS_MAP_KD | PHONG_USE_DIR_LIGHT | PHONG_USE_POINT_LIGHT | PHONG_USE_SPOT | PHONG_USE_SHADOWS | PHONG_USE_POINT_SHADOW);
+    if (!pImpl->skyboxShader->Submit("shaders/skybox.vs", "shaders/skybox.fs", "")) {
+        std::cerr << "Failed to load skybox shader." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!pImpl->depthOnlyShader->Submit("shaders/depth_only.vs", "shaders/depth_only.fs", "")) {
+        std::cerr << "Failed to load depth_only shader." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // Select the cube face in the vertex shader if supported, otherwise in a pass-through geometry shader.
+    if (GLEW_ARB_shader_viewport_layer_array || GLEW_AMD_vertex_shader_layer) {
+        pImpl->pointShadowShader->Submit("shaders/point_shadow.vs", "shaders/point_shadow.fs", "", { "VS_LAYER" });
+    }
+    else {
+        pImpl->pointShadowShader->Submit("shaders/point_shadow.vs", "shaders/point_shadow.fs", "shaders/point_shadow.gs");
+    }
+    // Shader storage buffers need OpenGL 4.3, the clustered path is optional.
+    // Point and spot lights come from the light lists and are not shadowed, so those bits are unused.
+    if (GLEW_VERSION_4_3) {
+        pImpl->clusteredPhongShaders = std::make_unique<ShaderPermutations<PhongShadingDemoShaderProg>>(
+            "shaders/phong_shading_demo.vs", "shaders/clustered_phong.fs", "",
+            std::vector<std::string>{ "HAS_MAP_KD", "USE_DIR_LIGHT", "", "", "", "" });
+        pImpl->clusteredPhongShaders->Submit(0);
+        pImpl->clusteredPhongShaders->Submit(PHONG_HAS_MAP_KD | PHONG_USE_DIR_LIGHT);
+
+        // The resolve pass pulls the vertices from shader storage buffers.
+        pImpl->visibilityShader = std::make_unique<VisibilityShaderProg>();
+        pImpl->visibilityShader->Submit("shaders/visibility.vs", "shaders/visibility.fs", "");
+        pImpl->visibilityResolveShaders = std::make_unique<ShaderPermutations<VisibilityResolveShaderProg>>(
+            "shaders/visibility_resolve.vs", "shaders/visibility_resolve.fs", "",
+            std::vector<std::string>{ "HAS_MAP_KD", "USE_DIR_LIGHT", "NUM_POINT_LIGHTS 1", "USE_SPOT", "USE_SHADOWS", "USE_POINT_SHADOW" });
+        pImpl->visibilityResolveShaders->Submit(0);
+    }
+    pImpl->upscaleShader = std::make_unique<UpscaleShaderProg>();
+    pImpl->upscaleShader->Submit("shaders/deferred_fullscreen.vs", "shaders/upscale.fs", "");
+    // The G-buffer only stores the materials, so only the texture bit is used.
+    pImpl->gbufferShaders = std::make_unique<ShaderPermutations<PhongShadingDemoShaderProg>>(
+        "shaders/phong_shading_demo.vs", "shaders/gbuffer.fs", "",
+        std::vector<std::string>{ "HAS_MAP_KD", "", "", "", "", "" });
+    pImpl->gbufferShaders->Submit(0);
+    pImpl->gbufferShaders->Submit(PHONG_HAS_MAP_KD);
+    pImpl->deferredDirShader = std::make_unique<DeferredLightingShaderProg>();
+    pImpl->deferredDirShader->Submit("shaders/deferred_fullscreen.vs", "shaders/deferred_directional.fs", "");
+    pImpl->deferredLightShader = std::make_unique<DeferredLightingShaderProg>();
+    pImpl->deferredLightShader->Submit("shaders/deferred_light.vs", "shaders/deferred_light.fs", "");
+}
 
-    if (!pImpl->fillColorShader->LoadFromFiles("shaders/fixed_color.vs", "shaders/fixed_color.fs", "")) {
+// Wait for the programs that have no fallback. The other variants keep
+// compiling and are picked up by the renderer once they are ready.
+void ScreenManager::FinishShaderLib() {
+    if (!pImpl->fillColorShader->Finish()) {
         std::cerr << "Failed to load fixed_color shader." << std::endl;
         exit(EXIT_FAILURE);
     }
-    if (!pImpl->phongShader->LoadFromFiles("shaders/phong_shading_demo.vs", "shaders/phong_shading_demo.fs", "shaders/face_culling.gs")) {
+    if (pImpl->phongShaders->Finish(0) == nullptr) {
         std::cerr << "Failed to load gouraud shader." << std::endl;
         exit(EXIT_FAILURE);
     }
-    if (!pImpl->skyboxShader->LoadFromFiles("shaders/skybox.vs", "shaders/skybox.fs", "")) {
+    if (!pImpl->skyboxShader->Finish()) {
         std::cerr << "Failed to load skybox shader." << std::endl;
         exit(EXIT_FAILURE);
     }
+    if (!pImpl->depthOnlyShader->Finish()) {
+        std::cerr << "Failed to load depth_only shader." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!pImpl->pointShadowShader->Finish()) {
+        std::cerr << "Failed to load point_shadow shader, the point light casts no shadow." << std::endl;
+        if (pImpl->pointLightObj->light != nullptr) {
+            pImpl->pointLightObj->light->SetShadowMap(nullptr);
+        }
+    }
+    if (pImpl->clusteredPhongShaders != nullptr && pImpl->clusteredPhongShaders->Finish(0) == nullptr) {
+        std::cerr << "Failed to load clustered_phong shader." << std::endl;
+        pImpl->clusteredPhongShaders = nullptr;
+    }
+    if (pImpl->visibilityResolveShaders != nullptr
+        && (!pImpl->visibilityShader->Finish() || pImpl->visibilityResolveShaders->Finish(0) == nullptr)) {
+        std::cerr << "Failed to load visibility buffer shaders." << std::endl;
+        pImpl->visibilityResolveShaders = nullptr;
+    }
+    if (!pImpl->upscaleShader->Finish()) {
+        std::cerr << "Failed to load upscale shader, adaptive quality is disabled." << std::endl;
+        pImpl->upscaleShader = nullptr;
+        pImpl->adaptiveQuality = false;
+        ApplyQualityLevel();
+    }
+    if (pImpl->gbufferShaders->Finish(0) == nullptr || !pImpl->deferredDirShader->Finish() || !pImpl->deferredLightShader->Finish()) {
+        std::cerr << "Failed to load deferred shaders." << std::endl;
+        pImpl->gbufferShaders = nullptr;
+    }
+}
+
+// Redraw continuously from the idle callback, or only when RenderSceneCB or an
+// input callback asks for a frame.
+void ScreenManager::SetupRedisplay() {
+    if (pImpl->onDemandRendering) {
+        glutIdleFunc(nullptr);
+    }
+    else {
+        glutIdleFunc([]() { glutPostRedisplay(); });
+    }
+}
+
+// Whether the next frame differs from the last one without any input.
+bool ScreenManager::IsAnimating() const {
+    const FrameSnapshot& frame = *pImpl->frame;
+    if (!frame.rotationPaused) {
+        return true;
+    }
+    if (!frame.demoLights.empty() && (pImpl->clusteredShading || pImpl->deferredShading)) {
+        return true;
+    }
+    // Input queued after this snapshot was taken shows in the next one.
+    if (pImpl->numInputEventsPushed > frame.numInputEvents) {
+        return true;
+    }
+    return HasPendingLoads();
+}
+
+// Whether a skybox or a shader permutation is still loading in the background.
+bool ScreenManager::HasPendingLoads() const {
+    if (pImpl->pendingSkyboxIndex >= 0 || pImpl->skyboxCache->HasPending()) {
+        return true;
+    }
+    return pImpl->phongShaders->HasPending()
+        || (pImpl->clusteredPhongShaders != nullptr && pImpl->clusteredPhongShaders->HasPending())
+        || (pImpl->gbufferShaders != nullptr && pImpl->gbufferShaders->HasPending())
+        || (pImpl->visibilityResolveShaders != nullptr && pImpl->visibilityResolveShaders->HasPending());
+}
+
+// Read the GPU time of an earlier frame and let the governor pick the level of the next one.
+void ScreenManager::UpdateQuality(double cpuFrameTime) {
+    pImpl->gpuTimerIndex = (pImpl->gpuTimerIndex + 1) % 3;
+    GLuint oldestQuery = pImpl->gpuTimerQueries[pImpl->gpuTimerIndex];
+    if (glIsQuery(oldestQuery)) {
+        GLint available = 0;
+        glGetQueryObjectiv(oldestQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(oldestQuery, GL_QUERY_RESULT, &elapsed);
+            pImpl->gpuFrameTime = (double)elapsed * 1e-6;
+        }
+    }
+    if (pImpl->adaptiveQuality && pImpl->governor->Update(cpuFrameTime, pImpl->gpuFrameTime)) {
+        ApplyQualityLevel();
+    }
+}
+
+// Draw the rolling CPU and GPU times of every profiler scope below the frame rate.
+void ScreenManager::DrawProfilerOverlay() {
+    const float lineHeight = 36.0f / pImpl->height;
+    float y = 0.9f - 1.5f * lineHeight;
+    char line[160];
+    snprintf(line, sizeof(line), "%-22s %23s %23s", "Scope (ms)", "CPU min/avg/p99", "GPU min/avg/p99");
+    glRasterPos2f(-0.95f, y);
+    glutBitmapString(GLUT_BITMAP_9_BY_15, (const unsigned char*)line);
+    for (const auto& stats : pImpl->profiler->GetStats()) {
+        y -= lineHeight;
+        std::string name = std::string(2 * stats.depth, ' ') + stats.name;
+        snprintf(line, sizeof(line), "%-22s %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f", name.c_str(),
+            stats.cpuMin, stats.cpuAvg, stats.cpuP99, stats.gpuMin, stats.gpuAvg, stats.gpuP99);
+        glRasterPos2f(-0.95f, y);
+        glutBitmapString(GLUT_BITMAP_9_BY_15, (const unsigned char*)line);
+    }
+}
+
+// Draw the GL call counts of the previous frame at the bottom of the window.
+void ScreenManager::DrawGLCallCounters() {
+    const auto& counts = GLCallCounters::GetLastFrame();
+    char line[256];
+    snprintf(line, sizeof(line), "GL calls: %d  Draws: %d  Programs: %d (+%d redundant)  Binds: %d buf %d vao %d tex %d fbo (%d redundant)",
+        counts.calls, counts.draws, counts.programSwitches, counts.redundantProgramSwitches, counts.bufferBinds,
+        counts.vertexArrayBinds, counts.textureBinds, counts.framebufferBinds, counts.redundantBinds);
+    glRasterPos2f(-0.95f, -0.88f);
+    glutBitmapString(GLUT_BITMAP_9_BY_15, (const unsigned char*)line);
+    snprintf(line, sizeof(line), "State changes: %d  Uniforms: %d  Uploads: %.1f KB buffers %.1f KB textures",
+        counts.stateChanges, counts.uniformUploads, counts.bufferBytes / 1024.0, counts.textureBytes / 1024.0);
+    glRasterPos2f(-0.95f, -0.94f);
+    glutBitmapString(GLUT_BITMAP_9_BY_15, (const unsigned char*)line);
+}
+
+// Render a fixed number of frames into the headless framebuffer, following the
+// camera path if one is given, and write the frame times, the profiler
+// statistics and the images to the output directory.
+void ScreenManager::RunHeadless() {
+    // One "eye.x eye.y eye.z target.x target.y target.z" key per line, # starts a comment.
+    std::vector<std::pair<glm::vec3, glm::vec3>> cameraPath;
+    if (!pImpl->cameraPathFile.empty()) {
+        std::ifstream fin(pImpl->cameraPathFile);
+        if (!fin) {
+            std::cerr << "[ERROR] Cannot open camera path " << pImpl->cameraPathFile << std::endl;
+            return;
+        }
+        std::string line;
+        while (std::getline(fin, line)) {
+            glm::vec3 eye;
+            glm::vec3 target;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            if (std::sscanf(line.c_str(), "%f %f %f %f %f %f", &eye.x, &eye.y, &eye.z, &target.x, &target.y, &target.z) == 6) {
+                cameraPath.push_back({ eye, target });
+            }
+        }
+    }
+    int numFrames = pImpl->headlessFrames;
+    if (numFrames == 0) {
+        numFrames = cameraPath.empty() ? 300 : (int)cameraPath.size();
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(pImpl->outputDir, ec);
+    std::ofstream timing(pImpl->outputDir / "timing.csv");
+    if (!timing) {
+        std::cerr << "[ERROR] Cannot write to " << pImpl->outputDir << std::endl;
+        return;
+    }
+
+    WaitForLoads();
+
+    timing << "frame,cpu_ms,frame_ms\n";
+    double totalFrameTime = 0.0;
+    for (int frame = 0; frame < numFrames; ++frame) {
+        if (!cameraPath.empty()) {
+            const auto& key = cameraPath[frame % cameraPath.size()];
+            pImpl->camera->UpdateView(key.first, key.second, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+        pImpl->headlessContext->Bind();
+        Clock frameClock;
+        RenderSceneCB();
+        double cpuTime = frameClock.GetElapsedTime() * 1000.0;
+        // Include the GPU work of the frame, as a swap would.
+        glFinish();
+        double frameTime = frameClock.GetElapsedTime() * 1000.0;
+        totalFrameTime += frameTime;
+        timing << frame << "," << cpuTime << "," << frameTime << "\n";
+
+        if (pImpl->saveFrames) {
+            char fileName[32];
+            snprintf(fileName, sizeof(fileName), "frame_%04d.png", frame);
+            pImpl->headlessContext->SaveImage(pImpl->outputDir / fileName);
+        }
+    }
+    if (!pImpl->saveFrames) {
+        pImpl->headlessContext->SaveImage(pImpl->outputDir / "last_frame.png");
+    }
+
+    std::ofstream profile(pImpl->outputDir / "profile.csv");
+    profile << "scope,depth,cpu_min_ms,cpu_avg_ms,cpu_p99_ms,gpu_min_ms,gpu_avg_ms,gpu_p99_ms\n";
+    for (const auto& stats : pImpl->profiler->GetStats()) {
+        profile << stats.name << "," << stats.depth << ","
+            << stats.cpuMin << "," << stats.cpuAvg << "," << stats.cpuP99 << ","
+            << stats.gpuMin << "," << stats.gpuAvg << "," << stats.gpuP99 << "\n";
+    }
+    std::cout << "Rendered " << numFrames << " headless frames, " << totalFrameTime / numFrames
+        << " ms on average, results in " << pImpl->outputDir << std::endl;
+}
+
+// Render headless frames until the skybox and the shader permutations are loaded,
+// so that every measured frame is complete. Nothing moves meanwhile.
+void ScreenManager::WaitForLoads() {
+    const bool rotationPaused = pImpl->simulation.rotationPaused;
+    pImpl->simulation.rotationPaused = true;
+    for (int i = 0; i < 1000; ++i) {
+        pImpl->headlessContext->Bind();
+        RenderSceneCB();
+        glFinish();
+        if (!HasPendingLoads()) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    pImpl->simulation.rotationPaused = rotationPaused;
+    pImpl->simulation.elapsedTime = 0.0;
+}
+
+// Play the benchmark timeline at its fixed time step, write the percentiles of
+// the measured frames as JSON, and compare them against the baseline.
+// Return false on errors and regressions.
+bool ScreenManager::RunBenchmark() {
+    BenchmarkTimeline timeline;
+    if (!timeline.LoadFromFile(pImpl->benchmarkFile)) {
+        return false;
+    }
+    if (!timeline.GetModel().empty()) {
+        auto it = std::find(pImpl->objNames.begin(), pImpl->objNames.end(), timeline.GetModel());
+        if (it == pImpl->objNames.end()) {
+            std::cerr << "[ERROR] Unknown benchmark model " << timeline.GetModel() << std::endl;
+            return false;
+        }
+        SetupScene((int)(it - pImpl->objNames.begin()));
+    }
+    if (!timeline.GetSkybox().empty()) {
+        auto it = std::find(pImpl->skyboxNames.begin(), pImpl->skyboxNames.end(), timeline.GetSkybox());
+        if (it == pImpl->skyboxNames.end()) {
+            std::cerr << "[ERROR] Unknown benchmark skybox " << timeline.GetSkybox() << std::endl;
+            return false;
+        }
+        SetupSkybox((int)(it - pImpl->skyboxNames.begin()));
+    }
+    pImpl->fixedTimeStep = timeline.GetTimeStep();
+    WaitForLoads();
+
+    BenchmarkReport report(timeline.GetName());
+    const int numFrames = timeline.GetNumWarmupFrames() + timeline.GetNumMeasuredFrames();
+    for (int frame = 0; frame < numFrames; ++frame) {
+        const double time = frame * timeline.GetTimeStep();
+        glm::vec3 eye;
+        glm::vec3 target;
+        if (timeline.SampleCamera(time, eye, target)) {
+            pImpl->camera->UpdateView(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+        glm::vec3 position;
+        if (pImpl->pointLightObj->light != nullptr && timeline.SamplePointLight(time, position)) {
+            pImpl->pointLightObj->light->SetPosition(position);
+        }
+        if (pImpl->spotLightObj->light != nullptr && timeline.SampleSpotLight(time, position)) {
+            pImpl->spotLightObj->light->SetPosition(position);
+        }
+
+        pImpl->headlessContext->Bind();
+        const uint64_t numAllocations = AllocationCounters::GetNumAllocations();
+        const int numDecisions = pImpl->governor->GetNumDecisions();
+        Clock frameClock;
+        RenderSceneCB();
+        double cpuTime = frameClock.GetElapsedTime() * 1000.0;
+        const uint64_t numFrameAllocations = AllocationCounters::GetNumAllocations() - numAllocations;
+        glFinish();
+        if (frame >= timeline.GetNumWarmupFrames()) {
+            // The GPU time lags two frames behind, the warm-up frames cover the gap.
+            report.AddFrame(cpuTime, pImpl->gpuFrameTime,
+                pImpl->sceneObj->mesh->GetNumDrawCalls(), pImpl->sceneObj->mesh->GetNumTrianglesDrawn());
+            report.AddGLCallCounts(GLCallCounters::GetCurrentFrame());
+            // A quality change resizes the targets, the frame is not a steady-state one.
+            if (pImpl->governor->GetNumDecisions() == numDecisions) {
+                report.AddAllocations(numFrameAllocations);
+            }
+        }
+    }
+    report.Summarize();
+
+    std::error_code ec;
+    std::filesystem::create_directories(pImpl->outputDir, ec);
+    const auto reportFile = pImpl->outputDir / (timeline.GetName() + ".json");
+    if (!report.WriteJson(reportFile)) {
+        return false;
+    }
+    std::cout << "[Benchmark] " << timeline.GetName() << ": CPU p50/p95/p99 "
+        << report.GetCpuFrameTime().p50 << "/" << report.GetCpuFrameTime().p95 << "/" << report.GetCpuFrameTime().p99
+        << " ms, GPU p50/p95/p99 "
+        << report.GetGpuFrameTime().p50 << "/" << report.GetGpuFrameTime().p95 << "/" << report.GetGpuFrameTime().p99
+        << " ms, written to " << reportFile << std::endl;
+    // The warm-up frames grow the arena and the queues, after them a frame allocates nothing.
+    if (report.GetNumAllocatingFrames() > 0) {
+        std::cerr << "[ERROR] " << report.GetNumAllocatingFrames()
+            << " measured frames allocated from the heap" << std::endl;
+        return false;
+    }
+
+    if (pImpl->baselineFile.empty()) {
+        return true;
+    }
+    BenchmarkReport baseline("baseline");
+    if (!baseline.LoadJson(pImpl->baselineFile)) {
+        return false;
+    }
+    int numRegressions = report.CountRegressions(baseline, pImpl->regressionThreshold);
+    if (numRegressions > 0) {
+        std::cerr << "[Benchmark] " << numRegressions << " metrics regressed by more than "
+            << pImpl->regressionThreshold * 100.0 << "%" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Resize the render targets and the shadow maps to the current quality level,
+// or to the full quality when the governor is off.
+void ScreenManager::ApplyQualityLevel() {
+    QualityGovernor::QualityLevel level = { 1.0f, 1, 1024, 0.0f };
+    if (pImpl->adaptiveQuality) {
+        level = pImpl->governor->GetLevel();
+    }
+    pImpl->renderWidth = std::max(1, (int)(pImpl->width * level.renderScale));
+    pImpl->renderHeight = std::max(1, (int)(pImpl->height * level.renderScale));
+    if (pImpl->adaptiveQuality) {
+        pImpl->sceneTarget->Resize(pImpl->renderWidth, pImpl->renderHeight, level.msaaSamples);
+    }
+    pImpl->deferredRenderer->Resize(pImpl->renderWidth, pImpl->renderHeight);
+    pImpl->visibilityBuffer->Resize(pImpl->renderWidth, pImpl->renderHeight);
+    pImpl->shadowAtlas->SetTileSize(level.shadowTileSize);
+    // The material textures are bound to unit 0. The bias of the texture unit
+    // applies to the texture lookups of the shaders in the compatibility profile.
+    glActiveTexture(GL_TEXTURE0);
+    glTexEnvf(GL_TEXTURE_FILTER_CONTROL, GL_TEXTURE_LOD_BIAS, level.lodBias);
+}
+
+// Gather the point and spot lights in view space for the clustered and deferred paths.
+void ScreenManager::GatherLights() {
+    const glm::mat4x4& V = pImpl->camera->GetViewMatrix();
+    pImpl->clusterLights.clear();
+    const auto& pointLight = pImpl->pointLightObj->light;
+    if (pointLight != nullptr) {
+        pImpl->clusterLights.push_back(LightClusterGrid::MakePointLight(pointLight->GetPosition(), pointLight->GetIntensity(), V));
+    }
+    const auto& spotLight = pImpl->spotLightObj->light;
+    if (spotLight != nullptr) {
+        pImpl->clusterLights.push_back(LightClusterGrid::MakeSpotLight(*spotLight, V));
+    }
+    for (const auto& demoLight : pImpl->frame->demoLights) {
+        pImpl->clusterLights.push_back(LightClusterGrid::MakePointLight(demoLight.position, demoLight.intensity, V));
+    }
+}
+
+// Assign the lights to the froxels and upload the light lists for the clustered shader.
+void ScreenManager::UpdateLightClusters() {
+    GatherLights();
+
+    pImpl->lightGrid->Build(pImpl->camera->GetProjMatrix(), pImpl->clusterLights);
+    pImpl->lightGrid->Upload(pImpl->clusterLights, glm::vec2((float)pImpl->renderWidth, (float)pImpl->renderHeight));
+    pImpl->lightGrid->Bind();
+}
+
+// Queue the input of a GLUT callback for the simulation. A full queue drops
+// the event, which takes 256 inputs within one frame.
+void ScreenManager::PushInput(const InputEvent& event) {
+    if (pImpl->inputEvents.Push(event)) {
+        ++pImpl->numInputEventsPushed;
+    }
+}
+
+// Step the simulation on its own thread, one snapshot ahead of the rendering.
+void ScreenManager::StartSimulation() {
+    pImpl->simulationThread = std::thread(&ScreenManager::SimulationMain, this);
+}
+
+void ScreenManager::SimulationMain() {
+    TraceRecorder::SetThreadName("Simulation");
+    while (true) {
+        const uint64_t numConsumed = pImpl->numSnapshotsConsumed.load();
+        if (pImpl->simulationQuit) {
+            return;
+        }
+        // Keep a single snapshot ready, so that it is at most one frame old.
+        int slot = -1;
+        if (pImpl->readySnapshots.IsEmpty() && pImpl->freeSnapshots.Pop(slot)) {
+            TraceScope trace("Simulate");
+            Simulate(pImpl->snapshots[slot]);
+            pImpl->readySnapshots.Push(slot);
+        }
+        pImpl->numSnapshotsConsumed.wait(numConsumed);
+    }
+}
+
+// Apply the queued input and advance the animation into the snapshot.
+void ScreenManager::Simulate(FrameSnapshot& snapshot) {
+    SimulationState& simulation = pImpl->simulation;
+    if (pImpl->resetSimulationClock.exchange(false)) {
+        simulation.clock.Reset();
+    }
+    double deltaTime = simulation.clock.GetElapsedTime();
+    simulation.clock.Reset();
+    if (pImpl->fixedTimeStep > 0.0) {
+        deltaTime = pImpl->fixedTimeStep;
+    }
+    if (pImpl->onDemandRendering) {
+        // Nothing animated while no frame was drawn, so do not jump over the idle time.
+        deltaTime = std::min(deltaTime, 2.0 / pImpl->animationFrameRate);
+    }
+
+    snapshot.pointLightMoved = false;
+    snapshot.spotLightMoved = false;
+    snapshot.renderEvents.clear();
+    InputEvent event;
+    while (pImpl->inputEvents.Pop(event)) {
+        ++simulation.numInputEvents;
+        ApplySimulationInput(event, snapshot);
+    }
+
+    simulation.elapsedTime += deltaTime;
+    snapshot.deltaTime = deltaTime;
+    snapshot.elapsedTime = simulation.elapsedTime;
+    snapshot.rotationPaused = simulation.rotationPaused;
+    snapshot.rotationAngle = simulation.rotationPaused ? 0.0f : (float)(0.1 * deltaTime);
+    snapshot.pointLightPosition = simulation.pointLightPosition;
+    snapshot.spotLightPosition = simulation.spotLightPosition;
+    // The snapshots are reused, so their vectors stop growing after a few frames.
+    snapshot.demoLights.resize(simulation.demoLights.size());
+    for (size_t i = 0; i < simulation.demoLights.size(); ++i) {
+        const DemoLight& demoLight = simulation.demoLights[i];
+        snapshot.demoLights[i].position = demoLight.GetPosition((float)simulation.elapsedTime);
+        snapshot.demoLights[i].intensity = demoLight.intensity;
+    }
+    snapshot.numInputEvents = simulation.numInputEvents;
+}
+
+// Move the lights, add or remove the demo lights and pause the rotation here,
+// and pass the other input on to the render thread.
+void ScreenManager::ApplySimulationInput(const InputEvent& event, FrameSnapshot& snapshot) {
+    SimulationState& simulation = pImpl->simulation;
+    const float step = 0.1f * pImpl->lightMoveSpeed;
+    if (event.type == InputEvent::Type::SpecialKey) {
+        // Light control.
+        glm::vec3 offset = glm::vec3(0.0f);
+        switch (event.value) {
+        case GLUT_KEY_LEFT:
+            offset = glm::vec3(-step, 0.0f, 0.0f);
+            break;
+        case GLUT_KEY_RIGHT:
+            offset = glm::vec3(step, 0.0f, 0.0f);
+            break;
+        case GLUT_KEY_UP:
+            offset = glm::vec3(0.0f, step, 0.0f);
+            break;
+        case GLUT_KEY_DOWN:
+            offset = glm::vec3(0.0f, -step, 0.0f);
+            break;
+        default:
+            return;
+        }
+        if (simulation.hasPointLight) {
+            simulation.pointLightPosition += offset;
+            snapshot.pointLightMoved = true;
+        }
+        return;
+    }
+    if (event.type != InputEvent::Type::Key) {
+        snapshot.renderEvents.push_back(event);
+        return;
+    }
+
+    const unsigned char key = (unsigned char)event.value;
+    if (key == '+' || key == '=') {
+        // Deterministic so that runs can be compared.
+        std::mt19937 rng((unsigned int)simulation.demoLights.size());
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < 64; ++i) {
+            DemoLight demoLight;
+            glm::vec3 color = glm::vec3(unit(rng), unit(rng), unit(rng));
+            demoLight.intensity = 0.01f * color / std::max(color.r, std::max(color.g, color.b));
+            demoLight.orbitRadius = 0.3f + 1.7f * unit(rng);
+            demoLight.height = 1.6f * unit(rng) - 0.8f;
+            demoLight.speed = 2.0f * unit(rng) - 1.0f;
+            demoLight.phase = glm::two_pi<float>() * unit(rng);
+            simulation.demoLights.push_back(demoLight);
+        }
+        std::cout << "Demo lights: " << simulation.demoLights.size() << std::endl;
+    }
+    else if (key == '-') {
+        if (!simulation.demoLights.empty()) {
+            simulation.demoLights.resize(simulation.demoLights.size() - std::min((size_t)64, simulation.demoLights.size()));
+            std::cout << "Demo lights: " << simulation.demoLights.size() << std::endl;
+        }
+    }
+    else if (key == 'p') {
+        simulation.rotationPaused = !simulation.rotationPaused;
+        std::cout << "Rotation: " << (simulation.rotationPaused ? "paused" : "running") << std::endl;
+    }
+    else if (key == 'a' || key == 'd' || key == 'w' || key == 's') {
+        // Spot light control.
+        if (simulation.hasSpotLight) {
+            if (key == 'a')
+                simulation.spotLightPosition.x -= step;
+            if (key == 'd')
+                simulation.spotLightPosition.x += step;
+            if (key == 'w')
+                simulation.spotLightPosition.y += step;
+            if (key == 's')
+                simulation.spotLightPosition.y -= step;
+            snapshot.spotLightMoved = true;
+        }
+    }
+    else {
+        snapshot.renderEvents.push_back(event);
+    }
+}
+
+// Take the newest snapshot and hand the previous one back to the simulation.
+// Without a simulation thread, as in the headless runs, simulate here.
+void ScreenManager::AcquireSnapshot() {
+    if (!pImpl->simulationThread.joinable()) {
+        Simulate(pImpl->snapshots[0]);
+        pImpl->currentSnapshot = 0;
+        pImpl->frame = &pImpl->snapshots[0];
+        return;
+    }
+    int slot = -1;
+    while (!pImpl->readySnapshots.Pop(slot)) {
+        std::this_thread::yield();
+    }
+    if (pImpl->currentSnapshot >= 0) {
+        pImpl->freeSnapshots.Push(pImpl->currentSnapshot);
+    }
+    pImpl->currentSnapshot = slot;
+    pImpl->frame = &pImpl->snapshots[slot];
+    ++pImpl->numSnapshotsConsumed;
+    pImpl->numSnapshotsConsumed.notify_one();
+}
+
+// Apply the input the simulation passed on, and place the lights it moved.
+void ScreenManager::ApplySnapshot(const FrameSnapshot& snapshot) {
+    for (const auto& event : snapshot.renderEvents) {
+        switch (event.type) {
+        case InputEvent::Type::Key:
+            ApplyRenderKey((unsigned char)event.value);
+            break;
+        case InputEvent::Type::ModelMenu:
+            SetupScene(event.value);
+            break;
+        case InputEvent::Type::SkyboxMenu:
+            SetupSkybox(event.value);
+            break;
+        default:
+            break;
+        }
+    }
+    const auto& pointLight = pImpl->pointLightObj->light;
+    if (snapshot.pointLightMoved && pointLight != nullptr) {
+        pointLight->SetPosition(snapshot.pointLightPosition);
+        if (pointLight->GetShadowMap() != nullptr) {
+            pointLight->GetShadowMap()->Invalidate();
+        }
+    }
+    const auto& spotLight = pImpl->spotLightObj->light;
+    if (snapshot.spotLightMoved && spotLight != nullptr) {
+        spotLight->SetPosition(snapshot.spotLightPosition);
+        pImpl->shadowAtlas->InvalidateSpotLight();
+    }
 }
 
 void ScreenManager::SetupMenu() {
-    int skyboxMenu = glutCreateMenu([](int value) { GetInstance()->SkyboxMenuCB(value); });
+    int skyboxMenu = glutCreateMenu([](int value) { GetInstance()->SkyboxMenuCB(value); glutPostRedisplay(); });
     for (int i = 0; i < pImpl->skyboxNames.size(); i++) {
         glutAddMenuEntry(pImpl->skyboxNames[i].c_str(), i + 1);
     }
 
-    int objMenu = glutCreateMenu([](int value) { GetInstance()->ObjectMenuCB(value); });
+    int objMenu = glutCreateMenu([](int value) { GetInstance()->ObjectMenuCB(value); glutPostRedisplay(); });
     for (int i = 0; i < pImpl->objNames.size(); i++) {
         glutAddMenuEntry(pImpl->objNames[i].c_str(), i + 1);
     }
@@ -439,11 +1675,11 @@ void ScreenManager::MainMenuCB(int value) {
 }
 
 void ScreenManager::ObjectMenuCB(int value) {
-    SetupScene(value - 1);
+    PushInput({ InputEvent::Type::ModelMenu, value - 1 });
 }
 
 void ScreenManager::SkyboxMenuCB(int value) {
-    SetupSkybox(value - 1);
+    PushInput({ InputEvent::Type::SkyboxMenu, value - 1 });
 }
 
 } // namespace opengl_homework
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <random>
 
 #define MAX_BUFFER_SIZE 1024
 
@@ -14,54 +17,117 @@ ShaderProg::ShaderProg() {
     }
     // locM = locV = locP = -1;
     locMVP = -1;
+    status = EMPTY;
 }
 
 ShaderProg::~ShaderProg() {
+    ReleaseShaders();
     glDeleteProgram(shaderProgId);
 }
 
-bool ShaderProg::LoadFromFiles(const std::filesystem::path& vsFilePath, const std::filesystem::path& fsFilePath, const std::filesystem::path& gsFilePath) {
-    // Load the vertex shader from a source file and attach it to the shader program.
+std::filesystem::path ShaderProg::binaryCacheDir = "shader_cache";
+
+bool ShaderProg::LoadFromFiles(const std::filesystem::path& vsFilePath, const std::filesystem::path& fsFilePath, const std::filesystem::path& gsFilePath,
+    const std::vector<std::string>& defines) {
+    return Submit(vsFilePath, fsFilePath, gsFilePath, defines) && Finish();
+}
+
+bool ShaderProg::Submit(const std::filesystem::path& vsFilePath, const std::filesystem::path& fsFilePath, const std::filesystem::path& gsFilePath,
+    const std::vector<std::string>& defines) {
+    // Load the shader sources.
     std::string vs, fs, gs;
     if (!LoadShaderTextFromFile(vsFilePath, vs)) {
         std::cerr << "[ERROR] Failed to load vertex shader source: " << vsFilePath << std::endl;
+        status = FAILED;
         return false;
     }
-    GLuint vsId = AddShader(vs, GL_VERTEX_SHADER);
+    InjectDefines(defines, vs);
 
-    // Load the fragment shader from a source file and attach it to the shader program.
     if (!LoadShaderTextFromFile(fsFilePath, fs)) {
         std::cerr << "[ERROR] Failed to load vertex shader source: " << fsFilePath << std::endl;
+        status = FAILED;
         return false;
     };
-    GLuint fsId = AddShader(fs, GL_FRAGMENT_SHADER);
+    InjectDefines(defines, fs);
 
-    GLuint gsId = 0;
     if (!gsFilePath.empty()) {
         if (!LoadShaderTextFromFile(gsFilePath, gs)) {
             std::cerr << "[ERROR] Failed to load vertex shader source: " << gsFilePath << std::endl;
+            status = FAILED;
             return false;
         };
-        gsId = AddShader(gs, GL_GEOMETRY_SHADER);
+        InjectDefines(defines, gs);
+    }
+
+    // Reuse the binary linked by a previous run if the driver still accepts it.
+    binaryPath = GetBinaryCachePath(vs + '\0' + fs + '\0' + gs);
+    if (!binaryPath.empty() && LoadProgramBinary(binaryPath)) {
+        binaryPath.clear();
+        GetUniformVariableLocation();
+        status = READY;
+        return true;
+    }
+
+    // Compile and attach the shaders to the shader program. Nothing below queries
+    // a status, so the driver is free to compile and link in the background.
+    shaderIds.push_back(AddShader(vs, GL_VERTEX_SHADER));
+    shaderIds.push_back(AddShader(fs, GL_FRAGMENT_SHADER));
+    if (!gs.empty()) {
+        shaderIds.push_back(AddShader(gs, GL_GEOMETRY_SHADER));
+    }
+
+    if (!binaryPath.empty()) {
+        glProgramParameteri(shaderProgId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(shaderProgId);
+    status = COMPILING;
+    return true;
+}
+
+bool ShaderProg::IsReady() {
+    if (status == COMPILING && (GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile)) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(shaderProgId, GL_COMPLETION_STATUS_KHR, &completed);
+        if (!completed) {
+            return false;
+        }
+    }
+    // Without the extension the first query waits for the link, as before.
+    if (status == COMPILING) {
+        Finish();
+    }
+    return status == READY;
+}
+
+bool ShaderProg::Finish() {
+    if (status != COMPILING) {
+        return status == READY;
     }
 
     // Link and compile shader programs.
     GLint success = 0;
     GLchar errorLog[MAX_BUFFER_SIZE] = { 0 };
-    glLinkProgram(shaderProgId);
     glGetProgramiv(shaderProgId, GL_LINK_STATUS, &success);
     if (success == 0) {
+        for (GLuint shaderId : shaderIds) {
+            GLint compiled = 0;
+            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &compiled);
+            if (!compiled) {
+                GLint shaderType = 0;
+                glGetShaderiv(shaderId, GL_SHADER_TYPE, &shaderType);
+                glGetShaderInfoLog(shaderId, sizeof(errorLog), NULL, errorLog);
+                std::cerr << "[ERROR] Failed to compile shader with type: " << shaderType << ". Info: " << errorLog << std::endl;
+            }
+        }
         glGetProgramInfoLog(shaderProgId, sizeof(errorLog), NULL, errorLog);
         std::cerr << "[ERROR] Failed to link shader program: " << errorLog << std::endl;
+        ReleaseShaders();
+        status = FAILED;
         return false;
     }
 
     // Now the program already has all stage information, we can delete the shaders now.
-    glDeleteShader(vsId);
-    glDeleteShader(fsId);
-    if (gsId != 0) {
-        glDeleteShader(gsId);
-    }
+    ReleaseShaders();
 
     // Validate program.
     glValidateProgram(shaderProgId);
@@ -69,15 +135,133 @@ bool ShaderProg::LoadFromFiles(const std::filesystem::path& vsFilePath, const st
     if (!success) {
         glGetProgramInfoLog(shaderProgId, sizeof(errorLog), NULL, errorLog);
         std::cerr << "[ERROR] Invalid shader program: " << errorLog << std::endl;
+        status = FAILED;
         return false;
     }
 
+    if (!binaryPath.empty()) {
+        SaveProgramBinary(binaryPath);
+        binaryPath.clear();
+    }
+
     // Update the location of uniform variables.
     GetUniformVariableLocation();
 
+    status = READY;
     return true;
 }
 
+// Desc: Let the driver use as many compiler threads as it likes for programs
+// submitted afterwards. Does nothing without GL_KHR_parallel_shader_compile.
+void ShaderProg::EnableParallelCompile() {
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    }
+    else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    }
+}
+
+void ShaderProg::SetBinaryCacheDir(const std::filesystem::path& dir) {
+    binaryCacheDir = dir;
+}
+
+// Desc: Name the cached binary after a 64-bit FNV-1a hash of the sources (with the
+// injected defines) and the driver strings, since a binary is only valid for the
+// driver that produced it. Returns an empty path if the cache cannot be used.
+std::filesystem::path ShaderProg::GetBinaryCachePath(const std::string& sourceText) {
+    if (binaryCacheDir.empty() || !GLEW_ARB_get_program_binary) {
+        return std::filesystem::path();
+    }
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats <= 0) {
+        return std::filesystem::path();
+    }
+
+    std::string key = sourceText;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const GLubyte* value = glGetString(name);
+        key += '\0';
+        key += value != nullptr ? (const char*)value : "";
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long)hash);
+    return binaryCacheDir / fileName;
+}
+
+bool ShaderProg::LoadProgramBinary(const std::filesystem::path& binaryPath) {
+    std::ifstream binaryFile(binaryPath, std::ios::binary);
+    if (!binaryFile) {
+        return false;
+    }
+    // An empty or truncated file is compiled again instead of handed to the driver.
+    GLenum format = 0;
+    if (!binaryFile.read((char*)&format, sizeof(format))) {
+        return false;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(binaryFile)), std::istreambuf_iterator<char>());
+    if ((!binaryFile.eof() && binaryFile.fail()) || binary.empty()) {
+        return false;
+    }
+
+    // The driver rejects binaries from other versions by failing the link status.
+    GLint success = 0;
+    glProgramBinary(shaderProgId, format, binary.data(), (GLsizei)binary.size());
+    glGetProgramiv(shaderProgId, GL_LINK_STATUS, &success);
+    if (success == 0) {
+        std::cerr << "[WARNING] Program binary rejected, recompiling: " << binaryPath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ShaderProg::SaveProgramBinary(const std::filesystem::path& binaryPath) {
+    GLint length = 0;
+    glGetProgramiv(shaderProgId, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(shaderProgId, length, nullptr, &format, binary.data());
+
+    // Write to a temporary file first so other instances never read a partial binary.
+    // The name is unique so that instances saving the same program never share it.
+    std::error_code error;
+    std::filesystem::create_directories(binaryPath.parent_path(), error);
+    std::random_device random;
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%08x%08x.tmp", random(), random());
+    std::filesystem::path tmpPath = binaryPath;
+    tmpPath += suffix;
+    {
+        std::ofstream binaryFile(tmpPath, std::ios::binary);
+        if (!binaryFile) {
+            std::cerr << "[WARNING] Failed to write program binary: " << binaryPath << std::endl;
+            return;
+        }
+        binaryFile.write((const char*)&format, sizeof(format));
+        binaryFile.write(binary.data(), binary.size());
+        if (!binaryFile) {
+            binaryFile.close();
+            std::filesystem::remove(tmpPath, error);
+            std::cerr << "[WARNING] Failed to write program binary: " << binaryPath << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, binaryPath, error);
+    if (error) {
+        std::filesystem::remove(tmpPath, error);
+    }
+}
+
 void ShaderProg::GetUniformVariableLocation() {
     locMVP = glGetUniformLocation(shaderProgId, "MVP");
 }
@@ -96,20 +280,20 @@ GLuint ShaderProg::AddShader(const std::string& sourceText, GLenum shaderType) {
     glShaderSource(shaderObj, 1, p, lengths);
     glCompileShader(shaderObj);
 
-    GLint success;
-    glGetShaderiv(shaderObj, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLchar infoLog[MAX_BUFFER_SIZE];
-        glGetShaderInfoLog(shaderObj, MAX_BUFFER_SIZE, NULL, infoLog);
-        std::cerr << "[ERROR] Failed to compile shader with type: " << shaderType << ". Info: " << infoLog << std::endl;
-        exit(1);
-    }
-
+    // The compile status is checked in Finish() so the compile is not forced to complete here.
     glAttachShader(shaderProgId, shaderObj);
 
     return shaderObj;
 }
 
+void ShaderProg::ReleaseShaders() {
+    for (GLuint shaderId : shaderIds) {
+        glDetachShader(shaderProgId, shaderId);
+        glDeleteShader(shaderId);
+    }
+    shaderIds.clear();
+}
+
 bool ShaderProg::LoadShaderTextFromFile(const std::filesystem::path& filePath, std::string& sourceText) {
     std::ifstream sourceFile(filePath);
     if (!sourceFile) {
@@ -120,6 +304,23 @@ bool ShaderProg::LoadShaderTextFromFile(const std::filesystem::path& filePath, s
     return true;
 }
 
+// Insert the macros after the #version directive, which must stay the first statement.
+void ShaderProg::InjectDefines(const std::vector<std::string>& defines, std::string& sourceText) {
+    if (defines.empty()) {
+        return;
+    }
+    std::string defineText;
+    for (const auto& define : defines) {
+        defineText += "#define " + define + "\n";
+    }
+    size_t insertPos = 0;
+    if (sourceText.compare(0, 8, "#version") == 0) {
+        size_t lineEnd = sourceText.find('\n');
+        insertPos = (lineEnd == std::string::npos) ? sourceText.size() : lineEnd + 1;
+    }
+    sourceText.insert(insertPos, defineText);
+}
+
 // ------------------------------------------------------------------------------------------------
 
 FillColorShaderProg::FillColorShaderProg() {
@@ -134,6 +335,36 @@ void FillColorShaderProg::GetUniformVariableLocation() {
     locFillColor = glGetUniformLocation(shaderProgId, "fillColor");
 }
 
+// ------------------------------------------------------------------------------------------------
+
+DepthOnlyShaderProg::DepthOnlyShaderProg() {
+}
+
+DepthOnlyShaderProg::~DepthOnlyShaderProg() {
+}
+
+void DepthOnlyShaderProg::GetUniformVariableLocation() {
+    ShaderProg::GetUniformVariableLocation();
+}
+
+// ------------------------------------------------------------------------------------------------
+
+PointShadowShaderProg::PointShadowShaderProg() {
+    locM = -1;
+    locFaceViewProj = -1;
+    locFaceLayers = -1;
+}
+
+PointShadowShaderProg::~PointShadowShaderProg() {
+}
+
+void PointShadowShaderProg::GetUniformVariableLocation() {
+    ShaderProg::GetUniformVariableLocation();
+    locM = glGetUniformLocation(shaderProgId, "worldMatrix");
+    locFaceViewProj = glGetUniformLocation(shaderProgId, "faceViewProj");
+    locFaceLayers = glGetUniformLocation(shaderProgId, "faceLayers");
+}
+
 // ------------------------------------------------------------------------------------------------
 PhongShadingDemoShaderProg::PhongShadingDemoShaderProg() {
     locM = -1;
@@ -154,6 +385,12 @@ PhongShadingDemoShaderProg::PhongShadingDemoShaderProg() {
     locSpotLightIntensity = -1;
     locSpotLightCutoff = -1;
     locSpotLightTotalWidth = -1;
+    locShadowAtlas = -1;
+    locCascadeShadowMatrices = -1;
+    locCascadeSplits = -1;
+    locSpotShadowMatrix = -1;
+    locPointShadowMap = -1;
+    locPointShadowDepth = -1;
 }
 
 PhongShadingDemoShaderProg::~PhongShadingDemoShaderProg() {
@@ -179,6 +416,12 @@ void PhongShadingDemoShaderProg::GetUniformVariableLocation() {
     locSpotLightIntensity = glGetUniformLocation(shaderProgId, "spotLightIntensity");
     locSpotLightCutoff = glGetUniformLocation(shaderProgId, "spotLightCutoff");
     locSpotLightTotalWidth = glGetUniformLocation(shaderProgId, "spotLightTotalWidth");
+    locShadowAtlas = glGetUniformLocation(shaderProgId, "shadowAtlas");
+    locCascadeShadowMatrices = glGetUniformLocation(shaderProgId, "cascadeShadowMatrices");
+    locCascadeSplits = glGetUniformLocation(shaderProgId, "cascadeSplits");
+    locSpotShadowMatrix = glGetUniformLocation(shaderProgId, "spotShadowMatrix");
+    locPointShadowMap = glGetUniformLocation(shaderProgId, "pointShadowMap");
+    locPointShadowDepth = glGetUniformLocation(shaderProgId, "pointShadowDepth");
     locAmbientLight = glGetUniformLocation(shaderProgId, "ambientLight");
 }
 
@@ -187,6 +430,7 @@ void PhongShadingDemoShaderProg::GetUniformVariableLocation() {
 SkyboxShaderProg::SkyboxShaderProg()
 {
     locMapKd = -1;
+    locInvViewProj = -1;
 }
 
 SkyboxShaderProg::~SkyboxShaderProg()
@@ -196,4 +440,114 @@ void SkyboxShaderProg::GetUniformVariableLocation()
 {
     ShaderProg::GetUniformVariableLocation();
     locMapKd = glGetUniformLocation(shaderProgId, "mapKd");
+    locInvViewProj = glGetUniformLocation(shaderProgId, "invViewProj");
+}
+
+// ------------------------------------------------------------------------------------------------
+
+DeferredLightingShaderProg::DeferredLightingShaderProg() {
+    locAlbedoNs = -1;
+    locSpecular = -1;
+    locNormal = -1;
+    locAmbient = -1;
+    locDepth = -1;
+    locP = -1;
+    locInvP = -1;
+    locDirLightDir = -1;
+    locDirLightRadiance = -1;
+}
+
+DeferredLightingShaderProg::~DeferredLightingShaderProg() {
+}
+
+void DeferredLightingShaderProg::GetUniformVariableLocation() {
+    ShaderProg::GetUniformVariableLocation();
+    locAlbedoNs = glGetUniformLocation(shaderProgId, "gAlbedoNs");
+    locSpecular = glGetUniformLocation(shaderProgId, "gSpecular");
+    locNormal = glGetUniformLocation(shaderProgId, "gNormal");
+    locAmbient = glGetUniformLocation(shaderProgId, "gAmbient");
+    locDepth = glGetUniformLocation(shaderProgId, "gDepth");
+    locP = glGetUniformLocation(shaderProgId, "projMatrix");
+    locInvP = glGetUniformLocation(shaderProgId, "invProjMatrix");
+    locDirLightDir = glGetUniformLocation(shaderProgId, "dirLightDir");
+    locDirLightRadiance = glGetUniformLocation(shaderProgId, "dirLightRadiance");
+}
+
+// ------------------------------------------------------------------------------------------------
+
+VisibilityShaderProg::VisibilityShaderProg() {
+    locDrawId = -1;
+    locFirstTriangle = -1;
+}
+
+VisibilityShaderProg::~VisibilityShaderProg() {
+}
+
+void VisibilityShaderProg::GetUniformVariableLocation() {
+    ShaderProg::GetUniformVariableLocation();
+    locDrawId = glGetUniformLocation(shaderProgId, "drawId");
+    locFirstTriangle = glGetUniformLocation(shaderProgId, "firstTriangle");
+}
+
+// ------------------------------------------------------------------------------------------------
+
+VisibilityResolveShaderProg::VisibilityResolveShaderProg() {
+    locVisibilityIds = -1;
+    locVisibilityDepth = -1;
+    locDrawId = -1;
+    locScreenSize = -1;
+}
+
+VisibilityResolveShaderProg::~VisibilityResolveShaderProg() {
+}
+
+void VisibilityResolveShaderProg::GetUniformVariableLocation() {
+    PhongShadingDemoShaderProg::GetUniformVariableLocation();
+    locVisibilityIds = glGetUniformLocation(shaderProgId, "visibilityIds");
+    locVisibilityDepth = glGetUniformLocation(shaderProgId, "visibilityDepth");
+    locDrawId = glGetUniformLocation(shaderProgId, "drawId");
+    locScreenSize = glGetUniformLocation(shaderProgId, "screenSize");
+}
+
+// ------------------------------------------------------------------------------------------------
+
+UpscaleShaderProg::UpscaleShaderProg() {
+    locSceneTexture = -1;
+    locOutputSize = -1;
+}
+
+UpscaleShaderProg::~UpscaleShaderProg() {
+}
+
+void UpscaleShaderProg::GetUniformVariableLocation() {
+    ShaderProg::GetUniformVariableLocation();
+    locSceneTexture = glGetUniformLocation(shaderProgId, "sceneTexture");
+    locOutputSize = glGetUniformLocation(shaderProgId, "outputSize");
+}
+
+// ------------------------------------------------------------------------------------------------
+
+DrawSubmissionShaderProg::DrawSubmissionShaderProg() {
+    locWorldMatrix = -1;
+    locNormalMatrix = -1;
+    locKa = -1;
+    locKd = -1;
+    locKs = -1;
+}
+
+DrawSubmissionShaderProg::~DrawSubmissionShaderProg() {
+}
+
+void DrawSubmissionShaderProg::GetUniformVariableLocation() {
+    ShaderProg::GetUniformVariableLocation();
+    locWorldMatrix = glGetUniformLocation(shaderProgId, "worldMatrix");
+    locNormalMatrix = glGetUniformLocation(shaderProgId, "normalMatrix");
+    locKa = glGetUniformLocation(shaderProgId, "Ka");
+    locKd = glGetUniformLocation(shaderProgId, "Kd");
+    locKs = glGetUniformLocation(shaderProgId, "Ks");
+    // GLSL 3.30 has no binding qualifier.
+    GLuint blockIndex = glGetUniformBlockIndex(shaderProgId, "DrawBlock");
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shaderProgId, blockIndex, kDrawBlockBinding);
+    }
 }
@@ -0,0 +1,331 @@
+#include "ShadowAtlas.h"
+
+// GLM headers.
+#include <glm/gtc/matrix_transform.hpp>
+
+// C++ STL headers.
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Project headers.
+#include "GLCallCounters.h"
+
+// Blend between uniform and logarithmic cascade splits.
+static constexpr float kCascadeSplitLambda = 0.75f;
+
+glm::vec4 ShadowCaster::GetBoundingSphere() const {
+	glm::vec4 sphere = mesh->GetBoundingSphere();
+	float scale = std::max(glm::length(glm::vec3(worldMatrix[0])),
+		std::max(glm::length(glm::vec3(worldMatrix[1])), glm::length(glm::vec3(worldMatrix[2]))));
+	return glm::vec4(glm::vec3(worldMatrix * glm::vec4(glm::vec3(sphere), 1.0f)), scale * sphere.w);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+ShadowAtlas::ShadowAtlas(const int tileSize, const float shadowDistance) {
+	this->tileSize = tileSize;
+	this->shadowDistance = shadowDistance;
+	cascadeSplits = glm::vec3(0.0f, 0.0f, 0.0f);
+	numPassesRendered = 0;
+	numPassesSkipped = 0;
+	for (int i = 0; i < kNumViews; ++i) {
+		shadowMatrices[i] = glm::mat4(1.0f);
+	}
+	CreateTargets();
+}
+
+ShadowAtlas::~ShadowAtlas() {
+	ReleaseTargets();
+}
+
+// Desc: Recreate the atlas at another resolution. The texel snapping of the
+// cascades depends on the tile size, so every view is rendered again.
+void ShadowAtlas::SetTileSize(const int tileSize) {
+	if (tileSize == this->tileSize) {
+		return;
+	}
+	this->tileSize = tileSize;
+	ReleaseTargets();
+	CreateTargets();
+	InvalidateAll();
+}
+
+void ShadowAtlas::CreateTargets() {
+	// Depth texture compared by a sampler2DShadow with bilinear PCF.
+	glGenTextures(1, &texId);
+	glBindTexture(GL_TEXTURE_2D, texId);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, 2 * tileSize, 2 * tileSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texId, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "[ERROR] Shadow atlas framebuffer is incomplete" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowAtlas::ReleaseTargets() {
+	glDeleteFramebuffers(1, &fboId);
+	glDeleteTextures(1, &texId);
+	fboId = 0;
+	texId = 0;
+}
+
+void ShadowAtlas::Update(
+	const std::shared_ptr<Camera>& camera,
+	const std::shared_ptr<DirectionalLight>& dirLight,
+	const std::shared_ptr<SpotLight>& spotLight,
+	const std::vector<ShadowCaster>& casters,
+	FrameArena& arena,
+	const std::shared_ptr<DepthOnlyShaderProg>& shader
+) {
+	// World space bounding spheres of the casters.
+	const std::span<glm::vec4> casterSpheres(arena.AllocateArray<glm::vec4>(casters.size()), casters.size());
+	for (size_t i = 0; i < casters.size(); ++i) {
+		casterSpheres[i] = casters[i].GetBoundingSphere();
+	}
+
+	// Fit the views.
+	glm::mat4 viewProjs[kNumViews];
+	const glm::mat4 invView = glm::inverse(camera->GetViewMatrix());
+	for (int i = 0; i < kNumCascades; ++i) {
+		views[i].active = dirLight != nullptr;
+	}
+	if (dirLight != nullptr) {
+		// Corners of the near plane in view space, the far corners of any depth are a scaled copy.
+		const glm::mat4 invProj = glm::inverse(camera->GetProjMatrix());
+		const glm::vec2 ndcCorners[4] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+		glm::vec3 nearCorners[4];
+		for (int k = 0; k < 4; ++k) {
+			glm::vec4 corner = invProj * glm::vec4(ndcCorners[k], -1.0f, 1.0f);
+			nearCorners[k] = glm::vec3(corner) / corner.w;
+		}
+		const float zNear = -nearCorners[0].z;
+
+		float depthBegin = zNear;
+		for (int i = 0; i < kNumCascades; ++i) {
+			float t = (float)(i + 1) / (float)kNumCascades;
+			float uniformSplit = zNear + (shadowDistance - zNear) * t;
+			float logSplit = zNear * std::pow(shadowDistance / zNear, t);
+			float depthEnd = glm::mix(uniformSplit, logSplit, kCascadeSplitLambda);
+			viewProjs[i] = FitCascade(invView, nearCorners, zNear, depthBegin, depthEnd, dirLight->GetDirection(), casterSpheres);
+			cascadeSplits[i] = depthEnd;
+			depthBegin = depthEnd;
+		}
+	}
+	views[kSpotView].active = spotLight != nullptr;
+	if (spotLight != nullptr) {
+		viewProjs[kSpotView] = FitSpot(*spotLight, casterSpheres);
+	}
+
+	// Reuse the tiles whose view and casters did not change.
+	bool dirty[kNumViews] = { false };
+	numPassesRendered = 0;
+	numPassesSkipped = 0;
+	for (int i = 0; i < kNumViews; ++i) {
+		ShadowView& view = views[i];
+		if (!view.active) {
+			continue;
+		}
+		uint64_t casterKey = GetCasterKey(viewProjs[i], casters, casterSpheres);
+		if (view.valid && view.viewProj == viewProjs[i] && view.casterKey == casterKey) {
+			++numPassesSkipped;
+		}
+		else {
+			view.viewProj = viewProjs[i];
+			view.casterKey = casterKey;
+			view.valid = true;
+			dirty[i] = true;
+			++numPassesRendered;
+		}
+		shadowMatrices[i] = GetTileMatrix(i) * view.viewProj * invView;
+	}
+	if (numPassesRendered == 0) {
+		return;
+	}
+
+	// Render the dirty tiles.
+	GLint viewport[4];
+	GLint prevFboId = 0;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	glEnable(GL_SCISSOR_TEST);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+	// Both faces cast shadows, the models are not always closed.
+	glDisable(GL_CULL_FACE);
+	for (int i = 0; i < kNumViews; ++i) {
+		if (!dirty[i]) {
+			continue;
+		}
+		int x = (i % 2) * tileSize;
+		int y = (i / 2) * tileSize;
+		glViewport(x, y, tileSize, tileSize);
+		glScissor(x, y, tileSize, tileSize);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		for (const auto& caster : casters) {
+			caster.mesh->RenderShadow(shader, caster.worldMatrix, views[i].viewProj);
+		}
+	}
+	glEnable(GL_CULL_FACE);
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void ShadowAtlas::InvalidateDirectionalLight() {
+	for (int i = 0; i < kNumCascades; ++i) {
+		views[i].valid = false;
+	}
+}
+
+void ShadowAtlas::InvalidateSpotLight() {
+	views[kSpotView].valid = false;
+}
+
+void ShadowAtlas::InvalidateAll() {
+	InvalidateDirectionalLight();
+	InvalidateSpotLight();
+}
+
+void ShadowAtlas::Bind(const GLenum textureUnit) const {
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_2D, texId);
+}
+
+// Desc: Fit an orthographic view of the directional light around the bounding sphere of
+// the slice [depthBegin, depthEnd] of the camera frustum. The sphere does not change
+// when the camera rotates, and snapping its center to whole texels keeps the matrix
+// constant until the camera or the light actually moves the slice.
+glm::mat4 ShadowAtlas::FitCascade(const glm::mat4& invView, const glm::vec3 nearCorners[4], const float zNear,
+	const float depthBegin, const float depthEnd, const glm::vec3& lightDir,
+	const std::span<const glm::vec4> casterSpheres) const {
+	glm::vec3 corners[8];
+	glm::vec3 center = glm::vec3(0.0f, 0.0f, 0.0f);
+	for (int k = 0; k < 4; ++k) {
+		corners[k] = glm::vec3(invView * glm::vec4(nearCorners[k] * (depthBegin / zNear), 1.0f));
+		corners[k + 4] = glm::vec3(invView * glm::vec4(nearCorners[k] * (depthEnd / zNear), 1.0f));
+		center += corners[k] + corners[k + 4];
+	}
+	center /= 8.0f;
+	float radius = 0.0f;
+	for (int k = 0; k < 8; ++k) {
+		radius = std::max(radius, glm::length(corners[k] - center));
+	}
+	radius = std::ceil(radius * 16.0f) / 16.0f;
+
+	// The light looks along -lightDir, the direction the light comes from.
+	glm::vec3 up = std::abs(lightDir.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), -lightDir, up);
+	glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+	float texelSize = 2.0f * radius / (float)tileSize;
+	lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+	lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+	// Extend the depth range towards the light to keep the casters in front of the slice.
+	float maxZ = lightCenter.z + radius;
+	float minZ = lightCenter.z - radius;
+	for (const auto& sphere : casterSpheres) {
+		maxZ = std::max(maxZ, glm::vec3(lightView * glm::vec4(glm::vec3(sphere), 1.0f)).z + sphere.w);
+	}
+	glm::mat4 lightProj = glm::ortho(
+		lightCenter.x - radius, lightCenter.x + radius,
+		lightCenter.y - radius, lightCenter.y + radius,
+		-maxZ, -minZ);
+	return lightProj * lightView;
+}
+
+// Desc: Fit a perspective view of the spot light covering its cone and the casters.
+glm::mat4 ShadowAtlas::FitSpot(const SpotLight& spotLight, const std::span<const glm::vec4> casterSpheres) {
+	const glm::vec3 position = spotLight.GetPosition();
+	const glm::vec3 direction = glm::normalize(spotLight.GetDirection());
+	float zNear = 0.05f;
+	float zFar = zNear + 1.0f;
+	if (!casterSpheres.empty()) {
+		float minDist = std::numeric_limits<float>::max();
+		float maxDist = 0.0f;
+		for (const auto& sphere : casterSpheres) {
+			float dist = glm::length(glm::vec3(sphere) - position);
+			minDist = std::min(minDist, dist - sphere.w);
+			maxDist = std::max(maxDist, dist + sphere.w);
+		}
+		zNear = std::max(zNear, minDist);
+		zFar = std::max(zNear + 0.01f, maxDist);
+	}
+
+	// The lit region reaches the total width on each side of the axis.
+	float fovyDeg = std::min(2.0f * spotLight.GetTotalWidthDeg() + 10.0f, 170.0f);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(position, position + direction, up);
+	glm::mat4 lightProj = glm::perspective(glm::radians(fovyDeg), 1.0f, zNear, zFar);
+	return lightProj * lightView;
+}
+
+// Desc: Hash the casters overlapping the frustum of a view with their transforms,
+// so that a caster moving outside of the view does not invalidate it.
+uint64_t ShadowAtlas::GetCasterKey(const glm::mat4& viewProj, const std::vector<ShadowCaster>& casters,
+	const std::span<const glm::vec4> casterSpheres) {
+	uint64_t hash = 14695981039346656037ull;
+	auto hashBytes = [&hash](const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+	for (size_t i = 0; i < casters.size(); ++i) {
+		if (!IntersectsFrustum(viewProj, casterSpheres[i])) {
+			continue;
+		}
+		const opengl_homework::TriangleMesh* mesh = casters[i].mesh;
+		hashBytes(&mesh, sizeof(mesh));
+		hashBytes(&casters[i].worldMatrix, sizeof(glm::mat4));
+	}
+	return hash;
+}
+
+// Desc: Test the sphere against the frustum planes taken from the rows of the matrix.
+bool ShadowAtlas::IntersectsFrustum(const glm::mat4& viewProj, const glm::vec4& sphere) {
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; ++r) {
+		rows[r] = glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]);
+	}
+	const glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2]
+	};
+	for (const auto& plane : planes) {
+		float dist = glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w;
+		if (dist < -sphere.w * glm::length(glm::vec3(plane))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Desc: Map the clip space of a view to its tile of the atlas and the depth to [0, 1].
+glm::mat4 ShadowAtlas::GetTileMatrix(const int view) const {
+	glm::mat4 tileMatrix = glm::mat4(1.0f);
+	tileMatrix[0][0] = 0.25f;
+	tileMatrix[1][1] = 0.25f;
+	tileMatrix[2][2] = 0.5f;
+	tileMatrix[3][0] = 0.25f + 0.5f * (float)(view % 2);
+	tileMatrix[3][1] = 0.25f + 0.5f * (float)(view / 2);
+	tileMatrix[3][2] = 0.5f;
+	return tileMatrix;
+}
@@ -0,0 +1,72 @@
+#include "SkyboxCache.h"
+
+#include <iostream>
+
+SkyboxCache::SkyboxCache(const size_t budgetBytes, JobSystem& jobSystem)
+	: jobSystem(jobSystem) {
+	this->budgetBytes = budgetBytes;
+	residentBytes = 0;
+}
+
+SkyboxCache::~SkyboxCache() {
+	// Wait for the workers before the cache goes away.
+	for (auto& entry : pending) {
+		jobSystem.Wait(entry.second->counter);
+	}
+}
+
+std::shared_ptr<Skybox> SkyboxCache::Request(const std::filesystem::path& texImagePath) {
+	for (auto it = resident.begin(); it != resident.end(); ++it) {
+		if (it->first == texImagePath) {
+			// Move to the front of the LRU list.
+			resident.splice(resident.begin(), resident, it);
+			return it->second;
+		}
+	}
+
+	if (pending.find(texImagePath) == pending.end()) {
+		auto& decode = pending[texImagePath];
+		decode = std::make_unique<PendingDecode>();
+		PendingDecode* target = decode.get();
+		// A decode takes far longer than a frame, no frame may wait on it.
+		jobSystem.RunBackground([target, texImagePath]() {
+			target->image = CubemapTexture::DecodePanorama(texImagePath);
+		}, &decode->counter);
+	}
+	return nullptr;
+}
+
+bool SkyboxCache::Update() {
+	bool updated = false;
+	for (auto it = pending.begin(); it != pending.end();) {
+		if (!it->second->counter.IsDone()) {
+			++it;
+			continue;
+		}
+
+		auto image = it->second->image;
+		if (image != nullptr) {
+			auto skybox = std::make_shared<Skybox>(std::make_shared<CubemapTexture>(*image));
+			residentBytes += skybox->GetCubemap()->GetSizeInBytes();
+			resident.emplace_front(it->first, skybox);
+			updated = true;
+		}
+		it = pending.erase(it);
+	}
+
+	if (updated) {
+		Evict();
+	}
+	return updated;
+}
+
+// Desc: Drop the least recently used skyboxes until the budget is met.
+// The most recently used one always stays resident.
+void SkyboxCache::Evict() {
+	while (residentBytes > budgetBytes && resident.size() > 1) {
+		auto& entry = resident.back();
+		std::cout << "[*] Evict skybox: " << entry.first << std::endl;
+		residentBytes -= entry.second->GetCubemap()->GetSizeInBytes();
+		resident.pop_back();
+	}
+}
@@ -0,0 +1,200 @@
+#include "TraceRecorder.h"
+
+// C++ STL headers.
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Project headers.
+#include "Clock.h"
+
+// ThreadBuffer Declarations.
+// Written by its thread only; head counts every event ever written. Dump reads
+// the slots while they are overwritten, so every field is atomic, and the
+// sequence of a slot is odd while event i is written and 2i + 2 once it is
+// complete, so that a torn or newer event is recognized and skipped.
+struct TraceRecorder::ThreadBuffer
+{
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence{ 0 };
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<double> time{ 0.0 };
+		std::atomic<uint32_t> threadId{ 0 };
+		std::atomic<char> phase{ 0 };
+	};
+
+	Slot events[kCapacity];
+	std::atomic<uint64_t> head{ 0 };
+	uint32_t threadId = 0;
+	// Guarded by registryMutex.
+	const char* threadName = nullptr;
+	// Set when the thread exits, a new thread may then take the buffer over.
+	std::atomic<bool> retired{ false };
+};
+
+// Buffers of all threads, only locked when a thread registers and when dumping.
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<TraceRecorder::ThreadBuffer>>& GetRegistry() {
+	static std::vector<std::unique_ptr<TraceRecorder::ThreadBuffer>> registry;
+	return registry;
+}
+
+static Clock& GetTraceClock() {
+	static Clock clock;
+	return clock;
+}
+
+// Desc: Marks the buffer of a thread as retired when the thread exits.
+namespace {
+struct ThreadBufferHandle
+{
+	TraceRecorder::ThreadBuffer* buffer = nullptr;
+	~ThreadBufferHandle();
+};
+}
+
+void TraceRecorder::Begin(const char* name) {
+	Record(name, 'B');
+}
+
+void TraceRecorder::End(const char* name) {
+	Record(name, 'E');
+}
+
+void TraceRecorder::SetThreadName(const char* name) {
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer.threadName = name;
+}
+
+// Desc: The release fence keeps the field stores after the odd sequence, so a
+// reader seeing any of them also sees the slot as being written.
+void TraceRecorder::Record(const char* name, const char phase) {
+	ThreadBuffer& buffer = GetThreadBuffer();
+	const uint64_t index = buffer.head.load(std::memory_order_relaxed);
+	ThreadBuffer::Slot& slot = buffer.events[index % kCapacity];
+	slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.time.store(GetTraceClock().GetElapsedTime(), std::memory_order_relaxed);
+	slot.threadId.store(buffer.threadId, std::memory_order_relaxed);
+	slot.phase.store(phase, std::memory_order_relaxed);
+	slot.sequence.store(2 * index + 2, std::memory_order_release);
+	buffer.head.store(index + 1, std::memory_order_release);
+}
+
+// Desc: Reuse the buffer of an exited thread so that short-lived workers do not grow the registry.
+// Its old events keep the ID of the thread which wrote them.
+TraceRecorder::ThreadBuffer& TraceRecorder::GetThreadBuffer() {
+	thread_local ThreadBufferHandle handle;
+	if (handle.buffer != nullptr) {
+		return *handle.buffer;
+	}
+
+	static uint32_t nextThreadId = 1;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	auto& registry = GetRegistry();
+	for (auto& buffer : registry) {
+		if (buffer->retired.load(std::memory_order_acquire)) {
+			handle.buffer = buffer.get();
+			break;
+		}
+	}
+	if (handle.buffer == nullptr) {
+		registry.push_back(std::make_unique<ThreadBuffer>());
+		handle.buffer = registry.back().get();
+	}
+	handle.buffer->threadId = nextThreadId++;
+	handle.buffer->threadName = nullptr;
+	handle.buffer->retired.store(false, std::memory_order_release);
+	return *handle.buffer;
+}
+
+ThreadBufferHandle::~ThreadBufferHandle() {
+	if (buffer != nullptr) {
+		buffer->retired.store(true, std::memory_order_release);
+	}
+}
+
+// Desc: Events may be overwritten while they are copied, so an event is only
+// kept if the sequence of its slot is the same complete one before and after
+// the copy. The owning thread may be writing the oldest slot of the window, so
+// the window starts one event later. Ends whose begin left the window are
+// dropped and scopes still open are closed at the time of the dump.
+bool TraceRecorder::Dump(const std::filesystem::path& filePath) {
+	std::vector<Event> events;
+	std::map<uint32_t, const char*> threadNames;
+	const double dumpTime = GetTraceClock().GetElapsedTime();
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const auto& buffer : GetRegistry()) {
+			const uint64_t end = buffer->head.load(std::memory_order_acquire);
+			const uint64_t begin = end + 1 > kCapacity ? end + 1 - kCapacity : 0;
+			for (uint64_t i = begin; i < end; ++i) {
+				const ThreadBuffer::Slot& slot = buffer->events[i % kCapacity];
+				const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+				if (sequence != 2 * i + 2) {
+					continue;
+				}
+				Event event;
+				event.name = slot.name.load(std::memory_order_relaxed);
+				event.time = slot.time.load(std::memory_order_relaxed);
+				event.threadId = slot.threadId.load(std::memory_order_relaxed);
+				event.phase = slot.phase.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+					events.push_back(event);
+				}
+			}
+			threadNames[buffer->threadId] = buffer->threadName;
+		}
+	}
+
+	std::ofstream fout(filePath);
+	if (!fout) {
+		std::cerr << "[ERROR] Cannot write trace file " << filePath << std::endl;
+		return false;
+	}
+	fout << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	auto writeEvent = [&fout, &first](const char* name, const char phase, const double time, const uint32_t threadId) {
+		fout << (first ? "" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"" << phase
+			<< "\",\"ts\":" << std::fixed << time * 1e6 << ",\"pid\":1,\"tid\":" << threadId << "}";
+		first = false;
+	};
+	for (const auto& [threadId, threadName] : threadNames) {
+		if (threadName != nullptr) {
+			fout << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId
+				<< ",\"args\":{\"name\":\"" << threadName << "\"}}";
+			first = false;
+		}
+	}
+	// The events of a thread are in order, and a retired buffer may hold several threads.
+	std::map<uint32_t, std::vector<const char*>> openScopes;
+	for (const auto& event : events) {
+		auto& stack = openScopes[event.threadId];
+		if (event.phase == 'B') {
+			stack.push_back(event.name);
+		}
+		else if (stack.empty()) {
+			continue;
+		}
+		else {
+			stack.pop_back();
+		}
+		writeEvent(event.name, event.phase, event.time, event.threadId);
+	}
+	for (const auto& [threadId, stack] : openScopes) {
+		for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+			writeEvent(*it, 'E', dumpTime, threadId);
+		}
+	}
+	fout << "\n]}\n";
+
+	std::cout << "Trace written to " << filePath << " (" << events.size() << " events)" << std::endl;
+	return true;
+}
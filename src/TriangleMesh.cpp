@@ -15,10 +15,23 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// Project headers.
+#include "Clock.h"
+#include "GLCallCounters.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "TraceRecorder.h"
 
 // Project headers.
 #include "Light.h"
 #include "Material.h"
+#include "ShadowAtlas.h"
+#include "PointShadowMap.h"
+#include "VisibilityBuffer.h"
 
 namespace opengl_homework {
 
@@ -39,6 +52,34 @@ struct TriangleMesh::VertexPTN {
 	glm::vec2 texcoord;
 };
 
+// Number of triangles grouped into one cluster.
+static constexpr int kClusterTriangles = 64;
+
+// Cluster Declarations.
+// A cluster is a run of triangles in the index buffer of a submesh with
+// a bounding sphere and a cone bounding the face normals of its triangles.
+struct TriangleMesh::Cluster
+{
+	Cluster() {
+		firstIndex = 0;
+		indexCount = 0;
+		center = glm::vec3(0.0f, 0.0f, 0.0f);
+		radius = 0.0f;
+		coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		coneCos = 0.0f;
+		coneSin = 1.0f;
+	}
+	unsigned int firstIndex;
+	int indexCount;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 coneAxis;
+	// Cosine and sine of the cone half angle.
+	// (0, 1) means the normals spread over a hemisphere or more and the cluster is never culled.
+	float coneCos;
+	float coneSin;
+};
+
 // SubMesh Declarations.
 struct TriangleMesh::SubMesh
 {
@@ -49,11 +90,16 @@ struct TriangleMesh::SubMesh
 	std::shared_ptr<PhongMaterial> material;
 	GLuint iboId;
 	std::vector<unsigned int> vertexIndices;
+	std::vector<Cluster> clusters;
+	// Object space bounding box of the triangles.
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
 };
 
 // TriangleMesh Private Declarations.
 struct TriangleMesh::Impl {
-	GLuint vboId;
+	GLuint vboId = 0;
+	GLuint positionVboId = 0;
 	std::vector<VertexPTN> vertices;
 	std::vector<SubMesh> subMeshes;
 	std::map<std::string, std::shared_ptr<PhongMaterial>> materials;
@@ -61,8 +107,17 @@ struct TriangleMesh::Impl {
 	std::string name;
 	int numVertices;
 	int numTriangles;
+	int numClusters;
 	glm::vec3 objCenter;
 	glm::vec3 objExtent;
+	glm::vec4 boundingSphere;
+
+	// Cluster culling state and the draws of the last pass.
+	bool clusterCulling;
+	int numTrianglesDrawn;
+	int numDrawCalls;
+
+	LoadStats loadStats;
 };
 
 // Desc: Get the number of vertices.
@@ -80,19 +135,77 @@ int TriangleMesh::GetNumIndices() const {
 	return pImpl->numTriangles * 3;
 }
 
+// Desc: Get the number of clusters.
+int TriangleMesh::GetNumClusters() const {
+	return pImpl->numClusters;
+}
+
+// Desc: Get the number of triangles submitted by the last Render call.
+int TriangleMesh::GetNumTrianglesDrawn() const {
+	return pImpl->numTrianglesDrawn;
+}
+
+// Desc: Get the number of draw calls issued by the last Render call.
+int TriangleMesh::GetNumDrawCalls() const {
+	return pImpl->numDrawCalls;
+}
+
+// Desc: Enable or disable the cluster cone culling.
+void TriangleMesh::SetClusterCulling(const bool enabled) {
+	pImpl->clusterCulling = enabled;
+}
+
 // Desc: Get the center of the model.
 glm::vec3 TriangleMesh::GetObjCenter() const {
 	return pImpl->objCenter;
 }
 
+// Desc: Get the bounding sphere of the vertices.
+glm::vec4 TriangleMesh::GetBoundingSphere() const {
+	return pImpl->boundingSphere;
+}
+
+// Desc: Get the interleaved vertex buffer.
+GLuint TriangleMesh::GetVertexBuffer() const {
+	return pImpl->vboId;
+}
+
+// Desc: Get the number of submeshes.
+int TriangleMesh::GetNumSubMeshes() const {
+	return (int)pImpl->subMeshes.size();
+}
+
+// Desc: Get the index buffer of a submesh.
+GLuint TriangleMesh::GetSubMeshIndexBuffer(const int subMesh) const {
+	return pImpl->subMeshes[subMesh].iboId;
+}
+
+// Desc: Get the number of indices of a submesh.
+int TriangleMesh::GetSubMeshNumIndices(const int subMesh) const {
+	return (int)pImpl->subMeshes[subMesh].vertexIndices.size();
+}
+
+// Desc: Get the time spent in each stage of loading.
+const TriangleMesh::LoadStats& TriangleMesh::GetLoadStats() const {
+	return pImpl->loadStats;
+}
+
 // Desc: Constructor of a triangle mesh.
 TriangleMesh::TriangleMesh(const std::filesystem::path& objFilePath, const bool normalized = true) {
 	pImpl = std::make_unique<Impl>();
 	pImpl->name = objFilePath.stem().string();
 	pImpl->numVertices = 0;
 	pImpl->numTriangles = 0;
+	pImpl->numClusters = 0;
 	pImpl->objCenter = glm::vec3(0.0f, 0.0f, 0.0f);
-	LoadFromFile(objFilePath, normalized);
+	pImpl->clusterCulling = true;
+	pImpl->numTrianglesDrawn = 0;
+	pImpl->numDrawCalls = 0;
+	if (LoadFromFile(objFilePath, normalized)) {
+		Clock stageClock;
+		BuildClusters();
+		pImpl->loadStats.postProcessTime = stageClock.GetElapsedTime();
+	}
 }
 
 // Desc: Destructor of a triangle mesh.
@@ -104,18 +217,29 @@ TriangleMesh::~TriangleMesh() {
 
 // Desc: Load the geometry data of the model from file and normalize it.
 bool TriangleMesh::LoadFromFile(const std::filesystem::path& objFilePath, const bool normalized) {
-	std::ifstream fin(objFilePath);
+	TraceScope trace("LoadFromFile");
+	LoadStats& stats = pImpl->loadStats;
+	Clock stageClock;
+	std::ifstream fin(objFilePath, std::ios::binary);
 	if (!fin) {
 		std::cerr << "Error: cannot open file " << objFilePath << std::endl;
 		return false;
 	}
+	// Read the whole file first, so that reading and parsing are timed apart.
+	std::stringstream contents;
+	contents << fin.rdbuf();
+	fin.close();
+	stats.numFileBytes += contents.str().size();
+	stats.readTime += stageClock.GetElapsedTime();
 
+	stageClock.Reset();
+	const double mtlTimeBefore = stats.mtlTime + stats.textureTime;
 	std::vector<glm::vec3> positions;
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec2> texcoords;
 
 	std::string line = "";
-	while (std::getline(fin, line)) {
+	while (std::getline(contents, line)) {
 		std::istringstream iss(line);
 		std::string type;
 		iss >> type;
@@ -172,8 +296,9 @@ bool TriangleMesh::LoadFromFile(const std::filesystem::path& objFilePath, const
 		}
 	}
 
-	fin.close();
+	stats.parseTime += stageClock.GetElapsedTime() - (stats.mtlTime + stats.textureTime - mtlTimeBefore);
 
+	stageClock.Reset();
 	if (normalized) {
 		// Normalize the model.
 		glm::vec3 minPos = glm::vec3(1e9, 1e9, 1e9);
@@ -189,15 +314,32 @@ bool TriangleMesh::LoadFromFile(const std::filesystem::path& objFilePath, const
 		}
 		pImpl->objExtent = (maxPos - minPos) / maxLen;
 	}
+
+	// Bounding sphere around the box of the final positions.
+	glm::vec3 minPos = glm::vec3(1e9, 1e9, 1e9);
+	glm::vec3 maxPos = glm::vec3(-1e9, -1e9, -1e9);
+	for (int i = 0; i < pImpl->numVertices; ++i) {
+		minPos = glm::min(minPos, pImpl->vertices[i].position);
+		maxPos = glm::max(maxPos, pImpl->vertices[i].position);
+	}
+	pImpl->boundingSphere = glm::vec4(0.5f * (minPos + maxPos), 0.5f * glm::length(maxPos - minPos));
+	stats.normalizeTime += stageClock.GetElapsedTime();
 	return true;
 }
 
 bool TriangleMesh::LoadMtllib(const std::filesystem::path& mtlPath) {
+	TraceScope trace("LoadMtllib");
+	LoadStats& stats = pImpl->loadStats;
+	Clock mtlClock;
+	const double textureTimeBefore = stats.textureTime;
 	std::ifstream fin(mtlPath);
 	if (!fin) {
 		std::cerr << "Error: cannot open file " << mtlPath << std::endl;
 		return false;
 	}
+	std::error_code ec;
+	const auto fileSize = std::filesystem::file_size(mtlPath, ec);
+	stats.numFileBytes += ec ? 0 : (size_t)fileSize;
 
 	std::string line = "";
 	std::string curMtlName = "";
@@ -235,23 +377,104 @@ bool TriangleMesh::LoadMtllib(const std::filesystem::path& mtlPath) {
 		else if (type == "map_Kd") {
 			std::string texFileName;
 			iss >> texFileName;
+			Clock textureClock;
 			pImpl->materials[curMtlName]->SetMapKd(
 				std::make_shared<ImageTexture>(mtlPath.parent_path() / texFileName)
 			);
+			stats.textureTime += textureClock.GetElapsedTime();
 		}
 	}
 
 	fin.close();
+	stats.mtlTime += mtlClock.GetElapsedTime() - (stats.textureTime - textureTimeBefore);
 
 	return true;
 }
 
+// Desc: Split the index buffer of every submesh into clusters of kClusterTriangles
+// triangles and compute the bounding sphere and normal cone of each cluster.
+void TriangleMesh::BuildClusters() {
+	pImpl->numClusters = 0;
+	for (auto& subMesh : pImpl->subMeshes) {
+		subMesh.clusters.clear();
+		subMesh.boundsMin = glm::vec3(1e9, 1e9, 1e9);
+		subMesh.boundsMax = glm::vec3(-1e9, -1e9, -1e9);
+		const size_t numIndices = subMesh.vertexIndices.size();
+		for (size_t first = 0; first < numIndices; first += kClusterTriangles * 3) {
+			const size_t last = std::min(numIndices, first + kClusterTriangles * 3);
+			Cluster cluster;
+			cluster.firstIndex = (unsigned int)first;
+			cluster.indexCount = (int)(last - first);
+
+			// Bounding sphere around the center of the bounding box.
+			glm::vec3 minPos = glm::vec3(1e9, 1e9, 1e9);
+			glm::vec3 maxPos = glm::vec3(-1e9, -1e9, -1e9);
+			for (size_t i = first; i < last; ++i) {
+				const glm::vec3& p = pImpl->vertices[subMesh.vertexIndices[i]].position;
+				minPos = glm::min(minPos, p);
+				maxPos = glm::max(maxPos, p);
+			}
+			cluster.center = minPos + (maxPos - minPos) * 0.5f;
+			subMesh.boundsMin = glm::min(subMesh.boundsMin, minPos);
+			subMesh.boundsMax = glm::max(subMesh.boundsMax, maxPos);
+			for (size_t i = first; i < last; ++i) {
+				const glm::vec3& p = pImpl->vertices[subMesh.vertexIndices[i]].position;
+				cluster.radius = std::max(cluster.radius, glm::length(p - cluster.center));
+			}
+
+			// Face normals follow the counter-clockwise front face winding.
+			std::vector<glm::vec3> faceNormals;
+			glm::vec3 normalSum = glm::vec3(0.0f, 0.0f, 0.0f);
+			for (size_t i = first; i < last; i += 3) {
+				const glm::vec3& p0 = pImpl->vertices[subMesh.vertexIndices[i]].position;
+				const glm::vec3& p1 = pImpl->vertices[subMesh.vertexIndices[i + 1]].position;
+				const glm::vec3& p2 = pImpl->vertices[subMesh.vertexIndices[i + 2]].position;
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float len = glm::length(n);
+				if (len <= 0.0f) {
+					continue;
+				}
+				normalSum += n;
+				faceNormals.push_back(n / len);
+			}
+
+			// The cone axis is the area weighted average normal, and the half angle
+			// is the largest deviation from it.
+			if (!faceNormals.empty() && glm::length(normalSum) > 0.0f) {
+				cluster.coneAxis = glm::normalize(normalSum);
+				float minDot = 1.0f;
+				for (const auto& n : faceNormals) {
+					minDot = std::min(minDot, glm::dot(cluster.coneAxis, n));
+				}
+				if (minDot > 0.0f) {
+					cluster.coneCos = minDot;
+					cluster.coneSin = std::sqrt(1.0f - minDot * minDot);
+				}
+			}
+
+			subMesh.clusters.push_back(cluster);
+		}
+		pImpl->numClusters += (int)subMesh.clusters.size();
+	}
+}
+
 // Desc: Create vertex buffer and index buffer.
 void TriangleMesh::CreateBuffers() {
+	TraceScope trace("CreateBuffers");
 	glGenBuffers(1, &(pImpl->vboId));
 	glBindBuffer(GL_ARRAY_BUFFER, pImpl->vboId);
 	glBufferData(GL_ARRAY_BUFFER, pImpl->vertices.size() * sizeof(VertexPTN), pImpl->vertices.data(), GL_STATIC_DRAW);
 
+	// Tightly packed positions for the depth pre-pass.
+	std::vector<glm::vec3> positions;
+	positions.reserve(pImpl->vertices.size());
+	for (const auto& vertex : pImpl->vertices) {
+		positions.push_back(vertex.position);
+	}
+	glGenBuffers(1, &(pImpl->positionVboId));
+	glBindBuffer(GL_ARRAY_BUFFER, pImpl->positionVboId);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+
 	for (auto& subMesh : pImpl->subMeshes) {
 		glGenBuffers(1, &(subMesh.iboId));
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, subMesh.iboId);
@@ -261,72 +484,482 @@ void TriangleMesh::CreateBuffers() {
 
 // Desc: Release vertex buffer and index buffer.
 void TriangleMesh::ReleaseBuffers() {
+	// Nothing to release if CreateBuffers was never called, as in the CPU-only loader benchmark.
+	if (pImpl->vboId == 0) {
+		return;
+	}
 	glDeleteBuffers(1, &(pImpl->vboId));
+	glDeleteBuffers(1, &(pImpl->positionVboId));
+	pImpl->vboId = 0;
+	pImpl->positionVboId = 0;
 	for (auto& subMesh : pImpl->subMeshes) {
 		glDeleteBuffers(1, &(subMesh.iboId));
+		subMesh.iboId = 0;
+	}
+}
+
+// Desc: Get the phong features needed by the non-null lights.
+static unsigned int GetLightFeatures(
+	const std::shared_ptr<DirectionalLight>& dirLight,
+	const std::shared_ptr<PointLight>& pointLight,
+	const std::shared_ptr<SpotLight>& spotLight,
+	const std::shared_ptr<ShadowAtlas>& shadowAtlas
+) {
+	unsigned int lightFeatures = 0;
+	if (dirLight != nullptr) {
+		lightFeatures |= PHONG_USE_DIR_LIGHT;
+	}
+	if (pointLight != nullptr) {
+		lightFeatures |= PHONG_USE_POINT_LIGHT;
 	}
+	if (spotLight != nullptr) {
+		lightFeatures |= PHONG_USE_SPOT;
+	}
+	if (shadowAtlas != nullptr && (dirLight != nullptr || spotLight != nullptr)) {
+		lightFeatures |= PHONG_USE_SHADOWS;
+	}
+	if (shadowAtlas != nullptr && pointLight != nullptr && pointLight->GetShadowMap() != nullptr) {
+		lightFeatures |= PHONG_USE_POINT_SHADOW;
+	}
+	return lightFeatures;
+}
+
+// Desc: Set the transformation and light uniforms of a bound phong program,
+// which stay the same for every submesh drawn with it.
+static void SetPhongFrameUniforms(
+	const PhongShadingDemoShaderProg& shader,
+	const unsigned int lightFeatures,
+	const TriangleMesh::PreparedFrame& frame,
+	const glm::vec3& ambientLight,
+	const std::shared_ptr<DirectionalLight>& dirLight,
+	const std::shared_ptr<PointLight>& pointLight,
+	const std::shared_ptr<SpotLight>& spotLight,
+	const std::shared_ptr<ShadowAtlas>& shadowAtlas
+) {
+	glUniformMatrix4fv(shader.GetLocM(), 1, GL_FALSE, glm::value_ptr(frame.worldMatrix));
+	glUniformMatrix4fv(shader.GetLocV(), 1, GL_FALSE, glm::value_ptr(frame.viewMatrix));
+	glUniformMatrix4fv(shader.GetLocNM(), 1, GL_FALSE, glm::value_ptr(frame.normalMatrix));
+	glUniformMatrix4fv(shader.GetLocMVP(), 1, GL_FALSE, glm::value_ptr(frame.MVP));
+	glUniform3fv(shader.GetLocCameraPos(), 1, glm::value_ptr(frame.cameraPos));
+	// Light data.
+	if (dirLight != nullptr) {
+		glUniform3fv(shader.GetLocDirLightDir(), 1, glm::value_ptr(dirLight->GetDirection()));
+		glUniform3fv(shader.GetLocDirLightRadiance(), 1, glm::value_ptr(dirLight->GetRadiance()));
+	}
+	if (pointLight != nullptr) {
+		glUniform3fv(shader.GetLocPointLightPos(), 1, glm::value_ptr(pointLight->GetPosition()));
+		glUniform3fv(shader.GetLocPointLightIntensity(), 1, glm::value_ptr(pointLight->GetIntensity()));
+	}
+	if (spotLight != nullptr) {
+		glUniform3fv(shader.GetLocSpotLightPos(), 1, glm::value_ptr(spotLight->GetPosition()));
+		glUniform3fv(shader.GetLocSpotLightDir(), 1, glm::value_ptr(spotLight->GetDirection()));
+		glUniform3fv(shader.GetLocSpotLightIntensity(), 1, glm::value_ptr(spotLight->GetIntensity()));
+		glUniform1f(shader.GetLocSpotLightCutoff(), spotLight->GetCutoffDeg());
+		glUniform1f(shader.GetLocSpotLightTotalWidth(), spotLight->GetTotalWidthDeg());
+	}
+	glUniform3fv(shader.GetLocAmbientLight(), 1, glm::value_ptr(ambientLight));
+	if (lightFeatures & PHONG_USE_SHADOWS) {
+		shadowAtlas->Bind(GL_TEXTURE1);
+		glUniform1i(shader.GetLocShadowAtlas(), 1);
+		glUniformMatrix4fv(shader.GetLocCascadeShadowMatrices(), ShadowAtlas::kNumCascades, GL_FALSE,
+			glm::value_ptr(shadowAtlas->GetCascadeMatrices()[0]));
+		glUniform3fv(shader.GetLocCascadeSplits(), 1, glm::value_ptr(shadowAtlas->GetCascadeSplits()));
+		glUniformMatrix4fv(shader.GetLocSpotShadowMatrix(), 1, GL_FALSE, glm::value_ptr(shadowAtlas->GetSpotMatrix()));
+	}
+	if (lightFeatures & PHONG_USE_POINT_SHADOW) {
+		const auto& pointShadowMap = pointLight->GetShadowMap();
+		pointShadowMap->Bind(GL_TEXTURE2);
+		glUniform1i(shader.GetLocPointShadowMap(), 2);
+		glUniform2fv(shader.GetLocPointShadowDepth(), 1, glm::value_ptr(pointShadowMap->GetDepthParams()));
+	}
+}
+
+// Desc: Set the material uniforms of a bound phong program.
+static void SetPhongMaterialUniforms(
+	const PhongShadingDemoShaderProg& shader,
+	const PhongMaterial& material
+) {
+	glUniform3fv(shader.GetLocKa(), 1, glm::value_ptr(material.GetKa()));
+	glUniform3fv(shader.GetLocKd(), 1, glm::value_ptr(material.GetKd()));
+	glUniform3fv(shader.GetLocKs(), 1, glm::value_ptr(material.GetKs()));
+	glUniform1f(shader.GetLocNs(), material.GetNs());
+	const auto& mapKd = material.GetMapKd();
+	if (mapKd != nullptr && mapKd->IsValid()) {
+		mapKd->Bind(GL_TEXTURE0);
+		glUniform1i(shader.GetLocMapKd(), 0);
+	}
+}
+
+// Desc: Whether the submesh uses the texture variant of the phong programs.
+static bool HasMapKd(const PhongMaterial& material) {
+	const auto& mapKd = material.GetMapKd();
+	return mapKd != nullptr && mapKd->IsValid();
 }
 
-// Desc: Render the mesh.
+// Desc: Whether the box lies entirely outside one plane of the clip space.
+static bool IsOutsideFrustum(const glm::mat4& MVP, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	glm::vec4 corners[8];
+	for (int c = 0; c < 8; ++c) {
+		corners[c] = MVP * glm::vec4(
+			(c & 1) ? boundsMax.x : boundsMin.x,
+			(c & 2) ? boundsMax.y : boundsMin.y,
+			(c & 4) ? boundsMax.z : boundsMin.z,
+			1.0f);
+	}
+	for (int axis = 0; axis < 3; ++axis) {
+		for (const float side : { -1.0f, 1.0f }) {
+			bool outside = true;
+			for (int c = 0; c < 8 && outside; ++c) {
+				outside = side * corners[c][axis] > corners[c].w;
+			}
+			if (outside) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Desc: Render the mesh. The packets are sorted by variant, so the program and
+// the frame uniforms only change when the variant does.
 void TriangleMesh::Render(
-	const std::shared_ptr<PhongShadingDemoShaderProg>& shader,
-	const glm::mat4& worldMatrix,
+	ShaderPermutations<PhongShadingDemoShaderProg>& shaderPermutations,
+	const PreparedFrame& frame,
 	const glm::vec3& ambientLight,
 	const std::shared_ptr<DirectionalLight>& dirLight,
 	const std::shared_ptr<PointLight>& pointLight,
 	const std::shared_ptr<SpotLight>& spotLight,
-	const std::shared_ptr<Camera>& camera
+	const std::shared_ptr<ShadowAtlas>& shadowAtlas
+) const {
+	pImpl->numTrianglesDrawn = 0;
+	pImpl->numDrawCalls = 0;
+
+	// Features shared by all submeshes.
+	const unsigned int lightFeatures = GetLightFeatures(dirLight, pointLight, spotLight, shadowAtlas);
+
+	PhongShadingDemoShaderProg* boundShader = nullptr;
+	for (const auto& packet : frame.merged.GetPackets()) {
+		const auto& subMesh = pImpl->subMeshes[packet.subMesh];
+		auto shader = shaderPermutations.Get(lightFeatures | (HasMapKd(*subMesh.material) ? PHONG_HAS_MAP_KD : 0u));
+		if (shader == nullptr) {
+			continue;
+		}
+		if (shader.get() != boundShader) {
+			shader->Bind();
+			SetPhongFrameUniforms(*shader, lightFeatures, frame, ambientLight, dirLight, pointLight, spotLight, shadowAtlas);
+			boundShader = shader.get();
+		}
+		SetPhongMaterialUniforms(*shader, *subMesh.material);
+		RenderSubMesh(frame, packet);
+	}
+	if (boundShader != nullptr) {
+		boundShader->Unbind();
+	}
+}
+
+// Desc: Cull the submeshes against the view frustum and their clusters with the
+// normal cones, in chunks of submeshes on the job system. Every job writes its
+// own packet buffer, and the buffers are merged in submesh order and sorted.
+void TriangleMesh::Prepare(
+	const glm::mat4& worldMatrix,
+	const std::shared_ptr<Camera>& camera,
+	JobSystem& jobSystem,
+	FrameArena& arena,
+	PreparedFrame& frame
+) const {
+	TraceScope trace("Prepare");
+	frame.worldMatrix = worldMatrix;
+	frame.viewMatrix = camera->GetViewMatrix();
+	frame.normalMatrix = glm::transpose(glm::inverse(frame.viewMatrix * worldMatrix));
+	frame.MVP = camera->GetProjMatrix() * frame.viewMatrix * worldMatrix;
+	frame.cameraPos = camera->GetPosition();
+	// The cluster cones are stored in object space.
+	const glm::vec3 objCameraPos = glm::vec3(glm::inverse(worldMatrix) * glm::vec4(frame.cameraPos, 1.0f));
+	const glm::mat4 MV = frame.viewMatrix * worldMatrix;
+
+	const int numSubMeshes = (int)pImpl->subMeshes.size();
+	// A few chunks per thread, and one buffer per chunk.
+	const int maxChunks = std::max(1, std::min(numSubMeshes, 4 * jobSystem.GetNumThreads()));
+	const int grain = (numSubMeshes + maxChunks - 1) / maxChunks;
+	const int numChunks = grain > 0 ? (numSubMeshes + grain - 1) / grain : 0;
+	frame.jobBuffers = arena.AllocateArray<PacketBuffer>(numChunks);
+	jobSystem.ParallelFor(0, numSubMeshes, grain, [&](const int first, const int last) {
+		// At most one packet per submesh and one range per cluster.
+		size_t maxRanges = 0;
+		for (int i = first; i < last; ++i) {
+			maxRanges += pImpl->subMeshes[i].clusters.size();
+		}
+		PacketBuffer& buffer = frame.jobBuffers[first / grain];
+		buffer = PacketBuffer();
+		buffer.packets = arena.AllocateArray<DrawPacket>(last - first);
+		buffer.drawCounts = arena.AllocateArray<GLsizei>(maxRanges);
+		buffer.drawOffsets = arena.AllocateArray<const void*>(maxRanges);
+		for (int i = first; i < last; ++i) {
+			const auto& subMesh = pImpl->subMeshes[i];
+			if (IsOutsideFrustum(frame.MVP, subMesh.boundsMin, subMesh.boundsMax)) {
+				continue;
+			}
+			DrawPacket packet;
+			packet.subMesh = i;
+			packet.firstRange = buffer.numRanges;
+			packet.numRanges = CullClusters(subMesh, objCameraPos, buffer);
+			if (packet.numRanges == 0) {
+				continue;
+			}
+			for (int r = packet.firstRange; r < packet.firstRange + packet.numRanges; ++r) {
+				packet.numTriangles += buffer.drawCounts[r] / 3;
+			}
+			// Positive depths keep their order as unsigned bits.
+			const glm::vec3 center = 0.5f * (subMesh.boundsMin + subMesh.boundsMax);
+			const float depth = std::max(0.0f, -(MV * glm::vec4(center, 1.0f)).z);
+			packet.sortKey = ((uint64_t)(HasMapKd(*subMesh.material) ? 1 : 0) << 32) | std::bit_cast<uint32_t>(depth);
+			buffer.packets[buffer.numPackets++] = packet;
+		}
+	});
+
+	int numPackets = 0;
+	int numRanges = 0;
+	for (int c = 0; c < numChunks; ++c) {
+		numPackets += frame.jobBuffers[c].numPackets;
+		numRanges += frame.jobBuffers[c].numRanges;
+	}
+	PacketBuffer& merged = frame.merged;
+	merged = PacketBuffer();
+	merged.packets = arena.AllocateArray<DrawPacket>(numPackets);
+	merged.drawCounts = arena.AllocateArray<GLsizei>(numRanges);
+	merged.drawOffsets = arena.AllocateArray<const void*>(numRanges);
+	for (int c = 0; c < numChunks; ++c) {
+		const PacketBuffer& buffer = frame.jobBuffers[c];
+		for (int p = 0; p < buffer.numPackets; ++p) {
+			DrawPacket packet = buffer.packets[p];
+			packet.firstRange += merged.numRanges;
+			merged.packets[merged.numPackets++] = packet;
+		}
+		std::copy_n(buffer.drawCounts, buffer.numRanges, merged.drawCounts + merged.numRanges);
+		std::copy_n(buffer.drawOffsets, buffer.numRanges, merged.drawOffsets + merged.numRanges);
+		merged.numRanges += buffer.numRanges;
+	}
+	std::sort(merged.packets, merged.packets + merged.numPackets, [](const DrawPacket& a, const DrawPacket& b) {
+		return a.sortKey != b.sortKey ? a.sortKey < b.sortKey : a.subMesh < b.subMesh;
+	});
+}
+
+// Desc: Render the depth of the mesh with the position-only vertex stream.
+void TriangleMesh::RenderDepth(
+	const std::shared_ptr<DepthOnlyShaderProg>& shader,
+	const PreparedFrame& frame
+) const {
+	shader->Bind();
+	glUniformMatrix4fv(shader->GetLocMVP(), 1, GL_FALSE, glm::value_ptr(frame.MVP));
+
+	glBindBuffer(GL_ARRAY_BUFFER, pImpl->positionVboId);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
+	// The same clusters as the shading pass must be drawn for the GL_EQUAL depth test.
+	for (const auto& packet : frame.merged.GetPackets()) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pImpl->subMeshes[packet.subMesh].iboId);
+		glMultiDrawElements(GL_TRIANGLES, frame.merged.drawCounts + packet.firstRange, GL_UNSIGNED_INT,
+			frame.merged.drawOffsets + packet.firstRange, (GLsizei)packet.numRanges);
+	}
+
+	glDisableVertexAttribArray(0);
+	shader->Unbind();
+}
+
+// Desc: Render the depth of the whole mesh from a light. The cluster cones are
+// built for the camera, so nothing is culled here.
+void TriangleMesh::RenderShadow(
+	const std::shared_ptr<DepthOnlyShaderProg>& shader,
+	const glm::mat4& worldMatrix,
+	const glm::mat4& lightViewProj
 ) const {
-	glm::mat4x4 V = camera->GetViewMatrix();
-	glm::mat4x4 normalMatrix = glm::transpose(glm::inverse(V * worldMatrix));
-	glm::mat4x4 MVP = camera->GetProjMatrix() * V * worldMatrix;
-	auto cameraPos = camera->GetPosition();
+	glm::mat4x4 MVP = lightViewProj * worldMatrix;
+
+	shader->Bind();
+	glUniformMatrix4fv(shader->GetLocMVP(), 1, GL_FALSE, glm::value_ptr(MVP));
+	DrawPositions(1);
+	shader->Unbind();
+}
+
+// Desc: Draw all submeshes with the position-only vertex stream, instanced.
+void TriangleMesh::DrawPositions(const int numInstances) const {
+	glBindBuffer(GL_ARRAY_BUFFER, pImpl->positionVboId);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
 
 	for (const auto& subMesh : pImpl->subMeshes) {
-		shader->Bind();
-
-		glUniformMatrix4fv(shader->GetLocM(), 1, GL_FALSE, glm::value_ptr(worldMatrix));
-		glUniformMatrix4fv(shader->GetLocV(), 1, GL_FALSE, glm::value_ptr(V));
-		glUniformMatrix4fv(shader->GetLocNM(), 1, GL_FALSE, glm::value_ptr(normalMatrix));
-		glUniformMatrix4fv(shader->GetLocMVP(), 1, GL_FALSE, glm::value_ptr(MVP));
-		glUniform3fv(shader->GetLocCameraPos(), 1, glm::value_ptr(cameraPos));
-		// Material properties.
-		glUniform3fv(shader->GetLocKa(), 1, glm::value_ptr(subMesh.material->GetKa()));
-		glUniform3fv(shader->GetLocKd(), 1, glm::value_ptr(subMesh.material->GetKd()));
-		glUniform3fv(shader->GetLocKs(), 1, glm::value_ptr(subMesh.material->GetKs()));
-		glUniform1f(shader->GetLocNs(), subMesh.material->GetNs());
-		if (subMesh.material->GetMapKd() != nullptr) {
-			subMesh.material->GetMapKd()->Bind(GL_TEXTURE0);
-			glUniform1i(shader->GetLocMapKd(), 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, subMesh.iboId);
+		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)subMesh.vertexIndices.size(), GL_UNSIGNED_INT, 0, numInstances);
+	}
+
+	glDisableVertexAttribArray(0);
+}
+
+// Desc: Write the submesh and triangle IDs of the visible clusters. gl_PrimitiveID
+// restarts at every draw, so each range is drawn separately with its first triangle.
+void TriangleMesh::RenderVisibility(
+	const std::shared_ptr<VisibilityShaderProg>& shader,
+	const PreparedFrame& frame
+) const {
+	pImpl->numTrianglesDrawn = 0;
+	pImpl->numDrawCalls = 0;
+
+	shader->Bind();
+	glUniformMatrix4fv(shader->GetLocMVP(), 1, GL_FALSE, glm::value_ptr(frame.MVP));
+
+	glBindBuffer(GL_ARRAY_BUFFER, pImpl->positionVboId);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
+	for (const auto& packet : frame.merged.GetPackets()) {
+		glUniform1ui(shader->GetLocDrawId(), (GLuint)packet.subMesh);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pImpl->subMeshes[packet.subMesh].iboId);
+		for (int r = packet.firstRange; r < packet.firstRange + packet.numRanges; ++r) {
+			const size_t firstIndex = (size_t)frame.merged.drawOffsets[r] / sizeof(unsigned int);
+			glUniform1ui(shader->GetLocFirstTriangle(), (GLuint)(firstIndex / 3));
+			glDrawElements(GL_TRIANGLES, frame.merged.drawCounts[r], GL_UNSIGNED_INT, frame.merged.drawOffsets[r]);
+			++pImpl->numDrawCalls;
+		}
+		pImpl->numTrianglesDrawn += packet.numTriangles;
+	}
+
+	glDisableVertexAttribArray(0);
+	shader->Unbind();
+}
+
+// Desc: Shade the pixels of every submesh with one full-screen triangle, scissored
+// to the screen rectangle of the submesh. The vertex buffer and the index buffer
+// of the submesh are read as shader storage buffers.
+void TriangleMesh::ResolveVisibility(
+	ShaderPermutations<VisibilityResolveShaderProg>& shaderPermutations,
+	const VisibilityBuffer& visibilityBuffer,
+	const PreparedFrame& frame,
+	const glm::vec3& ambientLight,
+	const std::shared_ptr<DirectionalLight>& dirLight,
+	const std::shared_ptr<PointLight>& pointLight,
+	const std::shared_ptr<SpotLight>& spotLight,
+	const std::shared_ptr<ShadowAtlas>& shadowAtlas
+) const {
+	const glm::mat4x4& MVP = frame.MVP;
+	const int width = visibilityBuffer.GetWidth();
+	const int height = visibilityBuffer.GetHeight();
+
+	const unsigned int lightFeatures = GetLightFeatures(dirLight, pointLight, spotLight, shadowAtlas);
+
+	// visibility_resolve.fs reads the vertices as 8 floats.
+	static_assert(sizeof(VertexPTN) == 8 * sizeof(float));
+	visibilityBuffer.Bind();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pImpl->vboId);
+	glEnable(GL_SCISSOR_TEST);
+
+	// Nothing of a submesh was written if it has no packet.
+	VisibilityResolveShaderProg* boundShader = nullptr;
+	for (const auto& packet : frame.merged.GetPackets()) {
+		const auto& subMesh = pImpl->subMeshes[packet.subMesh];
+		auto shader = shaderPermutations.Get(lightFeatures | (HasMapKd(*subMesh.material) ? PHONG_HAS_MAP_KD : 0u));
+		if (shader == nullptr) {
+			continue;
 		}
-		// Light data.
-		if (dirLight != nullptr) {
-			glUniform3fv(shader->GetLocDirLightDir(), 1, glm::value_ptr(dirLight->GetDirection()));
-			glUniform3fv(shader->GetLocDirLightRadiance(), 1, glm::value_ptr(dirLight->GetRadiance()));
+
+		// Screen rectangle of the bounding box, or the whole screen if it crosses the camera plane.
+		glm::vec2 rectMin = glm::vec2(-1.0f, -1.0f);
+		glm::vec2 rectMax = glm::vec2(1.0f, 1.0f);
+		glm::vec2 cornerMin = glm::vec2(1e9, 1e9);
+		glm::vec2 cornerMax = glm::vec2(-1e9, -1e9);
+		bool behindCamera = false;
+		for (int c = 0; c < 8; ++c) {
+			glm::vec3 corner = glm::vec3(
+				(c & 1) ? subMesh.boundsMax.x : subMesh.boundsMin.x,
+				(c & 2) ? subMesh.boundsMax.y : subMesh.boundsMin.y,
+				(c & 4) ? subMesh.boundsMax.z : subMesh.boundsMin.z);
+			glm::vec4 clip = MVP * glm::vec4(corner, 1.0f);
+			if (clip.w <= 1e-5f) {
+				behindCamera = true;
+				break;
+			}
+			cornerMin = glm::min(cornerMin, glm::vec2(clip) / clip.w);
+			cornerMax = glm::max(cornerMax, glm::vec2(clip) / clip.w);
 		}
-		if (pointLight != nullptr) {
-			glUniform3fv(shader->GetLocPointLightPos(), 1, glm::value_ptr(pointLight->GetPosition()));
-			glUniform3fv(shader->GetLocPointLightIntensity(), 1, glm::value_ptr(pointLight->GetIntensity()));
+		if (!behindCamera) {
+			rectMin = glm::clamp(cornerMin, -1.0f, 1.0f);
+			rectMax = glm::clamp(cornerMax, -1.0f, 1.0f);
 		}
-		if (spotLight != nullptr) {
-			glUniform3fv(shader->GetLocSpotLightPos(), 1, glm::value_ptr(spotLight->GetPosition()));
-			glUniform3fv(shader->GetLocSpotLightDir(), 1, glm::value_ptr(spotLight->GetDirection()));
-			glUniform3fv(shader->GetLocSpotLightIntensity(), 1, glm::value_ptr(spotLight->GetIntensity()));
-			glUniform1f(shader->GetLocSpotLightCutoff(), spotLight->GetCutoffDeg());
-			glUniform1f(shader->GetLocSpotLightTotalWidth(), spotLight->GetTotalWidthDeg());
+		const int x0 = (int)std::floor((rectMin.x * 0.5f + 0.5f) * width);
+		const int y0 = (int)std::floor((rectMin.y * 0.5f + 0.5f) * height);
+		const int x1 = (int)std::ceil((rectMax.x * 0.5f + 0.5f) * width);
+		const int y1 = (int)std::ceil((rectMax.y * 0.5f + 0.5f) * height);
+		if (x1 <= x0 || y1 <= y0) {
+			continue;
 		}
-		glUniform3fv(shader->GetLocAmbientLight(), 1, glm::value_ptr(ambientLight));
+		glScissor(x0, y0, x1 - x0, y1 - y0);
+
+		if (shader.get() != boundShader) {
+			shader->Bind();
+			SetPhongFrameUniforms(*shader, lightFeatures, frame, ambientLight, dirLight, pointLight, spotLight, shadowAtlas);
+			glUniform1i(shader->GetLocVisibilityIds(), VisibilityBuffer::kIdTextureUnit - GL_TEXTURE0);
+			glUniform1i(shader->GetLocVisibilityDepth(), VisibilityBuffer::kDepthTextureUnit - GL_TEXTURE0);
+			glUniform2f(shader->GetLocScreenSize(), (float)width, (float)height);
+			boundShader = shader.get();
+		}
+		SetPhongMaterialUniforms(*shader, *subMesh.material);
+		glUniform1ui(shader->GetLocDrawId(), (GLuint)packet.subMesh);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, subMesh.iboId);
 
-		RenderSubMesh(subMesh);
+		// The vertices are generated from gl_VertexID.
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	if (boundShader != nullptr) {
+		boundShader->Unbind();
+	}
+
+	glDisable(GL_SCISSOR_TEST);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+}
 
-		shader->Unbind();
+// Desc: Append the draw ranges of the clusters of the submesh which may face the camera.
+// A cluster is back facing as a whole when every point of its bounding sphere sees
+// every normal of its cone from behind, i.e. |d| * cos(phi + theta) > radius, where d
+// points from the camera to the center, phi is the angle between d and the cone
+// axis, and theta is the cone half angle.
+int TriangleMesh::CullClusters(const TriangleMesh::SubMesh& subMesh, const glm::vec3& cameraPos, PacketBuffer& buffer) const {
+	const int firstRange = buffer.numRanges;
+	unsigned int runEnd = 0;
+	for (const auto& cluster : subMesh.clusters) {
+		if (pImpl->clusterCulling) {
+			glm::vec3 d = cluster.center - cameraPos;
+			float dist = glm::length(d);
+			if (dist > cluster.radius) {
+				float cosPhi = glm::dot(d, cluster.coneAxis) / dist;
+				float sinPhi = std::sqrt(std::max(0.0f, 1.0f - cosPhi * cosPhi));
+				if (dist * (cosPhi * cluster.coneCos - sinPhi * cluster.coneSin) > cluster.radius) {
+					continue;
+				}
+			}
+		}
+
+		// Merge adjacent visible clusters into one draw range.
+		if (buffer.numRanges > firstRange && runEnd == cluster.firstIndex) {
+			buffer.drawCounts[buffer.numRanges - 1] += cluster.indexCount;
+		}
+		else {
+			buffer.drawCounts[buffer.numRanges] = cluster.indexCount;
+			buffer.drawOffsets[buffer.numRanges] = (const void*)(cluster.firstIndex * sizeof(unsigned int));
+			++buffer.numRanges;
+		}
+		runEnd = cluster.firstIndex + cluster.indexCount;
 	}
+	return buffer.numRanges - firstRange;
 }
 
-// Desc: Render the submesh.
-void TriangleMesh::RenderSubMesh(const TriangleMesh::SubMesh& subMesh) const {
+// Desc: Render the draw ranges of a packet.
+void TriangleMesh::RenderSubMesh(const PreparedFrame& frame, const DrawPacket& packet) const {
+	pImpl->numTrianglesDrawn += packet.numTriangles;
+	++pImpl->numDrawCalls;
+
 	glBindBuffer(GL_ARRAY_BUFFER, pImpl->vboId);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, subMesh.iboId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pImpl->subMeshes[packet.subMesh].iboId);
 
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
@@ -335,7 +968,8 @@ void TriangleMesh::RenderSubMesh(const TriangleMesh::SubMesh& subMesh) const {
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (void*)offsetof(VertexPTN, normal));
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (void*)offsetof(VertexPTN, texcoord));
 
-	glDrawElements(GL_TRIANGLES, subMesh.vertexIndices.size(), GL_UNSIGNED_INT, 0);
+	glMultiDrawElements(GL_TRIANGLES, frame.merged.drawCounts + packet.firstRange, GL_UNSIGNED_INT,
+		frame.merged.drawOffsets + packet.firstRange, (GLsizei)packet.numRanges);
 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
@@ -348,6 +982,7 @@ void TriangleMesh::PrintMeshInfo() const {
 	std::cout << "# Vertices: " << pImpl->numVertices << std::endl;
 	std::cout << "# Triangles: " << pImpl->numTriangles << std::endl;
 	std::cout << "# Submeshes: " << pImpl->subMeshes.size() << std::endl;
+	std::cout << "# Clusters: " << pImpl->numClusters << std::endl;
 	std::cout << "Center: (" << pImpl->objCenter.x << " , "
 		<< pImpl->objCenter.y << " , " << pImpl->objCenter.z << ")" << std::endl;
 	std::cout << "Extent: (" << pImpl->objExtent.x << " , "
@@ -0,0 +1,86 @@
+#include "VisibilityBuffer.h"
+
+// C++ STL headers.
+#include <iostream>
+
+// Project headers.
+#include "GLCallCounters.h"
+
+VisibilityBuffer::VisibilityBuffer(const int width, const int height) {
+	this->width = width;
+	this->height = height;
+	fboId = 0;
+	prevFboId = 0;
+	idTexId = 0;
+	depthTexId = 0;
+	CreateTargets();
+}
+
+VisibilityBuffer::~VisibilityBuffer() {
+	ReleaseTargets();
+}
+
+void VisibilityBuffer::Resize(const int width, const int height) {
+	if (width == this->width && height == this->height) {
+		return;
+	}
+	this->width = width;
+	this->height = height;
+	ReleaseTargets();
+	CreateTargets();
+}
+
+void VisibilityBuffer::CreateTargets() {
+	glGenFramebuffers(1, &fboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+
+	// Integer textures can only be fetched, never filtered.
+	glGenTextures(1, &idTexId);
+	glBindTexture(GL_TEXTURE_2D, idTexId);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, width, height, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTexId, 0);
+
+	glGenTextures(1, &depthTexId);
+	glBindTexture(GL_TEXTURE_2D, depthTexId);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexId, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "[ERROR] Visibility framebuffer is incomplete" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VisibilityBuffer::ReleaseTargets() {
+	glDeleteFramebuffers(1, &fboId);
+	glDeleteTextures(1, &idTexId);
+	glDeleteTextures(1, &depthTexId);
+	fboId = 0;
+	idTexId = 0;
+	depthTexId = 0;
+}
+
+void VisibilityBuffer::BeginGeometryPass() {
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFboId);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	const GLuint emptyIds[4] = { kEmptyId, kEmptyId, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, emptyIds);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void VisibilityBuffer::EndGeometryPass() {
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFboId);
+}
+
+void VisibilityBuffer::Bind() const {
+	glActiveTexture(kIdTextureUnit);
+	glBindTexture(GL_TEXTURE_2D, idTexId);
+	glActiveTexture(kDepthTextureUnit);
+	glBindTexture(GL_TEXTURE_2D, depthTexId);
+	glActiveTexture(GL_TEXTURE0);
+}